@@ -0,0 +1,98 @@
+/*
+ * Batched against one-at-a-time B+ tree lookups.
+ *
+ *   make build/bench_bpt_batch
+ *   ./build/bench_bpt_batch [keys] [lookups]
+ *
+ * Builds a tree of shuffled keys, then looks up the same random probes (about half of them missing)
+ * with a bpt_search_equals loop and with bpt_search_batch at a few batch sizes. Every batch has to
+ * give the same answers as the loop.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "binary_plus_tree.h"
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char* argv[]) {
+    const uint32_t num_keys = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000000;
+    const uint32_t num_lookups = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 2000000;
+
+    uint32_t* keys = malloc(sizeof(uint32_t) * num_keys);
+    for (uint32_t i = 0; i < num_keys; i++) keys[i] = i * 3 + 1;
+    uint64_t state = 42;
+    for (uint32_t i = num_keys - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t)(next_random(&state) % (i + 1));
+        const uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    BPTree* tree = malloc(sizeof(BPTree));
+    tree->root = NULL;
+    tree->rightmost = NULL;
+    tree->payload_size = 0;
+    for (uint32_t i = 0; i < num_keys; i++) bpt_insert(tree, keys[i], keys[i] + 1, NULL);
+
+    // every other probe hits a key, the rest fall between keys
+    uint32_t* probes = malloc(sizeof(uint32_t) * num_lookups);
+    for (uint32_t i = 0; i < num_lookups; i++) {
+        probes[i] = (uint32_t)(next_random(&state) % num_keys) * 3 + (i % 2 ? 1 : 2);
+    }
+
+    uint32_t* expected_rows = calloc(num_lookups, sizeof(uint32_t));
+    uint8_t* expected_found = calloc(num_lookups, 1);
+    double start = now_seconds();
+    for (uint32_t i = 0; i < num_lookups; i++) {
+        expected_found[i] = (uint8_t)bpt_search_equals(tree, probes[i], &expected_rows[i]);
+    }
+    const double single = num_lookups / (now_seconds() - start);
+    printf("tree of %u keys, %u lookups\n", num_keys, num_lookups);
+    printf("  one at a time: %12.0f lookups/s\n", single);
+
+    uint32_t* rows = calloc(num_lookups, sizeof(uint32_t));
+    uint8_t* found = calloc(num_lookups, 1);
+    int failed = 0;
+    const int batch_sizes[] = { 8, 64, 512, 4096 };
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        const uint32_t batch = (uint32_t)batch_sizes[b];
+        memset(found, 0, num_lookups);
+        start = now_seconds();
+        for (uint32_t first = 0; first < num_lookups; first += batch) {
+            const uint32_t count = num_lookups - first < batch ? num_lookups - first : batch;
+            bpt_search_batch(tree, probes + first, (int)count, rows + first, found + first);
+        }
+        const double batched = num_lookups / (now_seconds() - start);
+
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < num_lookups; i++) {
+            if (found[i] != expected_found[i] || (found[i] && rows[i] != expected_rows[i])) mismatches++;
+        }
+        printf("  batches of %4u: %12.0f lookups/s  speedup %.2fx  mismatches %u\n",
+               batch, batched, batched / single, mismatches);
+        if (mismatches) failed = 1;
+    }
+
+    free_tree(tree);
+    free(keys);
+    free(probes);
+    free(expected_rows);
+    free(expected_found);
+    free(rows);
+    free(found);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/*
+ * Multi-threaded stress test and benchmark for the B+ tree.
+ *
+ *   make build/bench_bpt_concurrent
+ *   ./build/bench_bpt_concurrent [keys] [max_threads]
+ *
+ * First every thread inserts its own share of shuffled keys at the same time and the tree is checked
+ * for every key. Then point lookup throughput is measured for 1, 2, 4, ... reader threads, once on
+ * a quiet tree and once with a writer inserting new keys the whole time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "binary_plus_tree.h"
+
+#define LOOKUP_SECONDS 1.0
+
+typedef struct {
+    BPTree* tree;
+    const uint32_t* keys;
+    uint32_t begin;
+    uint32_t end;
+    uint64_t operations;
+    uint64_t misses;
+    volatile int* stop;
+} Worker;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void* insert_worker(void* arg) {
+    Worker* worker = arg;
+    for (uint32_t i = worker->begin; i < worker->end; i++) {
+        bpt_insert(worker->tree, worker->keys[i], worker->keys[i] + 1, NULL);
+    }
+    return NULL;
+}
+
+static void* lookup_worker(void* arg) {
+    Worker* worker = arg;
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ (uintptr_t)worker;
+    const uint32_t count = worker->end - worker->begin;
+
+    while (!*worker->stop) {
+        for (int batch = 0; batch < 1024; batch++) {
+            const uint32_t key = worker->keys[worker->begin + next_random(&state) % count];
+            uint32_t row_num;
+            if (!bpt_search_equals(worker->tree, key, &row_num) || row_num != key + 1) worker->misses++;
+            worker->operations++;
+        }
+    }
+    return NULL;
+}
+
+static void* background_writer(void* arg) {
+    Worker* worker = arg;
+    uint32_t key = worker->begin;
+    while (!*worker->stop) {
+        bpt_insert(worker->tree, key, key + 1, NULL);
+        key++;
+        worker->operations++;
+    }
+    return NULL;
+}
+
+static double run_lookups(BPTree* tree, const uint32_t* keys, const uint32_t num_keys, const int threads,
+                          const int with_writer, uint64_t* misses) {
+    volatile int stop = 0;
+    pthread_t* handles = malloc(sizeof(pthread_t) * threads);
+    Worker* workers = calloc(threads, sizeof(Worker));
+    for (int i = 0; i < threads; i++) {
+        workers[i] = (Worker){ .tree = tree, .keys = keys, .begin = 0, .end = num_keys, .stop = &stop };
+        pthread_create(&handles[i], NULL, lookup_worker, &workers[i]);
+    }
+
+    // the writer works above the preloaded key range so readers keep finding exactly what they expect
+    static uint32_t writer_next = 0;
+    if (writer_next == 0) writer_next = num_keys * 4;
+    pthread_t writer;
+    Worker writer_state = { .tree = tree, .begin = writer_next, .stop = &stop };
+    if (with_writer) pthread_create(&writer, NULL, background_writer, &writer_state);
+
+    const double start = now_seconds();
+    usleep((useconds_t)(LOOKUP_SECONDS * 1e6));
+    stop = 1;
+
+    uint64_t operations = 0;
+    *misses = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(handles[i], NULL);
+        operations += workers[i].operations;
+        *misses += workers[i].misses;
+    }
+    const double elapsed = now_seconds() - start;
+    if (with_writer) {
+        pthread_join(writer, NULL);
+        writer_next += (uint32_t)writer_state.operations;
+    }
+
+    free(handles);
+    free(workers);
+    return (double)operations / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    const uint32_t num_keys = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) max_threads = 1;
+
+    uint32_t* keys = malloc(sizeof(uint32_t) * num_keys);
+    for (uint32_t i = 0; i < num_keys; i++) keys[i] = i * 3 + 1;
+    uint64_t state = 42;
+    for (uint32_t i = num_keys - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t)(next_random(&state) % (i + 1));
+        const uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    BPTree* tree = malloc(sizeof(BPTree));
+    tree->root = NULL;
+    tree->rightmost = NULL;
+    tree->payload_size = 0;
+
+    pthread_t* handles = malloc(sizeof(pthread_t) * max_threads);
+    Worker* workers = calloc(max_threads, sizeof(Worker));
+    const double start = now_seconds();
+    for (int i = 0; i < max_threads; i++) {
+        workers[i] = (Worker){ .tree = tree, .keys = keys,
+                               .begin = (uint32_t)((uint64_t)num_keys * i / max_threads),
+                               .end = (uint32_t)((uint64_t)num_keys * (i + 1) / max_threads) };
+        pthread_create(&handles[i], NULL, insert_worker, &workers[i]);
+    }
+    for (int i = 0; i < max_threads; i++) pthread_join(handles[i], NULL);
+    const double insert_seconds = now_seconds() - start;
+
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        uint32_t row_num;
+        if (!bpt_search_equals(tree, keys[i], &row_num) || row_num != keys[i] + 1) missing++;
+    }
+    printf("concurrent insert: %u keys, %d threads, %.0f inserts/s, %u missing\n",
+           num_keys, max_threads, num_keys / insert_seconds, missing);
+
+    double single_thread = 0;
+    int failed = missing != 0;
+    for (int with_writer = 0; with_writer <= 1; with_writer++) {
+        printf("point lookups%s:\n", with_writer ? " with a concurrent writer" : "");
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            uint64_t misses;
+            const double throughput = run_lookups(tree, keys, num_keys, threads, with_writer, &misses);
+            if (threads == 1) single_thread = throughput;
+            printf("  %2d threads: %12.0f lookups/s  speedup %.2fx  misses %llu\n",
+                   threads, throughput, throughput / single_thread, (unsigned long long)misses);
+            if (misses) failed = 1;
+        }
+    }
+
+    free_tree(tree);
+    free(keys);
+    free(handles);
+    free(workers);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
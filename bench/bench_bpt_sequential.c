@@ -0,0 +1,98 @@
+/*
+ * Load throughput and node fill of the B+ tree for increasing and for shuffled keys.
+ *
+ *   make build/bench_bpt_sequential
+ *   ./build/bench_bpt_sequential [keys]
+ *
+ * Increasing keys are what an auto-increment primary key produces: they go through the rightmost leaf
+ * fast path and split the right edge 100/0. Shuffled keys take the regular descent and 50/50 splits.
+ * Every load is checked for every key afterwards.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "binary_plus_tree.h"
+
+typedef struct {
+    uint64_t leaves;
+    uint64_t leaf_keys;
+    uint64_t internal_nodes;
+    uint64_t internal_keys;
+    int height;
+} TreeShape;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void measure_node(const BPTreeNode* node, const int depth, TreeShape* shape) {
+    if (depth > shape->height) shape->height = depth;
+    if (node->is_leaf) {
+        shape->leaves++;
+        shape->leaf_keys += node->num_keys;
+        return;
+    }
+    shape->internal_nodes++;
+    shape->internal_keys += node->num_keys;
+    for (int i = 0; i <= node->num_keys; i++) measure_node(node->pointers[i], depth + 1, shape);
+}
+
+static int run_load(const char* name, const uint32_t* keys, const uint32_t num_keys) {
+    BPTree* tree = malloc(sizeof(BPTree));
+    tree->root = NULL;
+    tree->rightmost = NULL;
+    tree->payload_size = 0;
+
+    const double start = now_seconds();
+    for (uint32_t i = 0; i < num_keys; i++) bpt_insert(tree, keys[i], keys[i] + 1, NULL);
+    const double seconds = now_seconds() - start;
+
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        uint32_t row_num;
+        if (!bpt_search_equals(tree, keys[i], &row_num) || row_num != keys[i] + 1) missing++;
+    }
+
+    TreeShape shape = {0};
+    if (tree->root != NULL) measure_node(tree->root, 1, &shape);
+    printf("%-10s %12.0f inserts/s  %9llu leaves  leaf fill %5.1f%%  internal fill %5.1f%%  height %d  missing %u\n",
+           name, num_keys / seconds, (unsigned long long)shape.leaves,
+           100.0 * (double)shape.leaf_keys / (double)(shape.leaves * MAX_KEYS),
+           shape.internal_nodes ? 100.0 * (double)shape.internal_keys / (double)(shape.internal_nodes * MAX_KEYS) : 0.0,
+           shape.height, missing);
+
+    free_tree(tree);
+    return missing == 0;
+}
+
+int main(int argc, char* argv[]) {
+    const uint32_t num_keys = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 1000000;
+    if (num_keys == 0) return EXIT_FAILURE;
+
+    uint32_t* keys = malloc(sizeof(uint32_t) * num_keys);
+    for (uint32_t i = 0; i < num_keys; i++) keys[i] = i + 1;
+    printf("%u keys\n", num_keys);
+    int ok = run_load("increasing", keys, num_keys);
+
+    uint64_t state = 42;
+    for (uint32_t i = num_keys - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t)(next_random(&state) % (i + 1));
+        const uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    ok &= run_load("shuffled", keys, num_keys);
+
+    free(keys);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,364 @@
+/*
+ * Microbenchmarks of the storage and index hot paths, with JSON output and regression checks.
+ *
+ *   make build/bench_suite
+ *   ./build/bench_suite [--large] [--repeat n] [--baseline previous.json] [--tolerance percent] > results.json
+ *
+ * Every benchmark runs at 10K and 1M rows, and at 10M as well with --large:
+ *   bpt_insert_sequential / bpt_insert_random   bpt_insert of increasing and of shuffled keys into an empty tree
+ *   bpt_search_equals                           point lookups of random keys the tree holds
+ *   bpt_range_scan                              cursor walks over ranges of RANGE_LENGTH keys, per key returned
+ *   table_insert                                allocate_row + serialize_row into a row storage table
+ *   row_slot                                    row_slot of random rows
+ *   filter_rows                                 a two condition WHERE clause against every row in turn
+ *
+ * A table holds at most TABLE_MAX_PAGES pages, so the table benchmarks make their row count of calls in
+ * passes over a full table, table_insert dropping and creating it again between passes.
+ *
+ * Each benchmark is repeated and the fastest run is reported. With --baseline, every result is checked
+ * against the same benchmark in an earlier output: a benchmark regressed when it takes more than
+ * tolerance percent (10 by default) longer per operation, and the exit status is then 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "binary_plus_tree.h"
+#include "database.h"
+#include "session.h"
+#include "statement.h"
+#include "table.h"
+
+#define MAX_RESULTS 64
+#define RANGE_LENGTH 100
+#define ROW_VARIANTS 256
+
+typedef struct {
+    char name[64];
+    uint64_t rows;
+    uint64_t ops;
+    double ns_per_op;
+} Result;
+
+static Result results[MAX_RESULTS];
+static int result_count = 0;
+static int repeat = 3;
+
+// every benchmark folds what it reads into the sink so the compiler can't drop the work
+static volatile uint64_t sink;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void add_result(const char* name, const uint64_t rows, const uint64_t ops, const double seconds) {
+    Result* result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->rows = rows;
+    result->ops = ops;
+    result->ns_per_op = seconds * 1e9 / (double)ops;
+    fprintf(stderr, "%-24s %10llu rows %10.1f ns/op\n", name, (unsigned long long)rows, result->ns_per_op);
+}
+
+static BPTree* new_tree() {
+    BPTree* tree = malloc(sizeof(BPTree));
+    tree->root = NULL;
+    tree->rightmost = NULL;
+    tree->payload_size = 0;
+    return tree;
+}
+
+static uint32_t* shuffled_keys(const uint32_t count, uint64_t* state) {
+    uint32_t* keys = malloc(sizeof(uint32_t) * count);
+    for (uint32_t i = 0; i < count; i++) keys[i] = i + 1;
+    for (uint32_t i = count - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t)(next_random(state) % (i + 1));
+        const uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    return keys;
+}
+
+static double time_inserts(const uint32_t* keys, const uint32_t count) {
+    BPTree* tree = new_tree();
+    const double start = now_seconds();
+    for (uint32_t i = 0; i < count; i++) bpt_insert(tree, keys[i], keys[i], NULL);
+    const double seconds = now_seconds() - start;
+    free_tree(tree);
+    return seconds;
+}
+
+static void bench_tree(const uint32_t rows) {
+    uint64_t state = 42;
+    uint32_t* increasing = malloc(sizeof(uint32_t) * rows);
+    for (uint32_t i = 0; i < rows; i++) increasing[i] = i + 1;
+    uint32_t* shuffled = shuffled_keys(rows, &state);
+
+    double best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        const double seconds = time_inserts(increasing, rows);
+        if (seconds < best) best = seconds;
+    }
+    add_result("bpt_insert_sequential", rows, rows, best);
+
+    best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        const double seconds = time_inserts(shuffled, rows);
+        if (seconds < best) best = seconds;
+    }
+    add_result("bpt_insert_random", rows, rows, best);
+
+    // lookups and scans share one tree of shuffled keys
+    BPTree* tree = new_tree();
+    for (uint32_t i = 0; i < rows; i++) bpt_insert(tree, shuffled[i], shuffled[i], NULL);
+
+    best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        uint64_t found = 0;
+        const double start = now_seconds();
+        for (uint32_t i = 0; i < rows; i++) {
+            uint32_t row_num;
+            found += bpt_search_equals(tree, increasing[shuffled[i] - 1], &row_num);
+        }
+        const double seconds = now_seconds() - start;
+        sink += found;
+        if (seconds < best) best = seconds;
+    }
+    add_result("bpt_search_equals", rows, rows, best);
+
+    const uint32_t scans = rows / RANGE_LENGTH > 0 ? rows / RANGE_LENGTH : 1;
+    uint64_t returned = 0;
+    best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        returned = 0;
+        const double start = now_seconds();
+        for (uint32_t scan = 0; scan < scans; scan++) {
+            BPTCursor cursor;
+            bpt_cursor_seek(&cursor, tree, shuffled[scan] % rows + 1);
+            uint32_t key;
+            uint32_t row_num;
+            for (int i = 0; i < RANGE_LENGTH && bpt_cursor_next(&cursor, &key, &row_num); i++) returned++;
+        }
+        const double seconds = now_seconds() - start;
+        if (seconds < best) best = seconds;
+    }
+    sink += returned;
+    add_result("bpt_range_scan", rows, returned > 0 ? returned : 1, best);
+
+    free_tree(tree);
+    free(increasing);
+    free(shuffled);
+}
+
+static void run_sql(const char* sql) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", sql);
+    const InputBuffer input = { .buffer = buffer, .buffer_length = sizeof(buffer), .input_length = (ssize_t)strlen(buffer) };
+    run_input(current_session, &input);
+}
+
+static Table* create_bench_table() {
+    run_sql("create table bench (id int, n int, name varchar(16), primary key (id))");
+    return find_table(&global_db, "bench");
+}
+
+static Row** make_rows(const TableSchema* schema, uint64_t* state) {
+    Row** rows = malloc(sizeof(Row*) * ROW_VARIANTS);
+    for (int i = 0; i < ROW_VARIANTS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "name%d", (int)(next_random(state) % 50));
+        rows[i] = create_row(schema);
+        set_int_value(schema, rows[i], 0, i);
+        set_int_value(schema, rows[i], 1, (int32_t)(next_random(state) % 1000));
+        set_text_value(schema, rows[i], 2, name);
+    }
+    return rows;
+}
+
+// fills the table and returns how many rows it took, the time is added to seconds
+static uint32_t fill_table(Table* table, Row** rows, const uint64_t limit, double* seconds) {
+    uint32_t count = 0;
+    const double start = now_seconds();
+    while (count < limit) {
+        uint32_t row_num;
+        const Row* row = rows[count % ROW_VARIANTS];
+        if (allocate_row(table, row, &row_num) != 0) break;
+        serialize_row(table, row, row_num);
+        if (row_num >= table->num_rows) table->num_rows = row_num + 1;
+        count++;
+    }
+    *seconds += now_seconds() - start;
+    return count;
+}
+
+static void bench_table(const uint32_t rows) {
+    uint64_t state = 7;
+    Table* table = create_bench_table();
+    Row** variants = make_rows(&table->schema, &state);
+
+    double best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        double seconds = 0;
+        uint64_t done = 0;
+        while (done < rows) {
+            const uint32_t filled = fill_table(table, variants, rows - done, &seconds);
+            done += filled;
+            run_sql("drop table bench");
+            table = create_bench_table();
+            if (filled == 0) break;
+        }
+        if (seconds < best) best = seconds;
+    }
+    add_result("table_insert", rows, rows, best);
+
+    double unused = 0;
+    fill_table(table, variants, UINT64_MAX, &unused);
+    // a slotted page fills up before its last row numbers, only the ones with a slot are read
+    uint32_t* row_nums = malloc(sizeof(uint32_t) * table->num_rows);
+    uint32_t num_rows = 0;
+    for (uint32_t row_num = table_next_row(table, 0); row_num < table->num_rows; row_num = table_next_row(table, row_num + 1)) {
+        row_nums[num_rows++] = row_num;
+    }
+    uint32_t* random_rows = malloc(sizeof(uint32_t) * num_rows);
+    for (uint32_t i = 0; i < num_rows; i++) random_rows[i] = row_nums[next_random(&state) % num_rows];
+
+    best = 1e30;
+    for (int run = 0; run < repeat; run++) {
+        uint64_t checksum = 0;
+        const double start = now_seconds();
+        for (uint32_t i = 0; i < rows; i++) checksum += (uintptr_t)row_slot(table, random_rows[i % num_rows]);
+        const double seconds = now_seconds() - start;
+        sink += checksum;
+        if (seconds < best) best = seconds;
+    }
+    add_result("row_slot", rows, rows, best);
+
+    // the conditions come from the parser, resolved against the table like a statement's
+    Statement statement;
+    char query[] = "select * from bench where n >= 500 and name = 'name7'";
+    const InputBuffer input = { .buffer = query, .buffer_length = sizeof(query), .input_length = (ssize_t)strlen(query) };
+    if (prepare_statement(&input, &statement) == PREPARE_SUCCESS) {
+        const SelectStatement* select_statement = &statement.select_stmt;
+        best = 1e30;
+        for (int run = 0; run < repeat; run++) {
+            uint64_t matches = 0;
+            const double start = now_seconds();
+            for (uint32_t i = 0; i < rows; i++) {
+                matches += filter_rows(select_statement->conditions, select_statement->condition_count, table, row_nums[i % num_rows]) == 1;
+            }
+            const double seconds = now_seconds() - start;
+            sink += matches;
+            if (seconds < best) best = seconds;
+        }
+        add_result("filter_rows", rows, rows, best);
+        free_statement(&statement);
+    }
+
+    run_sql("drop table bench");
+    free(row_nums);
+    free(random_rows);
+    for (int i = 0; i < ROW_VARIANTS; i++) {
+        free(variants[i]->data);
+        free(variants[i]);
+    }
+    free(variants);
+}
+
+static int find_baseline(FILE* baseline, const Result* result, double* ns_per_op) {
+    char line[512];
+    rewind(baseline);
+    while (fgets(line, sizeof(line), baseline) != NULL) {
+        char name[64];
+        unsigned long long rows;
+        unsigned long long ops;
+        double value;
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"rows\": %llu, \"ops\": %llu, \"ns_per_op\": %lf", name, &rows, &ops, &value) != 4) continue;
+        if (strcmp(name, result->name) == 0 && rows == result->rows) {
+            *ns_per_op = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int print_results(FILE* baseline, const double tolerance) {
+    int regressions = 0;
+    printf("{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < result_count; i++) {
+        const Result* result = &results[i];
+        printf("    {\"name\": \"%s\", \"rows\": %llu, \"ops\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f", result->name,
+               (unsigned long long)result->rows, (unsigned long long)result->ops, result->ns_per_op, 1e9 / result->ns_per_op);
+        double previous;
+        if (baseline != NULL && find_baseline(baseline, result, &previous)) {
+            const double threshold = previous * (1 + tolerance / 100);
+            const int regressed = result->ns_per_op > threshold;
+            regressions += regressed;
+            printf(", \"baseline_ns_per_op\": %.2f, \"threshold_ns_per_op\": %.2f, \"regressed\": %s", previous, threshold,
+                   regressed ? "true" : "false");
+            if (regressed) {
+                fprintf(stderr, "REGRESSION %s at %llu rows: %.1f ns/op, baseline %.1f ns/op\n", result->name,
+                        (unsigned long long)result->rows, result->ns_per_op, previous);
+            }
+        }
+        printf("}%s\n", i + 1 < result_count ? "," : "");
+    }
+    printf("  ],\n  \"regressions\": %d\n}\n", regressions);
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    const char* baseline_path = NULL;
+    double tolerance = 10;
+    int large = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--large") == 0) {
+            large = 1;
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--large] [--repeat n] [--baseline previous.json] [--tolerance percent]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (repeat < 1) repeat = 1;
+
+    FILE* baseline = NULL;
+    if (baseline_path != NULL && (baseline = fopen(baseline_path, "r")) == NULL) {
+        perror("could not open the baseline");
+        return EXIT_FAILURE;
+    }
+
+    // statements run through a session like the server's, their output is thrown away
+    Session session;
+    FILE* out = fopen("/dev/null", "w");
+    init_session(&session, &global_db, out);
+    current_session = &session;
+
+    const uint32_t sizes[] = { 10000, 1000000, 10000000 };
+    const int size_count = large ? 3 : 2;
+    for (int i = 0; i < size_count; i++) {
+        bench_tree(sizes[i]);
+        bench_table(sizes[i]);
+    }
+
+    const int regressions = print_results(baseline, tolerance);
+    if (baseline != NULL) fclose(baseline);
+    close_session(&session);
+    fclose(out);
+    return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,471 @@
+/*
+ * YCSB style load driver: workloads A to F against the engine in-process, through SQL statements
+ * the way clients send them.
+ *
+ *   make build/bench_ycsb
+ *   ./build/bench_ycsb [--workload a-f|all] [--records n] [--operations n] [--threads n]
+ *                      [--distribution uniform|zipfian|latest] [--max-scan-length n] [--interval seconds]
+ *
+ *   A  50% read, 50% update                  zipfian
+ *   B  95% read, 5% update                   zipfian
+ *   C  100% read                             zipfian
+ *   D  95% read, 5% insert                   latest
+ *   E  95% scan, 5% insert                   zipfian, scan lengths uniform up to --max-scan-length
+ *   F  50% read, 50% read-modify-write       zipfian
+ *
+ * Every workload starts from a freshly created and loaded usertable of --records rows, loaded by the
+ * same threads that then share --operations operations. Each thread runs its own session. A read is
+ * a primary key SELECT, an update sets one field, a scan is a primary key range and a
+ * read-modify-write is a read and an update in one BEGIN ... COMMIT. Zipfian keys are scattered over
+ * the table by a hash as in YCSB, latest picks the most recently inserted keys.
+ *
+ * Every --interval seconds the driver prints the throughput and the latency percentiles of each
+ * operation in that interval, and at the end of a workload the totals. An operation whose statement
+ * fails, a write conflict or a full table, is counted as failed. Records plus inserts have to fit in
+ * a table of TABLE_MAX_PAGES pages.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "database.h"
+#include "metrics.h"
+#include "session.h"
+#include "transaction.h"
+
+#define ZIPFIAN_CONSTANT 0.99
+#define FIELD_COUNT 4
+#define FIELD_LENGTH 16
+
+typedef enum {
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_READ_MODIFY_WRITE
+} Operation;
+
+#define OPERATIONS 5
+
+static const char* const operation_names[OPERATIONS] = { "read", "update", "insert", "scan", "read-modify-write" };
+
+typedef enum {
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_ZIPFIAN,
+    DISTRIBUTION_LATEST
+} Distribution;
+
+static const char* const distribution_names[] = { "uniform", "zipfian", "latest" };
+
+typedef struct {
+    char name;
+    double proportions[OPERATIONS];
+    Distribution distribution;
+} Workload;
+
+static const Workload workloads[] = {
+    { 'a', { 0.50, 0.50, 0, 0, 0 }, DISTRIBUTION_ZIPFIAN },
+    { 'b', { 0.95, 0.05, 0, 0, 0 }, DISTRIBUTION_ZIPFIAN },
+    { 'c', { 1.00, 0, 0, 0, 0 }, DISTRIBUTION_ZIPFIAN },
+    { 'd', { 0.95, 0, 0.05, 0, 0 }, DISTRIBUTION_LATEST },
+    { 'e', { 0, 0, 0.05, 0.95, 0 }, DISTRIBUTION_ZIPFIAN },
+    { 'f', { 0.50, 0, 0, 0, 0.50 }, DISTRIBUTION_ZIPFIAN },
+};
+
+#define WORKLOADS 6
+
+// the load phase inserts every record before a workload starts
+static const Workload load_phase = { 'l', { 0, 0, 1.00, 0, 0 }, DISTRIBUTION_UNIFORM };
+
+// Gray et al.'s zipfian generator as YCSB has it, the item count can grow as keys are inserted
+typedef struct {
+    uint64_t items;
+    double zeta_two;
+    double zeta_n;
+    double alpha;
+    double eta;
+} Zipfian;
+
+typedef struct {
+    const Workload* workload;
+    Distribution distribution;
+    uint32_t max_scan_length;
+    uint64_t operations_left;
+    uint32_t next_key; // the next key an insert takes
+    uint32_t acknowledged; // keys below this are inserted, reads only pick from them
+    int finished; // workers that ran out of operations
+} Run;
+
+typedef struct {
+    pthread_t thread;
+    Run* run;
+    Session session;
+    FILE* out;
+    uint64_t random_state;
+    Zipfian zipfian;
+    Histogram latencies[OPERATIONS];
+    uint64_t failed[OPERATIONS];
+    char sql[256];
+} Worker;
+
+static uint64_t now_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double random_unit(uint64_t* state) {
+    return (double)(next_random(state) >> 11) / (double)(1ULL << 53);
+}
+
+static uint64_t fnv_hash(uint64_t value) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        hash ^= value & 0xff;
+        hash *= 1099511628211ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+static void zipfian_grow(Zipfian* zipfian, const uint64_t items) {
+    for (uint64_t i = zipfian->items + 1; i <= items; i++) zipfian->zeta_n += 1 / pow((double)i, ZIPFIAN_CONSTANT);
+    zipfian->items = items;
+    zipfian->eta = (1 - pow(2.0 / (double)items, 1 - ZIPFIAN_CONSTANT)) / (1 - zipfian->zeta_two / zipfian->zeta_n);
+}
+
+static void init_zipfian(Zipfian* zipfian, const uint64_t items) {
+    zipfian->items = 0;
+    zipfian->zeta_n = 0;
+    zipfian->zeta_two = 1 + 1 / pow(2, ZIPFIAN_CONSTANT);
+    zipfian->alpha = 1 / (1 - ZIPFIAN_CONSTANT);
+    zipfian_grow(zipfian, items > 2 ? items : 2);
+}
+
+// 0 is the most popular item
+static uint64_t next_zipfian(Zipfian* zipfian, const uint64_t items, uint64_t* state) {
+    if (items > zipfian->items) zipfian_grow(zipfian, items);
+    const double u = random_unit(state);
+    const double uz = u * zipfian->zeta_n;
+    if (uz < 1) return 0;
+    if (uz < 1 + pow(0.5, ZIPFIAN_CONSTANT)) return 1;
+    const uint64_t item = (uint64_t)((double)items * pow(zipfian->eta * u - zipfian->eta + 1, zipfian->alpha));
+    return item < items ? item : items - 1;
+}
+
+static uint32_t choose_key(Worker* worker) {
+    const uint32_t keys = __atomic_load_n(&worker->run->acknowledged, __ATOMIC_ACQUIRE);
+    if (keys == 0) return 0;
+    switch (worker->run->distribution) {
+        case DISTRIBUTION_UNIFORM:
+            return (uint32_t)(next_random(&worker->random_state) % keys);
+        case DISTRIBUTION_ZIPFIAN:
+            return (uint32_t)(fnv_hash(next_zipfian(&worker->zipfian, keys, &worker->random_state)) % keys);
+        case DISTRIBUTION_LATEST:
+            return keys - 1 - (uint32_t)next_zipfian(&worker->zipfian, keys, &worker->random_state);
+    }
+    return 0;
+}
+
+static void random_field(Worker* worker, char* field) {
+    for (int i = 0; i < FIELD_LENGTH; i++) field[i] = (char)('a' + next_random(&worker->random_state) % 26);
+    field[FIELD_LENGTH] = '\0';
+}
+
+// runs one statement in the worker's session, 0 when it failed
+static int run_sql(Worker* worker) {
+    const InputBuffer input = { .buffer = worker->sql, .buffer_length = sizeof(worker->sql), .input_length = (ssize_t)strlen(worker->sql) };
+    const uint64_t errors = metrics_thread_counter(METRIC_STATEMENT_ERRORS);
+    run_input(&worker->session, &input);
+    return metrics_thread_counter(METRIC_STATEMENT_ERRORS) == errors;
+}
+
+static int do_read(Worker* worker, const uint32_t key) {
+    snprintf(worker->sql, sizeof(worker->sql), "select * from usertable where id = %u", key);
+    return run_sql(worker);
+}
+
+static int do_update(Worker* worker, const uint32_t key) {
+    char value[FIELD_LENGTH + 1];
+    random_field(worker, value);
+    snprintf(worker->sql, sizeof(worker->sql), "update usertable set field%d = '%s' where id = %u",
+             (int)(next_random(&worker->random_state) % FIELD_COUNT), value, key);
+    return run_sql(worker);
+}
+
+static int do_insert(Worker* worker) {
+    char fields[FIELD_COUNT][FIELD_LENGTH + 1];
+    for (int i = 0; i < FIELD_COUNT; i++) random_field(worker, fields[i]);
+    const uint32_t key = __atomic_fetch_add(&worker->run->next_key, 1, __ATOMIC_RELAXED);
+    snprintf(worker->sql, sizeof(worker->sql), "insert into usertable values (%u, '%s', '%s', '%s', '%s')", key,
+             fields[0], fields[1], fields[2], fields[3]);
+    const int succeeded = run_sql(worker);
+    // inserts finish out of order, readers may briefly pick a key whose insert is still running
+    uint32_t acknowledged = __atomic_load_n(&worker->run->acknowledged, __ATOMIC_RELAXED);
+    while (acknowledged < key + 1 &&
+           !__atomic_compare_exchange_n(&worker->run->acknowledged, &acknowledged, key + 1, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return succeeded;
+}
+
+static int do_scan(Worker* worker, const uint32_t key) {
+    const uint32_t length = 1 + (uint32_t)(next_random(&worker->random_state) % worker->run->max_scan_length);
+    snprintf(worker->sql, sizeof(worker->sql), "select * from usertable where id >= %u and id < %u", key, key + length);
+    return run_sql(worker);
+}
+
+static int do_read_modify_write(Worker* worker, const uint32_t key) {
+    snprintf(worker->sql, sizeof(worker->sql), "begin");
+    run_sql(worker);
+    const int succeeded = do_read(worker, key) && do_update(worker, key);
+    snprintf(worker->sql, sizeof(worker->sql), "commit");
+    return run_sql(worker) && succeeded;
+}
+
+static Operation choose_operation(Worker* worker) {
+    const double* proportions = worker->run->workload->proportions;
+    double u = random_unit(&worker->random_state);
+    for (int op = 0; op < OPERATIONS; op++) {
+        if (u < proportions[op]) return (Operation)op;
+        u -= proportions[op];
+    }
+    return OP_READ;
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    current_session = &worker->session;
+    while (1) {
+        uint64_t left = __atomic_load_n(&worker->run->operations_left, __ATOMIC_RELAXED);
+        do {
+            if (left == 0) {
+                __atomic_add_fetch(&worker->run->finished, 1, __ATOMIC_RELEASE);
+                return NULL;
+            }
+        } while (!__atomic_compare_exchange_n(&worker->run->operations_left, &left, left - 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+        const Operation op = choose_operation(worker);
+        const uint64_t start = now_nanos();
+        int succeeded = 0;
+        switch (op) {
+            case OP_READ: succeeded = do_read(worker, choose_key(worker)); break;
+            case OP_UPDATE: succeeded = do_update(worker, choose_key(worker)); break;
+            case OP_INSERT: succeeded = do_insert(worker); break;
+            case OP_SCAN: succeeded = do_scan(worker, choose_key(worker)); break;
+            case OP_READ_MODIFY_WRITE: succeeded = do_read_modify_write(worker, choose_key(worker)); break;
+        }
+        histogram_record(&worker->latencies[op], now_nanos() - start);
+        if (!succeeded) __atomic_store_n(&worker->failed[op], worker->failed[op] + 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void sum_workers(Worker* workers, const int threads, Histogram* latencies, uint64_t* failed) {
+    memset(latencies, 0, sizeof(Histogram) * OPERATIONS);
+    memset(failed, 0, sizeof(uint64_t) * OPERATIONS);
+    for (int i = 0; i < threads; i++) {
+        for (int op = 0; op < OPERATIONS; op++) {
+            histogram_merge(&latencies[op], &workers[i].latencies[op]);
+            failed[op] += __atomic_load_n(&workers[i].failed[op], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// what was recorded between two sums, the largest value is only known for the whole run
+static void interval_histogram(Histogram* interval, const Histogram* now, const Histogram* before) {
+    interval->count = now->count - before->count;
+    interval->sum = now->sum - before->sum;
+    interval->max = now->max;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) interval->buckets[i] = now->buckets[i] - before->buckets[i];
+}
+
+static double micros(const uint64_t nanos) {
+    return (double)nanos / 1e3;
+}
+
+static void print_interval(const double elapsed, const double seconds, const Histogram* now, const Histogram* before) {
+    Histogram* interval = malloc(sizeof(Histogram));
+    uint64_t operations = 0;
+    for (int op = 0; op < OPERATIONS; op++) operations += now[op].count - before[op].count;
+    printf("%8.1f s %10.0f ops/s", elapsed, (double)operations / seconds);
+    for (int op = 0; op < OPERATIONS; op++) {
+        interval_histogram(interval, &now[op], &before[op]);
+        if (interval->count == 0) continue;
+        printf(" | %s %llu p50 %.0f p99 %.0f us", operation_names[op], (unsigned long long)interval->count,
+               micros(histogram_percentile(interval, 50)), micros(histogram_percentile(interval, 99)));
+    }
+    printf("\n");
+    fflush(stdout);
+    free(interval);
+}
+
+static void print_totals(const Histogram* latencies, const uint64_t* failed, const double seconds) {
+    printf("  %-18s %10s %8s %10s %9s %9s %9s %9s %9s %9s\n", "operation", "count", "failed", "ops/s", "avg us",
+           "p50", "p95", "p99", "p99.9", "max");
+    for (int op = 0; op < OPERATIONS; op++) {
+        const Histogram* histogram = &latencies[op];
+        if (histogram->count == 0) continue;
+        printf("  %-18s %10llu %8llu %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", operation_names[op],
+               (unsigned long long)histogram->count, (unsigned long long)failed[op], (double)histogram->count / seconds,
+               micros(histogram->sum) / (double)histogram->count, micros(histogram_percentile(histogram, 50)),
+               micros(histogram_percentile(histogram, 95)), micros(histogram_percentile(histogram, 99)),
+               micros(histogram_percentile(histogram, 99.9)), micros(histogram->max));
+    }
+}
+
+// runs the phase to the end, printing a line per interval and the totals
+static void run_phase(Run* run, const int threads, const double interval_seconds, const char* title) {
+    Worker* workers = calloc(threads, sizeof(Worker));
+    Histogram* now = malloc(sizeof(Histogram) * OPERATIONS);
+    Histogram* before = calloc(OPERATIONS, sizeof(Histogram));
+    uint64_t failed[OPERATIONS];
+    if (!workers || !now || !before) {
+        perror("malloc failed");
+        exit(1);
+    }
+
+    Zipfian zipfian;
+    init_zipfian(&zipfian, run->acknowledged);
+    printf("%s\n", title);
+    const uint64_t start = now_nanos();
+    for (int i = 0; i < threads; i++) {
+        Worker* worker = &workers[i];
+        worker->run = run;
+        worker->out = fopen("/dev/null", "w");
+        init_session(&worker->session, &global_db, worker->out);
+        worker->random_state = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+        worker->zipfian = zipfian;
+        pthread_create(&worker->thread, NULL, worker_main, worker);
+    }
+
+    uint64_t last = start;
+    while (__atomic_load_n(&run->finished, __ATOMIC_ACQUIRE) < threads) {
+        usleep(10000);
+        const uint64_t current = now_nanos();
+        if ((double)(current - last) / 1e9 < interval_seconds) continue;
+        sum_workers(workers, threads, now, failed);
+        print_interval((double)(current - start) / 1e9, (double)(current - last) / 1e9, now, before);
+        memcpy(before, now, sizeof(Histogram) * OPERATIONS);
+        last = current;
+    }
+    for (int i = 0; i < threads; i++) pthread_join(workers[i].thread, NULL);
+    const double seconds = (double)(now_nanos() - start) / 1e9;
+
+    sum_workers(workers, threads, now, failed);
+    uint64_t operations = 0;
+    for (int op = 0; op < OPERATIONS; op++) operations += now[op].count;
+    printf("  %llu operations in %.2f s, %.0f ops/s\n", (unsigned long long)operations, seconds, (double)operations / seconds);
+    print_totals(now, failed, seconds);
+
+    for (int i = 0; i < threads; i++) {
+        close_session(&workers[i].session);
+        fclose(workers[i].out);
+    }
+    free(workers);
+    free(now);
+    free(before);
+}
+
+static void run_statement(const char* sql) {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", sql);
+    const InputBuffer input = { .buffer = buffer, .buffer_length = sizeof(buffer), .input_length = (ssize_t)strlen(buffer) };
+    run_input(current_session, &input);
+}
+
+static void run_workload(const Workload* workload, const uint32_t records, const uint64_t operations, const int threads,
+                         const int distribution, const uint32_t max_scan_length, const double interval_seconds) {
+    run_statement("drop table usertable");
+    run_statement("create table usertable (id int, field0 varchar(16), field1 varchar(16), field2 varchar(16), "
+                  "field3 varchar(16), primary key (id))");
+
+    char title[128];
+    Run load = { .workload = &load_phase, .distribution = DISTRIBUTION_UNIFORM, .max_scan_length = 1, .operations_left = records };
+    snprintf(title, sizeof(title), "Load: %u records, %d threads", records, threads);
+    run_phase(&load, threads, interval_seconds, title);
+
+    Run run = {
+        .workload = workload,
+        .distribution = distribution >= 0 ? (Distribution)distribution : workload->distribution,
+        .max_scan_length = max_scan_length,
+        .operations_left = operations,
+        .next_key = load.next_key,
+        .acknowledged = load.acknowledged
+    };
+    snprintf(title, sizeof(title), "Workload %c: %llu operations, %d threads, %s keys", workload->name - 'a' + 'A',
+             (unsigned long long)operations, threads, distribution_names[run.distribution]);
+    run_phase(&run, threads, interval_seconds, title);
+    printf("\n");
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--workload a-f|all] [--records n] [--operations n] [--threads n]\n"
+                    "       [--distribution uniform|zipfian|latest] [--max-scan-length n] [--interval seconds]\n", program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    const char* workload_names = "abcdef";
+    uint32_t records = 1000;
+    uint64_t operations = 100000;
+    int threads = 1;
+    int distribution = -1; // each workload's own
+    uint32_t max_scan_length = 100;
+    double interval_seconds = 1;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char* value = argv[++i];
+        if (strcmp(argv[i - 1], "--workload") == 0) {
+            workload_names = strcmp(value, "all") == 0 ? "abcdef" : value;
+        } else if (strcmp(argv[i - 1], "--records") == 0) {
+            records = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--operations") == 0) {
+            operations = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--threads") == 0) {
+            threads = atoi(value);
+        } else if (strcmp(argv[i - 1], "--distribution") == 0) {
+            for (int d = 0; d < 3; d++) {
+                if (strcmp(value, distribution_names[d]) == 0) distribution = d;
+            }
+            if (distribution < 0) usage(argv[0]);
+        } else if (strcmp(argv[i - 1], "--max-scan-length") == 0) {
+            max_scan_length = (uint32_t)strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--interval") == 0) {
+            interval_seconds = atof(value);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (records == 0 || threads < 1 || max_scan_length == 0 || interval_seconds <= 0) usage(argv[0]);
+
+    // the driver's own session creates the table, the cleaner reclaims what updates leave behind
+    Session session;
+    FILE* out = fopen("/dev/null", "w");
+    init_session(&session, &global_db, out);
+    current_session = &session;
+    start_cleaner();
+
+    for (const char* name = workload_names; *name != '\0'; name++) {
+        int found = 0;
+        for (int w = 0; w < WORKLOADS; w++) {
+            if (workloads[w].name != (*name | 0x20)) continue;
+            found = 1;
+            current_session = &session;
+            run_workload(&workloads[w], records, operations, threads, distribution, max_scan_length, interval_seconds);
+        }
+        if (!found) usage(argv[0]);
+    }
+
+    close_session(&session);
+    fclose(out);
+    return EXIT_SUCCESS;
+}
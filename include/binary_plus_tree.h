@@ -4,29 +4,59 @@
 #define MAX_KEYS 3
 #include <stdint.h>
 
+// largest payload a tree can carry next to each leaf entry, covering indexes copy column values into it
+#define BPT_MAX_PAYLOAD 128
+
+// descents a batched lookup runs side by side
+#define BPT_BATCH_GROUP 8
+
 typedef struct BPTreeNode {
+    uint64_t version; // optimistic lock word, see binary_plus_tree.c
     int is_leaf;
     int num_keys;
     uint32_t keys[MAX_KEYS];
-    void* pointers[MAX_KEYS + 1];
+    void* pointers[MAX_KEYS + 1]; // children of an internal node
+    uint32_t row_nums[MAX_KEYS]; // row numbers a leaf's keys point at
+    uint8_t* payloads; // payload_size bytes per leaf entry, NULL when the tree has no payload
     struct BPTreeNode* next;
     struct BPTreeNode* previous;
 }BPTreeNode;
 
 typedef struct {
     BPTreeNode* root;
+    BPTreeNode* rightmost; // last leaf of the chain, inserts past its largest key append to it directly
     int indexed_col;
+    uint32_t payload_size;
 } BPTree;
 
-void* bpt_search_equals(const BPTreeNode* root, long int key);
-BPTreeNode* bpt_search_greater_equal(BPTreeNode* root, long int key);
+// a copy of the qualifying entries of one leaf, so callers never read a node another thread is changing
+typedef struct {
+    int num_entries;
+    int position;
+    uint32_t keys[MAX_KEYS];
+    uint32_t row_nums[MAX_KEYS];
+    uint32_t payload_size;
+    uint8_t payloads[MAX_KEYS * BPT_MAX_PAYLOAD];
+    BPTreeNode* next_leaf;
+} BPTCursor;
+
+BPTreeNode* bpt_find_leaf(const BPTree* tree, long int key, uint64_t* version);
+int bpt_search_equals(const BPTree* tree, long int key, uint32_t* row_num);
+void bpt_cursor_seek_batch(BPTCursor* cursors, const BPTree* tree, const long int* keys, int count);
+int bpt_search_batch(const BPTree* tree, const uint32_t* keys, int count, uint32_t* row_nums, uint8_t* found);
+void bpt_cursor_seek(BPTCursor* cursor, const BPTree* tree, long int key);
+int bpt_cursor_next(BPTCursor* cursor, uint32_t* key, uint32_t* row_num);
+const uint8_t* bpt_cursor_payload(const BPTCursor* cursor);
 BPTreeNode* create_node(int is_leaf);
-void bpt_insert_internal(BPTree* tree, BPTreeNode* node, uint32_t key, BPTreeNode* right_child);
-void bpt_insert(BPTree* tree, uint32_t key, void* row_ptr);
-BPTreeNode* find_parent(BPTreeNode* root, BPTreeNode* child);
+void bpt_insert(BPTree* tree, uint32_t key, uint32_t row_num, const void* payload);
+int bpt_delete(BPTree* tree, uint32_t key, uint32_t row_num);
+int bpt_update(BPTree* tree, uint32_t key, uint32_t old_row_num, uint32_t new_row_num);
+int bpt_update_payload(BPTree* tree, uint32_t key, uint32_t row_num, const void* payload);
+uint64_t bpt_nodes_visited(void);
+int bpt_height(const BPTree* tree);
 void free_node(BPTreeNode* node);
 void free_tree(BPTree* tree);
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,22 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "overflow.h"
+
+/*
+ * Bloom filter over the values of one column on one page. A value sets BLOOM_HASHES bits picked by
+ * double hashing its 64 bit hash, about BLOOM_BITS_PER_VALUE bits per value keep false positives near 2%.
+ * Bits are only ever set, with atomic ORs, so scans may test a filter while an insert adds to it.
+ */
+#define BLOOM_HASHES 3
+#define BLOOM_BITS_PER_VALUE 10
+
+uint64_t bloom_hash(const char* bytes, size_t length);
+uint64_t bloom_hash_text(const TextValue* value);
+uint32_t bloom_words(uint32_t values);
+void bloom_add(uint64_t* bits, uint32_t words, uint64_t hash);
+int bloom_may_contain(const uint64_t* bits, uint32_t words, uint64_t hash);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * LZ block codec in the style of LZ4: a sequence is a token byte holding the literal count and the
+ * match length minus LZ_MIN_MATCH in its nibbles (15 continues in extra bytes), the literals, then a
+ * two byte offset back into the output. The last sequence has only literals.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+size_t lz_compress(const uint8_t* input, size_t input_length, uint8_t* output, size_t output_capacity);
+int lz_decompress(const uint8_t* input, size_t input_length, uint8_t* output, size_t output_length);
+
+/*
+ * A page stored compressed. Pages are immutable while compressed and every compression gets a new id,
+ * so a decompressed copy cached under the id is never stale.
+ */
+typedef struct {
+    uint64_t id;
+    uint32_t length;
+    uint8_t data[];
+} CompressedPage;
+
+// decompressed pages kept by each thread, a pointer into one stays valid for the next PAGE_CACHE_ENTRIES - 1 misses
+#define PAGE_CACHE_ENTRIES 8
+
+CompressedPage* compress_page(const void* page, size_t page_size);
+void decompress_page(const CompressedPage* compressed, void* page, size_t page_size);
+const void* cached_page(const CompressedPage* compressed, size_t page_size);
+
+#endif
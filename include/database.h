@@ -2,6 +2,7 @@
 #define DATABASE_H
 
 #include <stdint.h>
+#include <pthread.h>
 #include "table.h"
 
 #define MAX_TABLES 32
@@ -10,14 +11,9 @@ typedef struct {
     char name[32];
     uint32_t num_tables;
     Table* tables[MAX_TABLES];
+    pthread_rwlock_t lock; // read locked by every statement, write locked by CREATE/DROP TABLE
 } Database;
 
-/*
-typedef struct {
-    Database* db;
-} Session;
-*/
-
 extern Database global_db;
 
 void init_database(Database* db, const char* name);
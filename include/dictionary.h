@@ -0,0 +1,35 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * String dictionary of a DICTIONARY encoded VARCHAR column: rows store the code of their value and
+ * the dictionary maps codes back to strings. Codes are handed out in insert order and never reused,
+ * entries live in fixed blocks so readers decode codes without a lock while a writer appends.
+ */
+#define DICTIONARY_MAX_CODES 65536
+#define DICTIONARY_BLOCK_SIZE 256
+#define DICTIONARY_NO_CODE (-1)
+
+typedef struct {
+    char* text;
+    uint32_t length;
+} DictionaryEntry;
+
+typedef struct {
+    DictionaryEntry* blocks[DICTIONARY_MAX_CODES / DICTIONARY_BLOCK_SIZE];
+    uint32_t count;
+    uint32_t* buckets; // open addressing, code + 1 of the entry in the bucket or 0 when empty
+    uint32_t capacity;
+    pthread_mutex_t lock; // serializes lookups against the writer growing the buckets
+} Dictionary;
+
+Dictionary* new_dictionary();
+void free_dictionary(Dictionary* dictionary);
+int dictionary_encode(Dictionary* dictionary, const char* text, uint32_t length, uint16_t* code);
+int32_t dictionary_lookup(Dictionary* dictionary, const char* text, uint32_t length, uint32_t* size);
+const DictionaryEntry* dictionary_entry(const Dictionary* dictionary, uint16_t code);
+
+#endif
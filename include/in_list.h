@@ -0,0 +1,34 @@
+#ifndef IN_LIST_H
+#define IN_LIST_H
+
+#include <stdint.h>
+#include "table.h"
+
+/*
+ * Values of an IN (...) condition. Rows are probed against a hash set of the values keyed by the
+ * dictionary code on a DICTIONARY column and by bloom_hash otherwise, so a row costs one probe however
+ * long the list is. Values of a DICTIONARY column that had no code when the list was resolved are
+ * compared as text against rows with newer codes, like a single = condition does.
+ */
+typedef struct {
+    char** values;
+    uint32_t count;
+    uint32_t* lengths; // of the values as compared, cut at the column's declared size
+    int32_t* numbers; // the values of an INT column, the ones that are no int32 are dropped
+    int32_t* codes; // dictionary code of every value or DICTIONARY_NO_CODE, NULL on other columns
+    uint32_t dictionary_size; // codes handed out when the list was resolved
+    uint64_t* hashes; // bloom_hash of every value, also checked against page Bloom filters
+    uint64_t* keys;
+    uint32_t* slots; // open addressing, value index + 1 or 0 when empty
+    uint32_t slot_mask;
+} InList;
+
+InList* new_in_list();
+void in_list_add(InList* list, char* value);
+void resolve_in_list(const Table* table, int col_index, InList* list);
+int in_list_contains_int(const InList* list, int32_t value);
+int in_list_contains_text(const InList* list, const TextValue* value);
+int in_list_contains_code(const InList* list, uint16_t code);
+void free_in_list(InList* list);
+
+#endif
@@ -15,12 +15,17 @@ typedef enum {
     TOKEN_UNKNOWN, TOKEN_EOF,
     TOKEN_PRIMARY, TOKEN_KEY, TOKEN_AND,
     TOKEN_DROP, TOKEN_SHOW, TOKEN_DATABASES, TOKEN_TABLES,
-    TOKEN_DELETE
+    TOKEN_DELETE,
+    TOKEN_BEGIN, TOKEN_COMMIT, TOKEN_ROLLBACK,
+    TOKEN_VACUUM, TOKEN_WITH, TOKEN_DICTIONARY, TOKEN_INCLUDE,
+    TOKEN_IN, TOKEN_OR, TOKEN_UPDATE, TOKEN_SET, TOKEN_ANALYZE, TOKEN_EXPLAIN
 } TokenType;
 
 typedef struct {
     TokenType type;
     char text[256];
+    const char* start; // string tokens point into the input for values longer than text
+    size_t length;
 } Token;
 
 typedef struct {
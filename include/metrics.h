@@ -0,0 +1,118 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Engine-wide counters and histograms. Every thread counts into a shard of its own with plain
+ * relaxed stores, nothing on the hot path is shared between threads. Shards sit on a lock-free list
+ * and are summed when the metrics are read. A thread that exits hands its shard to the next thread
+ * that starts, the counts it made stay in it. Reset remembers the current sums and later reads
+ * subtract them, so it never has to write to a shard another thread owns.
+ *
+ * Histograms are log-linear: HISTOGRAM_SUB_BUCKETS buckets per power of two, so a value is known to
+ * within 1/HISTOGRAM_SUB_BUCKETS of itself. Values from 2^HISTOGRAM_MAX_BITS up share the top bucket,
+ * in nanoseconds that is about 18 minutes.
+ */
+typedef enum {
+    METRIC_STATEMENTS,
+    METRIC_STATEMENT_ERRORS,
+    METRIC_ROWS_SCANNED,
+    METRIC_ROWS_RETURNED,
+    METRIC_ROWS_INSERTED,
+    METRIC_ROWS_UPDATED,
+    METRIC_ROWS_DELETED,
+    METRIC_PAGES_ALLOCATED,
+    METRIC_PAGES_SKIPPED,
+    METRIC_OVERFLOW_PAGES_ALLOCATED,
+    METRIC_OVERFLOW_PAGES_FREED,
+    METRIC_INDEX_LOOKUPS,
+    METRIC_INDEX_NODES_VISITED,
+    METRIC_INDEX_NODES_CREATED,
+    METRIC_INDEX_SPLITS,
+    METRIC_INDEX_RESTARTS,
+    METRIC_COMMITS,
+    METRIC_ROLLBACKS,
+    METRIC_CYCLES, // hardware counters, only counted while they are on
+    METRIC_INSTRUCTIONS,
+    METRIC_LLC_MISSES,
+    METRIC_BRANCH_MISSES
+} Counter;
+
+#define METRIC_COUNTERS 22
+
+typedef enum {
+    HISTOGRAM_ROWS_SCANNED, // per statement
+    HISTOGRAM_ROWS_RETURNED // per statement
+} HistogramMetric;
+
+#define METRIC_HISTOGRAMS 2
+
+// statement latency is kept per statement type and phase, in nanoseconds
+typedef enum {
+    LATENCY_PREPARE,
+    LATENCY_EXECUTE
+} LatencyPhase;
+
+#define LATENCY_PHASES 2
+#define LATENCY_STATEMENT_TYPES 16 // room for every StatementType
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+typedef struct MetricsShard {
+    uint64_t counters[METRIC_COUNTERS];
+    Histogram histograms[METRIC_HISTOGRAMS];
+    Histogram latencies[LATENCY_STATEMENT_TYPES][LATENCY_PHASES];
+    int in_use; // owned by a running thread
+    struct MetricsShard* next;
+} MetricsShard;
+
+extern _Thread_local MetricsShard* metrics_shard;
+
+MetricsShard* claim_metrics_shard(void);
+
+static inline MetricsShard* thread_metrics(void) {
+    MetricsShard* shard = metrics_shard;
+    return shard != NULL ? shard : claim_metrics_shard();
+}
+
+// only the owning thread writes a shard, the relaxed store keeps readers from seeing a torn value
+static inline void metrics_add(const Counter counter, const uint64_t amount) {
+    uint64_t* value = &thread_metrics()->counters[counter];
+    __atomic_store_n(value, *value + amount, __ATOMIC_RELAXED);
+}
+
+// what this thread alone has counted, for measuring the work of one statement
+static inline uint64_t metrics_thread_counter(const Counter counter) {
+    return thread_metrics()->counters[counter];
+}
+
+void histogram_record(Histogram* histogram, uint64_t value);
+void histogram_merge(Histogram* into, const Histogram* from);
+uint64_t histogram_percentile(const Histogram* histogram, double percentile);
+void metrics_record(HistogramMetric metric, uint64_t value);
+void metrics_record_latency(int statement_type, LatencyPhase phase, uint64_t nanos);
+
+typedef struct {
+    uint64_t counters[METRIC_COUNTERS];
+    Histogram histograms[METRIC_HISTOGRAMS];
+    Histogram latencies[LATENCY_STATEMENT_TYPES][LATENCY_PHASES];
+} MetricsSnapshot;
+
+void read_metrics(MetricsSnapshot* snapshot);
+void reset_metrics(void);
+const char* counter_name(Counter counter);
+const char* histogram_name(HistogramMetric metric);
+
+#endif
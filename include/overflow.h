@@ -0,0 +1,45 @@
+#ifndef OVERFLOW_H
+#define OVERFLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * VARCHAR values too large to keep in a row are spilled: the row keeps a SpilledText with the length
+ * and the first VARCHAR_PREFIX_SIZE bytes, the rest of the value goes to a chain of overflow pages.
+ * A spilled value belongs to the version holding it and is freed when that version is reclaimed.
+ */
+#define VARCHAR_PREFIX_SIZE 32
+#define OVERFLOW_PAGE_DATA (4096 - sizeof(void*) - sizeof(uint32_t) * 2) // overflow pages are PAGE_SIZE bytes too
+
+typedef struct OverflowPage {
+    struct OverflowPage* next;
+    uint32_t length;
+    uint32_t reserved;
+    char data[OVERFLOW_PAGE_DATA];
+} OverflowPage;
+
+typedef struct {
+    uint32_t length;
+    char prefix[VARCHAR_PREFIX_SIZE];
+    OverflowPage* rest;
+} SpilledText;
+
+// a VARCHAR value as stored: the bytes kept in the row and, for a spilled value, the chain holding the rest
+typedef struct {
+    const char* bytes;
+    uint32_t inline_length;
+    uint32_t length;
+    const OverflowPage* rest;
+} TextValue;
+
+void spill_text(SpilledText* spilled, const char* text, uint32_t length);
+void free_spilled_text(const SpilledText* spilled);
+TextValue inline_text(const char* text, uint32_t length);
+TextValue spilled_text_value(const SpilledText* spilled);
+void read_text(const TextValue* value, char* out);
+int compare_text(const TextValue* value, const char* target, size_t target_length);
+void print_text(FILE* out, const TextValue* value);
+
+#endif
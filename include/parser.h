@@ -15,6 +15,11 @@ PrepareResult parse_create(Lexer* lexer, Statement* statement, const InputBuffer
 PrepareResult parse_drop(Lexer* lexer, Statement* statement, Token token);
 PrepareResult parse_show(Lexer* lexer, Statement* statement, Token token);
 PrepareResult parse_delete(Lexer* lexer, Statement* statement, Token token);
+PrepareResult parse_update(Lexer* lexer, Statement* statement, Token token);
+PrepareResult parse_transaction_control(Lexer* lexer, Statement* statement, Token token);
+PrepareResult parse_vacuum(Lexer* lexer, Statement* statement, Token token);
+PrepareResult parse_analyze(Lexer* lexer, Statement* statement, Token token);
+PrepareResult parse_explain(Lexer* lexer, Statement* statement, Token token);
 
 
 #endif
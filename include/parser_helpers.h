@@ -5,6 +5,7 @@
 
 ParseResult parse_table_name(Lexer* lexer, char* table_name, size_t size);
 ParseResult parse_condition(Lexer* lexer, Condition* condition);
+ParseResult parse_in_list(Lexer* lexer, Condition* condition);
 ParseResult parse_where_conditions(Lexer* lexer, uint32_t* condition_count, Condition* conditions);
 ParseResult parse_selected_columns(Lexer* col_lexer, const TableSchema* schema, SelectStatement* select_statement);
 ParseResult parse_create_table_name(Lexer* lexer, CreateTableStatement* create_statement);
@@ -13,6 +14,9 @@ ParseResult extract_column_definitions(const InputBuffer* buffer, char* out, siz
 ParseResult parse_create_table_columns(Lexer* lexer, CreateTableStatement* create_statement);
 ParseResult parse_create_table_column(Lexer* lexer, CreateTableStatement* create_statement);
 ParseResult parse_primary_key(Lexer* lexer, CreateTableStatement* create_statement);
+ParseResult parse_include_columns(Lexer* lexer, CreateTableStatement* create_statement);
 ParseResult parse_columns(Lexer* lexer, CreateTableStatement* create_statement);
+ParseResult parse_table_options(Lexer* lexer, CreateTableStatement* create_statement);
+ParseResult parse_table_option(Lexer* lexer, CreateTableStatement* create_statement, const Token* name);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Hardware performance counters from Linux perf_event_open, for telling whether a statement or an
+ * operator is bound by cache misses, branch mispredictions or plain instruction count. Counting is
+ * off until .perf on or --perf turns it on. Every thread then opens its own counters the first time
+ * it reads them, user space only, as one group so a reading is a single read(). An event the CPU,
+ * the kernel or perf_event_paranoid doesn't allow is left out of the group and reported as
+ * unavailable, and with none available, or on another OS, counting stays off.
+ *
+ * When the kernel has to multiplex the group, readings are scaled up by the share of time it ran.
+ */
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES
+} PerfEvent;
+
+#define PERF_EVENTS 4
+
+typedef struct {
+    uint64_t values[PERF_EVENTS];
+    unsigned available; // bit per PerfEvent that was counted
+} PerfReading;
+
+int enable_perf_counters(void);
+void disable_perf_counters(void);
+int perf_counters_enabled(void);
+int read_perf_counters(PerfReading* reading);
+void perf_counters_since(const PerfReading* start, PerfReading* end);
+const char* perf_event_name(PerfEvent event);
+void print_perf_counters(const PerfReading* reading, FILE* out);
+void print_perf_settings(FILE* out);
+const char* perf_counters_error(void);
+
+#endif
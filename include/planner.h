@@ -0,0 +1,48 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdint.h>
+#include "table.h"
+#include "statement.h"
+
+/*
+ * Access path selection for statements with a WHERE clause. The planner estimates the rows every
+ * condition keeps from the statistics of the last ANALYZE and prices three ways to find them: a scan of
+ * every page, a scan that skips pages through their zone maps and Bloom filters, and the primary key
+ * index when every OR group has a condition it answers. The cheapest one runs, and the conditions of each
+ * group are put in order of selectivity so a row stops at the first one it fails. Until a table has been
+ * analyzed the estimates are fixed guesses, so the planner keeps the index whenever it can be used.
+ *
+ * Costs are in units of one row read by a scan.
+ */
+#define COST_PAGE_CHECK 4.0 // zone map and Bloom filter checks of one page
+#define COST_INDEX_LEVEL 2.0 // one node of a descent
+#define COST_INDEX_ROW 3.0 // a row fetched through the index, out of page order
+#define COST_INDEX_ENTRY 0.5 // an entry an index-only scan answers from the leaf
+
+// selectivities guessed for tables without statistics
+#define DEFAULT_EQUAL_SELECTIVITY 0.01
+#define DEFAULT_RANGE_SELECTIVITY (1.0 / 3)
+
+typedef enum {
+    ACCESS_HEAP_SCAN,
+    ACCESS_ZONE_MAP_SCAN,
+    ACCESS_INDEX
+} AccessPath;
+
+#define ACCESS_PATHS 3
+
+typedef struct {
+    AccessPath path;
+    int analyzed; // the estimates come from statistics
+    double rows; // rows the conditions are estimated to keep
+    double costs[ACCESS_PATHS]; // estimated cost of each path, negative when it can't be used
+} AccessPlan;
+
+uint32_t group_end(const Condition* conditions, uint32_t condition_count, uint32_t first);
+uint32_t usable_condition_in_group(const Condition* conditions, uint32_t first, uint32_t end, const Table* table);
+int conditions_use_index(const Condition* conditions, uint32_t condition_count, const Table* table);
+void plan_access(const Table* table, Condition* conditions, uint32_t condition_count, int covered, AccessPlan* plan);
+const char* access_path_name(AccessPath path);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "table.h"
+#include "perf_counters.h"
+
+/*
+ * What EXPLAIN ANALYZE measures while it runs a statement. A plan has three operators: the access path
+ * that reads row slots (a scan or index probes) and passes on the visible versions, the filter that
+ * evaluates the WHERE clause, and the root that prints or changes the rows that match. Each counts the
+ * rows that went in and came out and the time spent inside it on the monotonic clock. Filter and root
+ * time their own calls, the access path gets whatever is left of the statement's time.
+ *
+ * With hardware counters on, the same split is made of the counter readings: filter and root read
+ * the counters around their calls and the access path gets the rest of the statement's counts.
+ *
+ * The session holds a profile only while EXPLAIN ANALYZE runs, every hook does nothing without one.
+ */
+typedef enum {
+    OPERATOR_ACCESS,
+    OPERATOR_FILTER,
+    OPERATOR_ROOT
+} ProfileOperator;
+
+#define PROFILE_OPERATORS 3
+
+typedef struct {
+    uint64_t rows_in;
+    uint64_t rows_out;
+    uint64_t nanos;
+    PerfReading counters;
+} OperatorProfile;
+
+typedef struct {
+    OperatorProfile operators[PROFILE_OPERATORS];
+    uint8_t page_touched[TABLE_MAX_PAGES];
+    uint32_t pages_touched; // distinct heap pages a row slot was read from
+    uint32_t pages_skipped; // pages the zone maps ruled out without reading them
+    uint64_t index_nodes; // B+ tree nodes read by descents and leaf walks
+    uint64_t wall_nanos;
+    uint64_t cpu_nanos; // CPU time of the thread, for the whole statement
+    int counting; // hardware counters were read for this statement
+    PerfReading counters; // for the whole statement
+    PerfReading mark; // the reading when the operator call being timed started
+} QueryProfile;
+
+static inline uint64_t profile_clock(const clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void profile_start(QueryProfile* profile);
+void profile_stop(QueryProfile* profile);
+uint64_t profile_begin(QueryProfile* profile);
+void profile_row(QueryProfile* profile, int visible);
+void profile_page(QueryProfile* profile, uint32_t page_num);
+void profile_operator(QueryProfile* profile, ProfileOperator op, uint64_t start, int passed);
+void print_operator_profile(const QueryProfile* profile, ProfileOperator op, FILE* out);
+void print_profile_totals(const QueryProfile* profile, FILE* out);
+
+#endif
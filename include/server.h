@@ -0,0 +1,29 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include "session.h"
+
+/*
+ * Wire protocol: every request and response is a frame made of a 4 byte big-endian payload length
+ * followed by the payload. A request carries one statement or meta-command, the response carries
+ * everything the REPL would have printed for it. ".exit" is answered and then the connection is closed.
+ */
+#define FRAME_HEADER_SIZE 4
+#define MAX_FRAME_SIZE (1 << 20)
+#define SERVER_MAX_EVENTS 64
+
+typedef struct Connection {
+    int fd;
+    Session session;
+    char* buffer;
+    size_t buffer_length;
+    size_t buffer_capacity;
+    int peer_closed; // the client shut down its side, the frames it sent before are still served
+    struct Connection* next_ready;
+} Connection;
+
+int run_server(const char* socket_path, int workers);
+int run_client(const char* socket_path);
+
+#endif
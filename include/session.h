@@ -0,0 +1,32 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include "database.h"
+#include "input_buffer.h"
+#include "transaction.h"
+#include "profile.h"
+#include "planner.h"
+
+typedef struct {
+    Database* db;
+    Transaction transaction;
+    FILE* out;
+    QueryProfile* profile; // set while EXPLAIN ANALYZE runs a statement
+    AccessPlan plan; // how the running statement finds its rows, valid when planned is set
+    int planned;
+    int remote; // a client of the server, it may not name files on the host
+} Session;
+
+typedef enum {
+    SESSION_CONTINUE,
+    SESSION_EXIT
+} SessionResult;
+
+extern _Thread_local Session* current_session;
+
+void init_session(Session* session, Database* db, FILE* out);
+void close_session(Session* session);
+SessionResult run_input(Session* session, const InputBuffer* input_buffer);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef SLOW_LOG_H
+#define SLOW_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "planner.h"
+
+/*
+ * Statements that take longer than a threshold are appended to a log file, one line each: when it
+ * finished, its prepare and execute time, the access path the planner chose and how many rows it
+ * scanned, returned and wrote, then the statement itself. One log is shared by every session.
+ *
+ * Only the local session and --slow-log choose the file. Clients of the server can turn the log off
+ * and back on, which reopens the file it was last opened with.
+ */
+typedef struct {
+    const char* text;
+    const char* type_name;
+    uint64_t prepare_nanos;
+    uint64_t execute_nanos;
+    const AccessPlan* plan; // NULL when the statement had nothing to plan
+    uint64_t rows_scanned;
+    uint64_t rows_returned;
+    uint64_t rows_written;
+    int failed;
+} StatementRecord;
+
+int open_slow_log(const char* path, double threshold_ms);
+int reopen_slow_log(double threshold_ms);
+void close_slow_log(void);
+int slow_log_wants(uint64_t nanos);
+void log_slow_statement(const StatementRecord* record);
+void print_slow_log_settings(FILE* out);
+
+#endif
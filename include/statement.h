@@ -5,6 +5,7 @@
 #include "input_buffer.h"
 #include "table.h"
 #include "lexer.h"
+#include "in_list.h"
 
 
 typedef enum {
@@ -15,7 +16,14 @@ typedef enum {
     STATEMENT_SHOW_TABLES,
     STATEMENT_CREATE_DATABASE,
     STATEMENT_SHOW_DATABASES,
-    STATEMENT_DELETE
+    STATEMENT_DELETE,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_ROLLBACK,
+    STATEMENT_VACUUM,
+    STATEMENT_UPDATE,
+    STATEMENT_ANALYZE,
+    STATEMENT_EXPLAIN
 }StatementType;
 
 typedef struct {
@@ -23,6 +31,11 @@ typedef struct {
     uint32_t column_index;
     char* value;
     TokenType type;
+    int32_t code; // code of the value on a DICTIONARY column, or DICTIONARY_NO_CODE
+    uint32_t dictionary_size; // codes handed out when the condition was prepared
+    uint64_t hash; // bloom_hash of the value, checked against the pages of a bloom column
+    InList* in_list; // values of a TOKEN_IN condition, which has no value
+    uint32_t group; // conditions of a group are ANDed, the groups are ORed
 } Condition;
 
 typedef struct {
@@ -30,6 +43,10 @@ typedef struct {
     uint32_t num_columns;
     Column columns[MAX_COLUMNS];
     uint32_t primary_col_index;
+    uint32_t include_columns[MAX_COLUMNS];
+    uint32_t include_count;
+    StorageLayout storage;
+    PageCompression compression;
 } CreateTableStatement;
 
 typedef struct {
@@ -64,8 +81,37 @@ typedef struct {
     uint32_t condition_count;
 } DeleteStatement;
 
+typedef struct {
+    char table_name[32];
+} VacuumStatement;
+
+typedef struct {
+    char table_name[32];
+} AnalyzeStatement;
+
+typedef struct {
+    uint32_t column_index;
+    int source_index; // column the value is computed from, -1 when it is the literal
+    char* value; // literal assigned, or the name of the source column
+    int32_t delta; // added to the source column
+} Assignment;
 
 typedef struct {
+    char table_name[32];
+    Assignment assignments[MAX_COLUMNS];
+    uint32_t assignment_count;
+    int has_condition;
+    Condition conditions[MAX_COLUMNS];
+    uint32_t condition_count;
+} UpdateStatement;
+
+typedef struct {
+    int analyze; // run the statement and report what each operator did
+    struct Statement* statement; // SELECT, UPDATE or DELETE being explained
+} ExplainStatement;
+
+
+typedef struct Statement {
     StatementType type;
     union {
         CreateTableStatement create_table_stmt;
@@ -75,6 +121,10 @@ typedef struct {
         CreateDatabaseStatement create_database_stmt;
         ShowTablesStatement show_tables_stmt;
         DeleteStatement delete_stmt;
+        VacuumStatement vacuum_stmt;
+        UpdateStatement update_stmt;
+        AnalyzeStatement analyze_stmt;
+        ExplainStatement explain_stmt;
     };
 } Statement;
 
@@ -92,28 +142,44 @@ typedef enum {
 
 typedef enum {
     EXECUTE_FAIL,
-    EXECUTE_SUCCESS
+    EXECUTE_SUCCESS,
+    EXECUTE_TABLE_FULL // the table has no slot left for a new version, execute_write_statement reports it
 } ExecuteResult;
 
 PrepareResult prepare_statement(const InputBuffer* input_buffer, Statement* statement);
 ExecuteResult execute_statement(const Statement* statement);
+const char* statement_type_name(StatementType type);
 ExecuteResult execute_insert(const InsertStatement* insert_statement);
 ExecuteResult execute_select(const SelectStatement* select_statement);
 ExecuteResult execute_create_table(const CreateTableStatement* create_statement);
 ExecuteResult execute_drop_table(const DropTableStatement* drop_table_statement);
 ExecuteResult execute_show_tables();
 ExecuteResult execute_delete(const DeleteStatement* delete_statement);
-void print_row(const TableSchema* schema, const Row* row, const SelectStatement* select_statement);
+ExecuteResult execute_update(const UpdateStatement* update_statement);
+ExecuteResult execute_write_statement(const Statement* statement);
+ExecuteResult execute_read_statement(const Statement* statement);
+ExecuteResult execute_begin();
+ExecuteResult execute_commit();
+ExecuteResult execute_rollback();
+ExecuteResult execute_vacuum(const VacuumStatement* vacuum_statement);
+ExecuteResult execute_analyze(const AnalyzeStatement* analyze_statement);
+ExecuteResult execute_explain(const ExplainStatement* explain_statement);
+void print_row(Table* table, uint32_t row_num, const SelectStatement* select_statement);
 const char* find_close_parenthesis(const char* open_parenthesis);
 void free_statement(const Statement* statement);
 void free_conditions(uint32_t condition_count, const Condition* conditions);
-int filter_rows(const Condition* conditions, uint32_t condition_count, const Table* table, Row row);
+void resolve_condition(const Table* table, Condition* condition);
+int filter_rows(const Condition* conditions, uint32_t condition_count, Table* table, uint32_t row_num);
+int page_may_match(const Condition* conditions, uint32_t condition_count, const Table* table, uint32_t page_num);
 uint32_t get_primary_condition_index(const SelectStatement* select_statement, const Table* table);
 long parse_target_value(const char* value, int* ok);
-void print_matching_row(const TableSchema* schema, const SelectStatement* stmt, const Table* table, const Row* row, void* row_ptr);
-ExecuteResult process_equal_condition(const SelectStatement* stmt, const Table* table, const Row* row, long target);
-ExecuteResult process_greater_condition(const SelectStatement* stmt, const Table* table, const Row* row, long target, int inclusive);
-ExecuteResult execute_bpt_search(const SelectStatement* select_statement, const Table* table, Row row);
+void print_matching_row(const SelectStatement* stmt, Table* table, uint32_t row_num);
+int index_covers(const SelectStatement* select_statement, const Table* table);
+ExecuteResult process_equal_condition(const SelectStatement* stmt, Table* table, long target, int covered);
+ExecuteResult process_greater_condition(const SelectStatement* stmt, Table* table, long target, int inclusive, int covered);
+ExecuteResult process_in_condition(const SelectStatement* stmt, Table* table, const InList* list, int covered);
+ExecuteResult execute_index_union(const SelectStatement* stmt, Table* table);
+ExecuteResult execute_bpt_search(const SelectStatement* select_statement, Table* table);
 void print_select_header(const SelectStatement* select_statement, const TableSchema* schema) ;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stdint.h>
+#include "table.h"
+#include "statement.h"
+#include "transaction.h"
+
+/*
+ * Statistics ANALYZE collects over the versions visible to its snapshot. Every column gets its number
+ * of distinct values, its range and an equi-depth histogram: bucket bounds with the same number of rows
+ * at or below each bound. Values are compared by their sort key, an INT with its sign bit flipped or the
+ * prefix a zone map keeps of a VARCHAR, so one histogram serves both types. page_span is the average
+ * share of the column's range one page's zone map covers, the smaller it is the more pages a condition
+ * on the column lets a scan skip.
+ */
+#define STATS_BUCKETS 32
+
+typedef struct {
+    uint32_t distinct;
+    uint64_t min_key;
+    uint64_t max_key;
+    uint32_t bucket_count; // fewer than STATS_BUCKETS when the table has fewer rows
+    uint64_t bounds[STATS_BUCKETS];
+    double page_span;
+} ColumnStats;
+
+typedef struct TableStats {
+    uint32_t row_count;
+    uint32_t page_count;
+    ColumnStats columns[MAX_COLUMNS];
+} TableStats;
+
+TableStats* analyze_table(Table* table, const Snapshot* snapshot);
+uint64_t int_sort_key(int32_t value);
+double condition_selectivity(const TableStats* stats, const Table* table, const Condition* condition);
+double condition_page_fraction(const TableStats* stats, const Table* table, const Condition* condition);
+
+#endif
@@ -3,23 +3,51 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <pthread.h>
 #include "binary_plus_tree.h"
+#include "overflow.h"
+#include "dictionary.h"
+#include "compression.h"
+#include "bloom.h"
 
 typedef enum {
     COLUMN_INT,
     COLUMN_VARCHAR
 } ColumnType;
 
+typedef enum {
+    STORAGE_ROW,
+    STORAGE_COLUMN
+} StorageLayout;
+
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_LZ
+} PageCompression;
+
 typedef struct {
     char name[32];
     ColumnType type;
     uint32_t size;
     int is_primary;
     uint32_t index;
+    int dictionary_encoded; // VARCHAR stored as a code into the table's dictionary for the column
+    int bloom_filter; // pages keep a Bloom filter of the column's values
 } Column;
 
 #define MAX_COLUMNS 32
 
+/*
+ * Every row slot in a page starts with a header: the begin/end stamps of the version followed by a
+ * one byte slot flag (0 = holds a version, 1 = free). A stamp with TS_TXN_BIT set holds the id of the
+ * transaction that is still writing it, the commit timestamp replaces it once that transaction commits.
+ * Slots are 8 byte aligned so the stamps can be read and written atomically by concurrent sessions.
+ */
+#define ROW_FLAG_OFFSET (2 * sizeof(uint64_t))
+#define ROW_HEADER_SIZE (ROW_FLAG_OFFSET + 1)
+#define TS_TXN_BIT (1ULL << 63)
+#define TS_INFINITY (TS_TXN_BIT - 1)
+
 #define PAGE_SIZE 4096
 #define TABLE_MAX_PAGES 100
 
@@ -35,6 +63,7 @@ typedef struct {
     Column columns[MAX_COLUMNS];
 } TableSchema;
 
+size_t column_width(const Column* column);
 size_t compute_row_size(const TableSchema* schema);
 
 typedef struct {
@@ -52,13 +81,96 @@ void set_text_value(const TableSchema* schema, const Row* row, int col_index, co
 
 #define TABLE_MAX_PAGES 100
 
+// one bit per slot of a page, set while the slot is free for the next insert to reuse
+#define FREE_MAP_WORDS (PAGE_SIZE / sizeof(uint64_t) / 64)
+
+/*
+ * Zone map of one page of rows: the smallest and largest value of every column over the versions
+ * placed on the page. VARCHAR columns are summarized by their first ZONE_PREFIX_SIZE bytes read as
+ * a big-endian number, which orders the same way as the strings. Inserts only widen the ranges,
+ * VACUUM rebuilds them, so a scan may skip a page whose ranges can't satisfy its WHERE clause.
+ * Columns created with a bloom option also get a Bloom filter per page for equality conditions,
+ * bloom_bits holds the filters of those columns one after another in column order.
+ */
+#define ZONE_PREFIX_SIZE sizeof(uint64_t)
+
+typedef struct {
+    int32_t min_int;
+    int32_t max_int;
+    uint64_t min_prefix;
+    uint64_t max_prefix;
+} ColumnZone;
+
+typedef struct {
+    uint32_t row_count;
+    ColumnZone columns[MAX_COLUMNS];
+    uint64_t* bloom_bits;
+} ZoneMap;
+
+/*
+ * Pages of a STORAGE_ROW table are slotted: a PageHeader, a directory of slots growing from the front
+ * and variable length tuples growing down from the end of the page. A tuple is the row header, one
+ * TUPLE_FIELD_SIZE field per column holding an INT or the offset and length of a VARCHAR, then the
+ * VARCHAR bytes, so a string only takes the bytes it has. Row number page * rows_per_page + slot
+ * names a slot, row numbers past the end of a page's directory are unused.
+ */
+#define TUPLE_FIELD_SIZE sizeof(uint32_t)
+
+/*
+ * Tuples stay below TUPLE_SPILL_THRESHOLD bytes by spilling their longest strings to overflow pages,
+ * the VARCHAR field of a spilled value has TEXT_SPILLED set in its length and points at a SpilledText.
+ * Column chains of VARCHARs declared wider than VARCHAR_INLINE_MAX hold a SpilledText per row.
+ */
+#define TUPLE_SPILL_THRESHOLD (PAGE_SIZE / 4)
+#define TEXT_SPILLED 0x8000
+#define VARCHAR_INLINE_MAX 256
+
+// DICTIONARY encoded columns keep a DICTIONARY_CODE_SIZE code in their tuple field or column chain
+#define DICTIONARY_CODE_SIZE sizeof(uint16_t)
+
+typedef struct {
+    uint16_t slot_count;
+    uint16_t heap_start;
+} PageHeader;
+
+/*
+ * STORAGE_ROW keeps each version in one tuple of pages: the row header followed by every column.
+ * STORAGE_COLUMN keeps only the row headers in pages and gives every column its own chain of pages
+ * in column_pages, so a scan only brings in the columns it reads. Either way a row is addressed by
+ * its row number, which is also what the primary key index points at.
+ *
+ * With COMPRESSION_LZ, VACUUM compresses the sealed pages of a row table: pages behind the one taking
+ * appends whose versions are all committed and not deleted. Readers go through a per-thread cache of
+ * decompressed pages, a writer that needs to stamp a row on a compressed page thaws it back first.
+ */
 typedef struct {
     char name[32];
     TableSchema schema;
+    StorageLayout storage;
     void* pages[TABLE_MAX_PAGES];
+    void* column_pages[MAX_COLUMNS][TABLE_MAX_PAGES];
+    ZoneMap* zone_maps[TABLE_MAX_PAGES];
+    Dictionary* dictionaries[MAX_COLUMNS];
+    PageCompression compression;
+    CompressedPage* compressed_pages[TABLE_MAX_PAGES]; // set instead of pages[] while a sealed page is compressed
+    CompressedPage* retired_pages[TABLE_MAX_PAGES]; // thawed pages readers may still be decompressing
+    uint32_t retired_count;
+    uint32_t compressed_count;
+    uint64_t compressed_bytes;
+    uint64_t free_maps[TABLE_MAX_PAGES][FREE_MAP_WORDS];
+    uint16_t free_counts[TABLE_MAX_PAGES];
+    uint32_t free_slots;
     uint32_t num_rows;
     BPTree* tree;
     int primary_key_index;
+    uint32_t include_columns[MAX_COLUMNS]; // copied into the primary key index leaves, in this order
+    uint32_t include_count;
+    uint8_t all_visible[TABLE_MAX_PAGES]; // set by VACUUM when every version on the page is visible to every snapshot
+    uint32_t live_rows;
+    uint32_t dead_versions;
+    pthread_rwlock_t lock; // read locked by statements, write locked by the cleaner before it frees versions
+    pthread_mutex_t write_lock; // serializes the statements that change the table
+    struct TableStats* stats; // collected by ANALYZE, NULL until the table is analyzed
 } Table;
 
 
@@ -67,9 +179,40 @@ int extract_primary_key(const TableSchema* schema, const Row* row, int pk_index)
 void free_table(Table* table);
 Table* new_table();
 void* row_slot(Table* table, uint32_t row_num);
+void* row_slot_for_write(Table* table, uint32_t row_num);
+uint32_t table_max_rows(const Table* table);
+uint32_t table_rows_per_page(const Table* table);
+void mark_slot_free(Table* table, uint32_t row_num);
+uint32_t table_next_row(Table* table, uint32_t row_num);
+int allocate_row(Table* table, const Row* source, uint32_t* row_num);
+void release_slot(Table* table, uint32_t row_num);
+uint32_t compact_table(Table* table);
+uint32_t compress_table(Table* table);
+void mark_all_visible(Table* table, uint64_t horizon);
+size_t index_payload_size(const Table* table);
+int index_payload_offset(const Table* table, int col_index);
+void build_index_payload(const Table* table, const Row* source, uint8_t* payload);
+uint64_t text_prefix(const char* text, size_t size);
+void zone_map_add(Table* table, uint32_t row_num);
+int page_may_contain(const Table* table, uint32_t page_num, int col_index, uint64_t hash);
 void delete_row(void* row);
-void serialize_row(const TableSchema* schema, const Row* source, void* destination);
-void deserialize_row(const TableSchema* schema, void* source, const Row* destination);
+int row_is_free(const void* row);
+uint64_t row_begin_ts(const void* row);
+uint64_t row_end_ts(const void* row);
+void set_row_begin_ts(void* row, uint64_t ts);
+void set_row_end_ts(void* row, uint64_t ts);
+uint32_t column_rows_per_page(const Table* table, int col_index);
+void* column_value(Table* table, uint32_t row_num, int col_index);
+int32_t column_int(Table* table, uint32_t row_num, int col_index);
+TextValue column_text(Table* table, uint32_t row_num, int col_index);
+uint16_t column_code(Table* table, uint32_t row_num, int col_index);
+int encode_row_values(Table* table, const Row* source);
+void free_spilled_values(Table* table, uint32_t row_num);
+uint32_t field_value(Table* table, const Row* source, int col_index);
+uint32_t write_field(Table* table, uint32_t row_num, int col_index, uint32_t value);
+void update_index_payload(Table* table, uint32_t row_num);
+void serialize_row(Table* table, const Row* source, uint32_t row_num);
+void deserialize_row(Table* table, uint32_t row_num, const Row* destination);
 int32_t get_column_index(const TableSchema* schema, const char* column_name);
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <stdint.h>
+#include "table.h"
+
+#define CLEANER_DEAD_VERSION_THRESHOLD 1024
+#define CLEANER_INTERVAL_SECONDS 1
+
+typedef enum {
+    UNDO_INSERT,
+    UNDO_DELETE,
+    UNDO_UPDATE
+} UndoType;
+
+typedef struct {
+    UndoType type;
+    Table* table;
+    uint32_t row_num;
+    void* row_ptr;
+    int has_key;
+    uint32_t key;
+    int col_index; // field an in-place update overwrote
+    uint32_t old_value;
+} UndoRecord;
+
+typedef struct {
+    uint64_t read_ts;
+    uint64_t txn_id;
+} Snapshot;
+
+typedef struct Transaction {
+    int active;
+    Snapshot snapshot;
+    UndoRecord* undo_log;
+    uint32_t undo_count;
+    uint32_t undo_capacity;
+    struct Transaction* next_active;
+} Transaction;
+
+typedef enum {
+    WRITE_SUCCESS,
+    WRITE_CONFLICT
+} WriteResult;
+
+int begin_transaction(Transaction* txn);
+void commit_transaction(Transaction* txn);
+void rollback_transaction(Transaction* txn);
+void rollback_to_savepoint(Transaction* txn, uint32_t savepoint);
+void log_insert(Transaction* txn, Table* table, uint32_t row_num, void* row_ptr, int has_key, uint32_t key);
+void log_delete(Transaction* txn, Table* table, void* row_ptr);
+void log_update(Transaction* txn, Table* table, uint32_t row_num, int col_index, uint32_t old_value);
+int version_visible(const Snapshot* snapshot, const void* row_ptr);
+void stamp_insert(const Transaction* txn, void* row_ptr);
+WriteResult delete_version(Transaction* txn, Table* table, void* row_ptr);
+uint64_t oldest_active_snapshot();
+uint32_t collect_dead_versions(Table* table, uint64_t horizon);
+uint32_t reclaim_dead_versions(Table* table);
+void run_cleaner();
+void start_cleaner();
+int table_in_use(const Table* table);
+
+#endif
@@ -1,7 +1,10 @@
+require 'socket'
+require 'json'
+
 RSpec.describe 'database' do
-  def run_script(commands)
+  def run_script(commands, args = [])
     raw_output = nil
-    IO.popen("./build/mydb", "r+") do |pipe|
+    IO.popen(["./build/mydb", *args], "r+") do |pipe|
       commands.each do |command|
         pipe.puts command
       end
@@ -14,6 +17,18 @@ RSpec.describe 'database' do
     raw_output.split("\n")
   end
 
+  # sends one statement to a server session and returns the lines it answered with
+  def request(socket, statement)
+    socket.write([statement.bytesize].pack("N") + statement)
+    length = socket.read(4).unpack1("N")
+    socket.read(length).split("\n")
+  end
+
+  # the rows every select in the output printed, without the column headers
+  def printed_rows(result)
+    result.each_with_index.select { |line, i| line.start_with?("(") && i > 0 && !result[i - 1].end_with?("COLUMNS:") }.map(&:first)
+  end
+
   it 'inserts and retrieves a row' do
     result = run_script([
       "create table tablo (c1 int, c2 varchar(31))",
@@ -33,4 +48,540 @@ RSpec.describe 'database' do
       "> ",
     ])
   end
-end
\ No newline at end of file
+
+  it 'rolls back every change made inside a transaction' do
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(31), primary key (c1))",
+      "insert into tablo values (1, 'kept')",
+      "begin",
+      "insert into tablo values (2, 'gone')",
+      "delete from tablo where c1 = 1",
+      "rollback",
+      "select * from tablo",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "> Table tablo created with 2 columns.",
+      "Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2)",
+      "",
+      "(1, kept)",
+      "Executed.",
+      "> ",
+    ])
+  end
+
+  it 'reclaims deleted rows with vacuum and reuses their slots' do
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(31), primary key (c1))",
+      "insert into tablo values (1, 'first')",
+      "insert into tablo values (2, 'second')",
+      "delete from tablo where c1 = 1",
+      "vacuum tablo",
+      "insert into tablo values (3, 'third')",
+      "select * from tablo",
+      ".exit",
+    ])
+    # the background cleaner may reclaim the deleted version before vacuum gets to it
+    result = result.map { |line| line.sub(/\d+ dead versions reclaimed/, "N dead versions reclaimed") }
+    expect(result).to match_array([
+      "> Table tablo created with 2 columns.",
+      "Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Vacuumed tablo: 1 live rows, N dead versions reclaimed, 0 still visible to open snapshots, 0 pages released.",
+      "Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2)",
+      "",
+      "(2, second)",
+      "(3, third)",
+      "Executed.",
+      "> ",
+    ])
+  end
+
+  it 'inserts, updates, deletes and reads rows of a column storage table' do
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(16), c3 int, primary key (c1)) with (storage = column)",
+      "insert into tablo values (1, 'ayse', 30)",
+      "insert into tablo values (2, 'mehmet', 40)",
+      "insert into tablo values (3, 'zeynep', 50)",
+      "update tablo set c3 = 41 where c1 = 2",
+      "delete from tablo where c1 = 1",
+      "select * from tablo",
+      "select c2 from tablo where c3 > 35",
+      "update tablo set c2 = 'x' where c3 = 50",
+      "select * from tablo where c1 = 3",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "> Table tablo created with 3 columns.",
+      "Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2, c3)",
+      "",
+      "(3, zeynep, 50)",
+      "(2, mehmet, 41)",
+      "Executed.",
+      "> COLUMNS:",
+      "(c2)",
+      "",
+      "(zeynep)",
+      "(mehmet)",
+      "Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2, c3)",
+      "",
+      "(3, x, 50)",
+      "Executed.",
+      "> ",
+    ])
+  end
+
+  it 'inserts, updates, deletes and reads dictionary encoded values' do
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(16) dictionary, primary key (c1))",
+      "insert into tablo values (1, 'ankara')",
+      "insert into tablo values (2, 'izmir')",
+      "insert into tablo values (3, 'ankara')",
+      "update tablo set c2 = 'bursa' where c1 = 2",
+      "delete from tablo where c1 = 1",
+      "select * from tablo where c2 = 'ankara'",
+      "select * from tablo where c2 = 'izmir'",
+      "update tablo set c2 = 'izmir' where c2 = 'ankara'",
+      "select * from tablo",
+      ".exit",
+    ])
+    expect(result).to match_array([
+      "> Table tablo created with 2 columns.",
+      "Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2)",
+      "",
+      "(3, ankara)",
+      "Executed.",
+      "> COLUMNS:",
+      "(c1, c2)",
+      "",
+      "Executed.",
+      "> Executed.",
+      "> COLUMNS:",
+      "(c1, c2)",
+      "",
+      "(2, bursa)",
+      "(3, izmir)",
+      "Executed.",
+      "> ",
+    ])
+  end
+
+  it 'reads, updates and deletes rows on compressed pages' do
+    inserts = (1..600).map { |i| "insert into tablo values (#{i}, 'name number #{i % 10}')" }
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(24), primary key (c1)) with (compression = lz)",
+      *inserts,
+      "vacuum tablo",
+      "select * from tablo where c1 = 5",
+      "update tablo set c2 = 'changed' where c1 = 5",
+      "delete from tablo where c1 = 6",
+      "select * from tablo where c1 >= 4 and c1 <= 7",
+      "vacuum tablo",
+      "select * from tablo where c2 = 'name number 3' and c1 < 40",
+      "select * from tablo where c1 = 5 or c1 = 600",
+      ".exit",
+    ])
+    # both vacuums leave sealed pages compressed, the update and delete thaw the page they change
+    expect(result.grep(/pages compressed to/).size).to eq(2)
+    expect(printed_rows(result)).to eq([
+      "(5, name number 5)",
+      "(4, name number 4)",
+      "(5, changed)",
+      "(7, name number 7)",
+      "(3, name number 3)",
+      "(13, name number 3)",
+      "(23, name number 3)",
+      "(33, name number 3)",
+      "(5, changed)",
+      "(600, name number 0)",
+    ])
+  end
+
+  it 'answers covered queries from the index with the same rows as the heap after updates' do
+    result = run_script([
+      "create table tablo (c1 int, c2 int, c3 varchar(16), primary key (c1) include (c2))",
+      "insert into tablo values (1, 20, 'a')",
+      "insert into tablo values (2, 30, 'b')",
+      "insert into tablo values (3, 40, 'c')",
+      "update tablo set c2 = 31 where c1 = 2",
+      "update tablo set c1 = 4 where c1 = 3",
+      "delete from tablo where c1 = 1",
+      "explain select c1, c2 from tablo where c1 >= 1",
+      "select c1, c2 from tablo where c1 >= 1",
+      "explain select c1, c2, c3 from tablo where c1 >= 1",
+      "select c1, c2, c3 from tablo where c1 >= 1",
+      "select c1, c2 from tablo where c1 = 2 and c2 = 31",
+      ".exit",
+    ])
+    expect(result).to include("    -> Index Only Scan on tablo using the primary key: c1 >= 1")
+    expect(result).to include("    -> Index Scan on tablo using the primary key: c1 >= 1")
+    expect(printed_rows(result)).to eq([
+      "(2, 31)",
+      "(4, 40)",
+      "(2, 31, b)",
+      "(4, 40, c)",
+      "(2, 31)",
+    ])
+  end
+
+  it 'inserts, updates, deletes and finds rows by a bloom filtered column' do
+    inserts = (1..400).map { |i| "insert into tablo values (#{i}, 'user#{i}')" }
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(16), primary key (c1)) with (bloom = c2)",
+      *inserts,
+      "select * from tablo where c2 = 'user250'",
+      "update tablo set c2 = 'renamed' where c1 = 250",
+      "select * from tablo where c2 = 'user250'",
+      "select * from tablo where c2 = 'renamed'",
+      "delete from tablo where c2 = 'user7'",
+      "select * from tablo where c1 >= 6 and c1 <= 8",
+      "explain analyze select * from tablo where c2 = 'user100'",
+      ".exit",
+    ])
+    expect(printed_rows(result)).to eq([
+      "(250, user250)",
+      "(250, renamed)",
+      "(6, user6)",
+      "(8, user8)",
+    ])
+    # only the page holding the value is read, the filters rule out the others
+    expect(result).to include("Pages touched: 1, skipped: 3. Index nodes visited: 0.")
+  end
+
+  it 'finds rows with IN lists and OR groups through the index and by scanning' do
+    inserts = (1..150).map { |i| "insert into tablo values (#{i}, 'n#{i % 5}', #{i % 7})" }
+    many_keys = (1..240).step(3).to_a.join(", ")
+    result = run_script([
+      "create table tablo (id int, name varchar(8), age int, primary key (id))",
+      *inserts,
+      "explain select * from tablo where id in (3, 5, 3, 9, 5)",
+      "select * from tablo where id in (3, 5, 3, 9, 5)",
+      "explain select id from tablo where id in (#{many_keys})",
+      "select id from tablo where id in (#{many_keys}) and id >= 130",
+      "select * from tablo where name in ('n1', 'x') and id < 20",
+      "explain select * from tablo where id = 4 or id >= 149 or id = 150",
+      "select * from tablo where id = 4 or id >= 149 or id = 150",
+      "explain select * from tablo where age = 3 and id < 20 or name = 'n3' and id < 10",
+      "select * from tablo where age = 3 and id < 20 or name = 'n3' and id < 10",
+      ".exit",
+    ])
+    expect(result).to include("    -> Index Scan on tablo using the primary key: id IN (5 values)")
+    expect(result).to include("    -> Index Only Scan on tablo using the primary key: id IN (80 values)")
+    expect(result).to include("    -> Index Union on tablo using the primary key: id = 4 OR id >= 149 OR id = 150")
+    expect(result).to include("    -> Zone Map Scan on tablo")
+    # duplicate keys are probed once, 150 and 3 match two groups and are printed once
+    expect(printed_rows(result)).to eq([
+      "(3, n3, 3)",
+      "(5, n0, 5)",
+      "(9, n4, 2)",
+      "(130)",
+      "(133)",
+      "(136)",
+      "(139)",
+      "(142)",
+      "(145)",
+      "(148)",
+      "(1, n1, 1)",
+      "(6, n1, 6)",
+      "(11, n1, 4)",
+      "(16, n1, 2)",
+      "(4, n4, 4)",
+      "(149, n4, 2)",
+      "(150, n0, 3)",
+      "(3, n3, 3)",
+      "(8, n3, 1)",
+      "(10, n0, 3)",
+      "(17, n2, 3)",
+    ])
+  end
+
+  it 'updates rows in place, rolls updates back, moves primary keys and rejects mistyped values' do
+    result = run_script([
+      "create table tablo (c1 int, c2 int, c3 varchar(16), primary key (c1))",
+      "insert into tablo values (1, 10, 'a')",
+      "insert into tablo values (2, 20, 'b')",
+      "begin",
+      "update tablo set c2 = 11 where c1 = 1",
+      "update tablo set c2 = c2 + 1 where c1 = 1",
+      "explain analyze select * from tablo",
+      "commit",
+      "select * from tablo",
+      "begin",
+      "update tablo set c2 = 99, c3 = 'gone' where c1 = 2",
+      "rollback",
+      "select * from tablo",
+      "update tablo set c1 = 7 where c1 = 2",
+      "select * from tablo where c1 = 7",
+      "select * from tablo where c1 = 2",
+      "update tablo set c2 = 'text' where c1 = 1",
+      "select * from tablo",
+      ".exit",
+    ])
+    # the second update rewrites the version the first one wrote instead of adding a third slot
+    expect(result.grep(/-> Seq Scan on tablo \(actual rows in 3, out 2,/).size).to eq(1)
+    expect(result).to include("> Insert type error.")
+    # a scan returns the rows in slot order, the committed update put row 1 after row 2
+    expect(printed_rows(result)).to eq([
+      "(2, 20, b)",
+      "(1, 12, a)",
+      "(2, 20, b)",
+      "(1, 12, a)",
+      "(7, 20, b)",
+      "(1, 12, a)",
+      "(7, 20, b)",
+    ])
+  end
+
+  it 'keeps showing the old version to other transactions until an update commits' do
+    path = "/tmp/mydb_spec_#{Process.pid}.sock"
+    server = Process.spawn("./build/mydb", "--listen", path, out: File::NULL)
+    sleep 0.05 until File.exist?(path)
+    writer = UNIXSocket.new(path)
+    reader = UNIXSocket.new(path)
+
+    request(writer, "create table tablo (c1 int, c2 varchar(16), primary key (c1))")
+    request(writer, "insert into tablo values (1, 'old')")
+    request(writer, "begin")
+    request(writer, "update tablo set c2 = 'new' where c1 = 1")
+    expect(request(reader, "select * from tablo")).to include("(1, old)")
+    expect(request(reader, "update tablo set c2 = 'other' where c1 = 1")).to include("Error: row was changed by a concurrent transaction.")
+    expect(request(writer, "select * from tablo")).to include("(1, new)")
+    request(writer, "commit")
+    expect(request(reader, "select * from tablo")).to include("(1, new)")
+  ensure
+    Process.kill("TERM", server) if server
+    Process.wait(server) if server
+    File.delete(path) if path && File.exist?(path)
+  end
+
+  it 'reports the access path and the actual row counts of every operator with explain analyze' do
+    inserts = (1..2000).map { |i| "insert into tablo values (#{i}, 'n#{i % 5}', #{i % 7})" }
+    result = run_script([
+      "create table tablo (id int, name varchar(8), age int, primary key (id))",
+      *inserts,
+      "explain analyze select * from tablo",
+      "explain analyze select * from tablo where age = 3 and id < 100",
+      "explain analyze select * from tablo where id >= 1995",
+      ".exit",
+    ]).map { |line| line.sub(/time [\d.]+ ms/, "time T") }
+    expect(result).to include(
+      "> Select on tablo (actual rows in 2000, out 2000, time T)",
+      "  -> Seq Scan on tablo (actual rows in 2000, out 2000, time T)",
+      "Pages touched: 18, skipped: 0. Index nodes visited: 0.",
+    )
+    # the zone maps rule out every page past the first
+    expect(result).to include(
+      "> Select on tablo (actual rows in 14, out 14, time T)",
+      "  -> Filter: age = 3 AND id < 100 (actual rows in 113, out 14, time T)",
+      "    -> Zone Map Scan on tablo (actual rows in 113, out 113, time T)",
+      "Pages touched: 1, skipped: 17. Index nodes visited: 0.",
+    )
+    expect(result).to include(
+      "> Select on tablo (actual rows in 6, out 6, time T)",
+      "  -> Filter: id >= 1995 (actual rows in 6, out 6, time T)",
+      "    -> Index Scan on tablo using the primary key: id >= 1995 (actual rows in 6, out 6, time T)",
+    )
+  end
+
+  it 'picks the index for selective predicates and a scan for the others once the table is analyzed' do
+    inserts = (1..2000).map { |i| "insert into tablo values (#{i}, 'n#{i % 5}', #{i % 7})" }
+    result = run_script([
+      "create table tablo (id int, name varchar(8), age int, primary key (id))",
+      *inserts,
+      "explain select * from tablo where id >= 10",
+      "analyze tablo",
+      "explain select * from tablo where id = 1500",
+      "explain select * from tablo where id >= 1990",
+      "explain select * from tablo where id >= 10",
+      ".exit",
+    ])
+    expect(result).to include("> Analyzed tablo: 2000 rows on 18 pages.")
+    # without statistics a usable key condition always takes the index
+    expect(result.grep(/-> .*Scan on tablo/)).to eq([
+      "    -> Index Scan on tablo using the primary key: id >= 10",
+      "    -> Index Scan on tablo using the primary key: id = 1500",
+      "    -> Index Scan on tablo using the primary key: id >= 1990",
+      "    -> Seq Scan on tablo",
+    ])
+    expect(result.grep(/^Estimated rows: \d+ from statistics\./).size).to eq(3)
+    expect(result.grep(/^Estimated rows: 1991 from statistics\. Costs: seq scan 2000\.0 \(chosen\)/).size).to eq(1)
+  end
+
+  it 'counts statements and rows in .stats and zeroes the counters on .stats reset' do
+    result = run_script([
+      "create table tablo (c1 int, primary key (c1))",
+      "insert into tablo values (1)",
+      "insert into tablo values (2)",
+      "select * from tablo",
+      "update tablo set c1 = 3 where c1 = 2",
+      "delete from tablo where c1 = 1",
+      "selec",
+      ".stats json",
+      ".stats reset",
+      ".stats",
+      "insert into tablo values (4)",
+      ".stats",
+      ".exit",
+    ])
+    counters = JSON.parse(result.find { |line| line.start_with?("> {") }.delete_prefix("> "))["counters"]
+    expect(counters.values_at("statements", "statement_errors", "rows_returned", "rows_inserted", "rows_updated",
+                              "rows_deleted", "commits")).to eq([7, 1, 2, 2, 1, 1, 5])
+    expect(result).to include("> Statistics reset.")
+    # the first listing follows the reset, the second the insert after it
+    statements = result.grep(/^(> Counters:|  statements |  rows_inserted )/)
+    expect(statements).to eq([
+      "> Counters:",
+      "  statements                   0",
+      "  rows_inserted                0",
+      "> Counters:",
+      "  statements                   1",
+      "  rows_inserted                1",
+    ])
+  end
+
+  it 'keeps latency percentiles per statement type and logs statements slower than --slow-ms' do
+    log = "/tmp/mydb_spec_#{Process.pid}.log"
+    File.delete(log) if File.exist?(log)
+    result = run_script([
+      "create table tablo (c1 int, primary key (c1))",
+      "insert into tablo values (1)",
+      "select * from tablo where c1 = 1",
+      ".latency",
+      ".slowlog off",
+      "insert into tablo values (2)",
+      ".slowlog on 0",
+      "insert into tablo values (3)",
+      ".exit",
+    ], ["--slow-log", log, "--slow-ms", "0"])
+    latency = result.grep(/^(> )?(statement|insert|select) /).map { |line| line.split(/\s{2,}/).first(3) }
+    expect(latency).to eq([
+      ["> statement", "phase", "count"],
+      ["insert", "prepare", "1"],
+      ["insert", "execute", "1"],
+      ["select", "prepare", "1"],
+      ["select", "execute", "1"],
+    ])
+    expect(result).to include("> Slow query log is off.", "> Slow query log: #{log}, statements over 0.000 ms.")
+    # every statement takes longer than 0 ms, except the one run while the log was off
+    statements = File.readlines(log, chomp: true).map { |line| line.sub(/\A.*? written \d+: /, "") }
+    expect(statements).to eq([
+      "create table tablo (c1 int, primary key (c1))",
+      "insert into tablo values (1)",
+      "select * from tablo where c1 = 1",
+      "insert into tablo values (3)",
+    ])
+    expect(File.read(log)).to include("plan: index")
+  ensure
+    File.delete(log) if log && File.exist?(log)
+  end
+
+  it 'lets clients of the server turn the slow query log off and on but not choose its file' do
+    path = "/tmp/mydb_spec_#{Process.pid}.sock"
+    log = "/tmp/mydb_spec_#{Process.pid}.log"
+    other = "/tmp/mydb_spec_#{Process.pid}.other"
+    server = Process.spawn("./build/mydb", "--listen", path, "--slow-log", log, "--slow-ms", "1000", out: File::NULL)
+    sleep 0.05 until File.exist?(path)
+    client = UNIXSocket.new(path)
+
+    expect(request(client, ".slowlog #{other} 0")).to eq(["Error: only the local session can choose the slow query log file."])
+    expect(File.exist?(other)).to eq(false)
+    expect(request(client, ".slowlog off")).to eq(["Slow query log is off."])
+    expect(request(client, ".slowlog on 0")).to eq(["Slow query log: #{log}, statements over 0.000 ms."])
+    request(client, "create table tablo (c1 int)")
+    expect(File.readlines(log, chomp: true).map { |line| line.sub(/\A.*? written \d+: /, "") }).to eq(["create table tablo (c1 int)"])
+  ensure
+    Process.kill("TERM", server) if server
+    Process.wait(server) if server
+    [path, log, other].each { |file| File.delete(file) if file && File.exist?(file) }
+  end
+
+  it 'reports a full table and reuses the slots of deleted rows without waiting for the cleaner' do
+    long_value = "x" * 200
+    inserts = (1..1701).map { |i| "insert into tablo values (#{i}, '#{long_value}')" }
+    reinserts = (2001..2100).map { |i| "insert into tablo values (#{i}, '#{long_value}')" }
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(255))",
+      *inserts,
+      "delete from tablo where c1 <= 100",
+      *reinserts,
+      "select c1 from tablo where c1 >= 2001",
+      ".exit",
+    ])
+    expect(result.grep(/Table full/)).to eq(["> Error: Table full."])
+    expect(printed_rows(result).size).to eq(100)
+  end
+
+  it 'prunes pages by zone maps for empty strings' do
+    inserts = (1..400).map { |i| "insert into tablo values (#{i}, 'user#{i}')" }
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(16))",
+      *inserts,
+      "insert into tablo values (401, '')",
+      "select * from tablo where c2 = ''",
+      "select * from tablo where c2 < 'user1'",
+      "explain analyze select * from tablo where c2 = ''",
+      ".exit",
+    ])
+    expect(printed_rows(result)).to eq(["(401, )", "(401, )"])
+    expect(result.grep(/^Pages touched: 1, skipped: [1-9]/).size).to eq(1)
+  end
+
+  it 'spills long VARCHAR values to overflow pages and frees them with the versions holding them' do
+    long_value = (0...9000).map { |i| ("a".ord + i * 7 % 26).chr }.join
+    other_value = long_value.reverse
+    result = run_script([
+      "create table tablo (c1 int, c2 varchar(10000), primary key (c1))",
+      "insert into tablo values (1, '#{long_value}')",
+      "insert into tablo values (2, 'small')",
+      "select * from tablo where c1 = 1",
+      "update tablo set c2 = 'short' where c1 = 1",
+      "select * from tablo where c1 = 1",
+      "update tablo set c2 = '#{other_value}' where c1 = 1",
+      "select * from tablo where c1 = 1",
+      "delete from tablo where c1 = 1",
+      "vacuum tablo",
+      ".stats json",
+      "select * from tablo",
+      ".exit",
+    ])
+    # the lexer keeps the whole literal, every byte comes back from the chain
+    expect(printed_rows(result)).to eq([
+      "(1, #{long_value})",
+      "(1, short)",
+      "(1, #{other_value})",
+      "(2, small)",
+    ])
+    counters = JSON.parse(result.find { |line| line.start_with?("> {") }.delete_prefix("> "))["counters"]
+    # each long value takes three pages after its prefix, both chains are gone once their versions are reclaimed
+    expect(counters.values_at("overflow_pages_allocated", "overflow_pages_freed")).to eq([6, 6])
+  end
+end
@@ -1,56 +1,340 @@
 #include "binary_plus_tree.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+/*
+ * Optimistic lock coupling: every node carries a version word where bit 1 is the write lock. Writers
+ * take the lock and bump the version when they release it. Readers never write to shared memory,
+ * they remember the version they saw, read the node and check the version again, restarting from the
+ * root when it moved. Nodes are never freed while the tree is in use, so a stale pointer is always
+ * safe to read and gets caught by the version check.
+ */
+#define NODE_LOCKED 2
+
+// nodes this thread has read, every descent and leaf walk goes through read_lock_or_restart
+uint64_t bpt_nodes_visited(void) {
+    return metrics_thread_counter(METRIC_INDEX_NODES_VISITED);
+}
 
-void* bpt_search_equals(const BPTreeNode* root, const long int key) {
-    if (root == NULL) return NULL;
+static uint64_t read_lock_or_restart(const BPTreeNode* node, int* restart) {
+    metrics_add(METRIC_INDEX_NODES_VISITED, 1);
+    const uint64_t version = __atomic_load_n(&node->version, __ATOMIC_ACQUIRE);
+    if (version & NODE_LOCKED) {
+        sched_yield();
+        metrics_add(METRIC_INDEX_RESTARTS, 1);
+        *restart = 1;
+    }
+    return version;
+}
 
-    const BPTreeNode* node = root;
+static void check_or_restart(const BPTreeNode* node, const uint64_t version, int* restart) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&node->version, __ATOMIC_RELAXED) != version) {
+        metrics_add(METRIC_INDEX_RESTARTS, 1);
+        *restart = 1;
+    }
+}
 
-    while (!node->is_leaf) {
-        int index = 0;
-        while (index < node->num_keys && key >= node->keys[index]) index++;
-        node = (BPTreeNode*)node->pointers[index];
+static void upgrade_to_write_lock_or_restart(BPTreeNode* node, uint64_t version, int* restart) {
+    if (!__atomic_compare_exchange_n(&node->version, &version, version + NODE_LOCKED, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        metrics_add(METRIC_INDEX_RESTARTS, 1);
+        *restart = 1;
     }
+}
+
+static void write_unlock(BPTreeNode* node) {
+    __atomic_fetch_add(&node->version, NODE_LOCKED, __ATOMIC_RELEASE);
+}
+
+static BPTreeNode* load_root(const BPTree* tree) {
+    return __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+}
+
+BPTreeNode* bpt_find_leaf(const BPTree* tree, const long int key, uint64_t* version) {
+    while (1) {
+        BPTreeNode* node = load_root(tree);
+        if (node == NULL) return NULL;
 
-    for (int i = 0; i < node->num_keys; i++) {
-        if (key == node->keys[i]) return node->pointers[i];
+        int restart = 0;
+        uint64_t node_version = read_lock_or_restart(node, &restart);
+
+        // descend to the leftmost leaf that may hold the key, duplicates can sit on both sides of a separator
+        while (!restart && !node->is_leaf) {
+            int index = 0;
+            while (index < node->num_keys && key > node->keys[index]) index++;
+            BPTreeNode* child = node->pointers[index];
+
+            check_or_restart(node, node_version, &restart);
+            if (restart) break;
+            node = child;
+            node_version = read_lock_or_restart(node, &restart);
+        }
+        if (restart) continue;
+
+        *version = node_version;
+        return node;
     }
-    return NULL;
 }
 
-BPTreeNode* bpt_search_greater_equal(BPTreeNode* root, const long int key) {
-    if (root == NULL) return NULL;
+static int load_leaf(BPTCursor* cursor, const BPTreeNode* leaf, const uint64_t version, const long int min_key) {
+    int num_keys = leaf->num_keys;
+    if (num_keys > MAX_KEYS) num_keys = MAX_KEYS;
+
+    int count = 0;
+    const uint32_t payload_size = cursor->payload_size;
+    for (int i = 0; i < num_keys; i++) {
+        if (leaf->keys[i] < min_key) continue;
+        cursor->keys[count] = leaf->keys[i];
+        cursor->row_nums[count] = leaf->row_nums[i];
+        if (payload_size) memcpy(cursor->payloads + count * payload_size, leaf->payloads + i * payload_size, payload_size);
+        count++;
+    }
+    BPTreeNode* next = leaf->next;
 
-    BPTreeNode* node = root;
+    int restart = 0;
+    check_or_restart(leaf, version, &restart);
+    if (restart) return 0;
 
-    while (!node->is_leaf) {
-        int index = 0;
-        while (index < node->num_keys && key >= node->keys[index]) index++;
-        node = (BPTreeNode*)node->pointers[index];
+    cursor->num_entries = count;
+    cursor->position = 0;
+    cursor->next_leaf = next;
+    return 1;
+}
+
+void bpt_cursor_seek(BPTCursor* cursor, const BPTree* tree, const long int key) {
+    metrics_add(METRIC_INDEX_LOOKUPS, 1);
+    cursor->payload_size = tree->payload_size;
+    while (1) {
+        uint64_t version;
+        const BPTreeNode* leaf = bpt_find_leaf(tree, key, &version);
+        if (leaf == NULL) {
+            cursor->num_entries = 0;
+            cursor->position = 0;
+            cursor->next_leaf = NULL;
+            return;
+        }
+        if (load_leaf(cursor, leaf, version, key)) return;
+    }
+}
+
+int bpt_cursor_next(BPTCursor* cursor, uint32_t* key, uint32_t* row_num) {
+    // leaves emptied by bpt_delete stay linked, so keep walking right until an entry turns up
+    while (cursor->position == cursor->num_entries) {
+        const BPTreeNode* leaf = cursor->next_leaf;
+        if (leaf == NULL) return 0;
+
+        // leaves are only ever split to the right, so retrying the same leaf can't skip entries
+        int restart = 0;
+        const uint64_t version = read_lock_or_restart(leaf, &restart);
+        if (!restart) load_leaf(cursor, leaf, version, 0);
+    }
+
+    *key = cursor->keys[cursor->position];
+    *row_num = cursor->row_nums[cursor->position];
+    cursor->position++;
+    return 1;
+}
+
+// the payload of the entry bpt_cursor_next returned last
+const uint8_t* bpt_cursor_payload(const BPTCursor* cursor) {
+    return cursor->payloads + (cursor->position - 1) * cursor->payload_size;
+}
+
+int bpt_search_equals(const BPTree* tree, const long int key, uint32_t* row_num) {
+    BPTCursor cursor;
+    bpt_cursor_seek(&cursor, tree, key);
+
+    uint32_t found_key;
+    return bpt_cursor_next(&cursor, &found_key, row_num) && found_key == key;
+}
+
+/*
+ * Batched lookups run BPT_BATCH_GROUP descents side by side, one level per round: each descent picks
+ * its child and prefetches it, and the node is only read in the next round, after the other descents
+ * had their turn. The cache misses of a group overlap instead of stalling one after the other.
+ */
+static void prefetch_node(const BPTreeNode* node) {
+    __builtin_prefetch(node);
+    __builtin_prefetch((const char*)node + 64);
+}
+
+// finds the leaves for up to BPT_BATCH_GROUP keys, a NULL leaf means that descent has to be retried alone
+static void find_leaves(const BPTree* tree, const long int* keys, const int count, const BPTreeNode** leaves,
+                        uint64_t* versions) {
+    const BPTreeNode* root = load_root(tree);
+    const BPTreeNode* nodes[BPT_BATCH_GROUP];
+    int active = 0;
+    for (int i = 0; i < count; i++) {
+        nodes[i] = root;
+        leaves[i] = NULL;
+        if (root != NULL) active++;
+    }
+
+    while (active > 0) {
+        for (int i = 0; i < count; i++) {
+            const BPTreeNode* node = nodes[i];
+            if (node == NULL) continue;
+
+            int restart = 0;
+            const uint64_t version = read_lock_or_restart(node, &restart);
+            if (!restart && node->is_leaf) {
+                leaves[i] = node;
+                versions[i] = version;
+            }
+            if (restart || node->is_leaf) {
+                nodes[i] = NULL;
+                active--;
+                continue;
+            }
+
+            int index = 0;
+            while (index < node->num_keys && keys[i] > node->keys[index]) index++;
+            const BPTreeNode* child = node->pointers[index];
+            check_or_restart(node, version, &restart);
+            if (restart) {
+                nodes[i] = NULL;
+                active--;
+                continue;
+            }
+            prefetch_node(child);
+            nodes[i] = child;
+        }
+    }
+}
+
+// the leaf the previous cursor loaded answers the key as well when it holds an entry at or above it
+static int reuse_leaf(BPTCursor* cursor, const BPTCursor* previous, const long int key) {
+    if (previous == NULL || previous->num_entries == 0 || previous->keys[previous->num_entries - 1] < key) return 0;
+
+    // copies only the payload bytes in use, most trees have none
+    cursor->num_entries = previous->num_entries;
+    memcpy(cursor->keys, previous->keys, sizeof(previous->keys));
+    memcpy(cursor->row_nums, previous->row_nums, sizeof(previous->row_nums));
+    cursor->payload_size = previous->payload_size;
+    memcpy(cursor->payloads, previous->payloads, (size_t)previous->num_entries * previous->payload_size);
+    cursor->next_leaf = previous->next_leaf;
+    cursor->position = 0;
+    while (cursor->keys[cursor->position] < key) cursor->position++;
+    return 1;
+}
+
+// seeks up to BPT_BATCH_GROUP cursors, previous is the cursor of the key before the group or NULL
+static void seek_group(BPTCursor* cursors, const BPTree* tree, const long int* keys, const int count,
+                       const BPTCursor* previous) {
+    metrics_add(METRIC_INDEX_LOOKUPS, (uint64_t)count);
+    // keys the previous leaf holds don't descend at all, they are a prefix of the sorted group
+    int reused = 0;
+    while (reused < count && reuse_leaf(&cursors[reused], previous, keys[reused])) reused++;
+
+    const BPTreeNode* leaves[BPT_BATCH_GROUP];
+    uint64_t versions[BPT_BATCH_GROUP];
+    find_leaves(tree, keys + reused, count - reused, leaves + reused, versions + reused);
+
+    for (int i = reused; i < count; i++) {
+        cursors[i].payload_size = tree->payload_size;
+        if (i > 0 && reuse_leaf(&cursors[i], &cursors[i - 1], keys[i])) continue;
+        if (leaves[i] == NULL || !load_leaf(&cursors[i], leaves[i], versions[i], keys[i])) {
+            bpt_cursor_seek(&cursors[i], tree, keys[i]);
+        }
     }
+}
+
+void bpt_cursor_seek_batch(BPTCursor* cursors, const BPTree* tree, const long int* keys, const int count) {
+    // keys come in ascending order, neighbouring keys mostly share a path and often a leaf
+    for (int first = 0; first < count; first += BPT_BATCH_GROUP) {
+        const int group = count - first < BPT_BATCH_GROUP ? count - first : BPT_BATCH_GROUP;
+        seek_group(cursors + first, tree, keys + first, group, first > 0 ? &cursors[first - 1] : NULL);
+    }
+}
+
+typedef struct {
+    long int key;
+    int index;
+} BatchKey;
+
+static int compare_batch_keys(const void* a, const void* b) {
+    const long int left = ((const BatchKey*)a)->key;
+    const long int right = ((const BatchKey*)b)->key;
+    return (left > right) - (left < right);
+}
 
-    for (int i = 0; i < node->num_keys; i++) {
-        if (node->keys[i] >= key) return node;
+int bpt_search_batch(const BPTree* tree, const uint32_t* keys, const int count, uint32_t* row_nums, uint8_t* found) {
+    BatchKey* sorted = malloc(sizeof(BatchKey) * (count > 0 ? count : 1));
+    if (!sorted) {
+        perror("malloc failed");
+        exit(1);
     }
-    return NULL;
+    for (int i = 0; i < count; i++) sorted[i] = (BatchKey){ .key = keys[i], .index = i };
+    qsort(sorted, count, sizeof(BatchKey), compare_batch_keys);
+
+    int hits = 0;
+    BPTCursor cursors[BPT_BATCH_GROUP];
+    BPTCursor previous;
+    long int group_keys[BPT_BATCH_GROUP];
+    for (int first = 0; first < count; first += BPT_BATCH_GROUP) {
+        const int group = count - first < BPT_BATCH_GROUP ? count - first : BPT_BATCH_GROUP;
+        for (int i = 0; i < group; i++) group_keys[i] = sorted[first + i].key;
+
+        seek_group(cursors, tree, group_keys, group, first > 0 ? &previous : NULL);
+        for (int i = 0; i < group; i++) {
+            const int index = sorted[first + i].index;
+            uint32_t key;
+            found[index] = bpt_cursor_next(&cursors[i], &key, &row_nums[index]) && key == group_keys[i];
+            hits += found[index];
+        }
+        previous = cursors[group - 1];
+    }
+    free(sorted);
+    return hits;
 }
 
 BPTreeNode* create_node(const int is_leaf) {
+    metrics_add(METRIC_INDEX_NODES_CREATED, 1);
     BPTreeNode* node = malloc(sizeof(BPTreeNode));
+    node->version = 0;
     node->is_leaf = is_leaf;
     node->num_keys = 0;
     node->next = NULL;
     node->previous = NULL;
+    node->payloads = NULL;
     for (int i = 0; i < MAX_KEYS + 1; i++) {
         node->pointers[i] = NULL;
     }
     return node;
 }
 
+static BPTreeNode* create_leaf(const BPTree* tree) {
+    BPTreeNode* leaf = create_node(1);
+    if (tree->payload_size) leaf->payloads = malloc((size_t)MAX_KEYS * tree->payload_size);
+    return leaf;
+}
+
+static void copy_payload(const BPTree* tree, BPTreeNode* to, const int to_index, const BPTreeNode* from, const int from_index) {
+    if (tree->payload_size == 0) return;
+    memcpy(to->payloads + to_index * tree->payload_size, from->payloads + from_index * tree->payload_size, tree->payload_size);
+}
+
+static void insert_into_leaf(const BPTree* tree, BPTreeNode* node, const uint32_t key, const uint32_t row_num, const void* payload) {
+    int i = node->num_keys - 1;
+    while (i >= 0 && key < node->keys[i]) {
+        node->keys[i + 1] = node->keys[i];
+        node->row_nums[i + 1] = node->row_nums[i];
+        copy_payload(tree, node, i + 1, node, i);
+        i--;
+    }
+
+    node->keys[i + 1] = key;
+    node->row_nums[i + 1] = row_num;
+    if (tree->payload_size) memcpy(node->payloads + (i + 1) * tree->payload_size, payload, tree->payload_size);
+    node->num_keys++;
+}
 
-void bpt_insert_internal(BPTree* tree, BPTreeNode* node, const uint32_t key, BPTreeNode* right_child) {
+static void insert_into_internal(BPTreeNode* node, const uint32_t key, BPTreeNode* right_child) {
     int i = node->num_keys - 1;
     while (i >= 0 && key < node->keys[i]) {
         node->keys[i + 1] = node->keys[i];
@@ -61,120 +345,270 @@ void bpt_insert_internal(BPTree* tree, BPTreeNode* node, const uint32_t key, BPT
     node->keys[i + 1] = key;
     node->pointers[i + 2] = right_child;
     node->num_keys++;
+}
 
-    if (node->num_keys > MAX_KEYS) {
-        const int split = node->num_keys / 2;
+/*
+ * Nodes on the right edge of the tree that split for a key past their last one split 100/0: the left
+ * node keeps everything and the new right node starts with only the key being inserted. Increasing
+ * keys then leave full nodes behind them instead of half full ones, and the next one appends to the
+ * new rightmost leaf without descending. Either way the key goes into the half that covers it.
+ */
+static BPTreeNode* split_leaf(BPTree* tree, BPTreeNode* node, const uint32_t key, const uint32_t row_num,
+                              const void* payload, const int appending, uint32_t* promoted_key) {
+    const int split = appending ? node->num_keys : node->num_keys / 2;
+    BPTreeNode* new_leaf = create_leaf(tree);
+
+    new_leaf->num_keys = node->num_keys - split;
+    for (int j = 0; j < new_leaf->num_keys; j++) {
+        new_leaf->keys[j] = node->keys[split + j];
+        new_leaf->row_nums[j] = node->row_nums[split + j];
+        copy_payload(tree, new_leaf, j, node, split + j);
+    }
+    node->num_keys = split;
+
+    // an empty right leaf is separated by the key going into it
+    *promoted_key = new_leaf->num_keys > 0 ? new_leaf->keys[0] : key;
+    insert_into_leaf(tree, key >= *promoted_key ? new_leaf : node, key, row_num, payload);
+
+    new_leaf->next = node->next;
+    if (new_leaf->next) new_leaf->next->previous = new_leaf;
+    new_leaf->previous = node;
+    __atomic_store_n(&node->next, new_leaf, __ATOMIC_RELEASE);
+    if (new_leaf->next == NULL) __atomic_store_n(&tree->rightmost, new_leaf, __ATOMIC_RELEASE);
+    return new_leaf;
+}
 
-        BPTreeNode* new_internal = create_node(0);
+static BPTreeNode* split_internal(BPTreeNode* node, const int appending, uint32_t* mid_key) {
+    // appending keeps all but the last key on the left, the right node starts with only the last child
+    const int split = appending ? node->num_keys - 1 : node->num_keys / 2;
+    BPTreeNode* new_internal = create_node(0);
 
-        const uint32_t mid_key = node->keys[split];
+    *mid_key = node->keys[split];
 
-        new_internal->num_keys = node->num_keys - split - 1;
-        for (int j = 0; j < new_internal->num_keys; j++) {
-            new_internal->keys[j] = node->keys[split + 1 + j];
-            new_internal->pointers[j] = node->pointers[split + 1 + j];
-        }
+    new_internal->num_keys = node->num_keys - split - 1;
+    for (int j = 0; j < new_internal->num_keys; j++) {
+        new_internal->keys[j] = node->keys[split + 1 + j];
+        new_internal->pointers[j] = node->pointers[split + 1 + j];
+    }
+    new_internal->pointers[new_internal->num_keys] = node->pointers[node->num_keys];
 
-        new_internal->pointers[new_internal->num_keys] = node->pointers[node->num_keys];
+    node->num_keys = split;
+    return new_internal;
+}
 
-        node->num_keys = split;
+static void grow_root(BPTree* tree, BPTreeNode* left, const uint32_t key, BPTreeNode* right) {
+    BPTreeNode* new_root = create_node(0);
+    new_root->keys[0] = key;
+    new_root->pointers[0] = left;
+    new_root->pointers[1] = right;
+    new_root->num_keys = 1;
+    __atomic_store_n(&tree->root, new_root, __ATOMIC_RELEASE);
+}
 
-        if (node == tree->root) {
-            BPTreeNode* new_root = create_node(0);
-            new_root->keys[0] = mid_key;
-            new_root->pointers[0] = node;
-            new_root->pointers[1] = new_internal;
-            new_root->num_keys = 1;
-            tree->root = new_root;
-        } else {
-            bpt_insert_internal(tree, find_parent(tree->root, node), mid_key, new_internal);
-        }
+/*
+ * Splits a full node while holding write locks on it and its parent. Full nodes are split on the way
+ * down, so the parent always has room for the separator. A leaf split inserts the key as well and
+ * returns 1, otherwise the caller restarts.
+ */
+static int split_full_node(BPTree* tree, BPTreeNode* parent, uint64_t parent_version, BPTreeNode* node,
+                           const uint64_t version, const uint32_t key, const uint32_t row_num, const void* payload,
+                           const int appending) {
+    int restart = 0;
+    if (parent) {
+        upgrade_to_write_lock_or_restart(parent, parent_version, &restart);
+        if (restart) return 0;
+    }
+    upgrade_to_write_lock_or_restart(node, version, &restart);
+    if (restart) {
+        if (parent) write_unlock(parent);
+        return 0;
+    }
+    if (parent == NULL && node != load_root(tree)) {
+        // somebody grew the tree above us, the split has to go into the new root
+        write_unlock(node);
+        return 0;
     }
+
+    const int is_leaf = node->is_leaf;
+    uint32_t separator;
+    BPTreeNode* right = is_leaf ? split_leaf(tree, node, key, row_num, payload, appending, &separator)
+                                : split_internal(node, appending, &separator);
+    if (parent) insert_into_internal(parent, separator, right);
+    else grow_root(tree, node, separator, right);
+    metrics_add(METRIC_INDEX_SPLITS, 1);
+
+    write_unlock(node);
+    if (parent) write_unlock(parent);
+    return is_leaf;
+}
+
+// the key is past every key of the node, which is on the right edge of the tree
+static int appends_to(const BPTreeNode* node, const uint32_t key, const int right_edge) {
+    return right_edge && node->num_keys > 0 && key > node->keys[node->num_keys - 1];
 }
 
-void bpt_insert(BPTree* tree, const uint32_t key, void* row_ptr) {
-    if (tree->root == NULL) {
-        tree->root = create_node(1);
-        tree->root->keys[0] = key;
-        tree->root->pointers[0] = row_ptr;
-        tree->root->num_keys = 1;
-        return;
+// appends to the cached rightmost leaf when the key is past its last one and it has room, 0 otherwise
+static int try_append(BPTree* tree, const uint32_t key, const uint32_t row_num, const void* payload) {
+    BPTreeNode* leaf = __atomic_load_n(&tree->rightmost, __ATOMIC_ACQUIRE);
+    if (leaf == NULL) return 0;
+
+    int restart = 0;
+    const uint64_t version = read_lock_or_restart(leaf, &restart);
+    if (restart) return 0;
+    const int fits = leaf->next == NULL && leaf->num_keys < MAX_KEYS && appends_to(leaf, key, 1);
+    check_or_restart(leaf, version, &restart);
+    if (restart || !fits) return 0;
+
+    // a leaf with no next leaf covers every key from its separator up
+    upgrade_to_write_lock_or_restart(leaf, version, &restart);
+    if (restart) return 0;
+    insert_into_leaf(tree, leaf, key, row_num, payload);
+    write_unlock(leaf);
+    return 1;
+}
+
+// returns 0 when it has to be restarted from the root
+static int try_insert(BPTree* tree, const uint32_t key, const uint32_t row_num, const void* payload) {
+    BPTreeNode* node = load_root(tree);
+    if (node == NULL) {
+        BPTreeNode* leaf = create_leaf(tree);
+        BPTreeNode* expected = NULL;
+        if (__atomic_compare_exchange_n(&tree->root, &expected, leaf, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            __atomic_store_n(&tree->rightmost, leaf, __ATOMIC_RELEASE);
+        else
+            free_node(leaf);
+        return 0;
     }
 
-    BPTreeNode* node = tree->root;
+    int restart = 0;
+    uint64_t version = read_lock_or_restart(node, &restart);
+    if (restart) return 0;
+
     BPTreeNode* parent = NULL;
+    uint64_t parent_version = 0;
+    int right_edge = 1;
     while (!node->is_leaf) {
+        if (node->num_keys == MAX_KEYS) {
+            split_full_node(tree, parent, parent_version, node, version, key, row_num, payload,
+                            appends_to(node, key, right_edge));
+            return 0;
+        }
+
+        if (parent) {
+            check_or_restart(parent, parent_version, &restart);
+            if (restart) return 0;
+        }
         parent = node;
+        parent_version = version;
+
         int index = 0;
         while (index < node->num_keys && key >= node->keys[index]) index++;
-        node = (BPTreeNode*)node->pointers[index];
-    }
+        right_edge = right_edge && index == node->num_keys;
+        node = node->pointers[index];
 
-    int i = node->num_keys - 1;
-    while (i >= 0 && key < node->keys[i]) {
-        node->keys[i + 1] = node->keys[i];
-        node->pointers[i + 1] = node->pointers[i];
-        i--;
+        check_or_restart(parent, parent_version, &restart);
+        if (restart) return 0;
+        version = read_lock_or_restart(node, &restart);
+        if (restart) return 0;
     }
 
-    node->keys[i + 1] = key;
-    node->pointers[i + 1] = row_ptr;
-    node->num_keys++;
+    if (node->num_keys == MAX_KEYS) {
+        return split_full_node(tree, parent, parent_version, node, version, key, row_num, payload,
+                               appends_to(node, key, right_edge));
+    }
 
-    if (node->num_keys > MAX_KEYS) {
-        const int split = node->num_keys / 2;
-        BPTreeNode* new_leaf = create_node(1);
+    // a leaf only loses part of its key range by splitting, which bumps its version
+    upgrade_to_write_lock_or_restart(node, version, &restart);
+    if (restart) return 0;
+    insert_into_leaf(tree, node, key, row_num, payload);
+    write_unlock(node);
+    return 1;
+}
 
-        new_leaf->num_keys = node->num_keys - split;
+void bpt_insert(BPTree* tree, const uint32_t key, const uint32_t row_num, const void* payload) {
+    if (try_append(tree, key, row_num, payload)) return;
+    while (!try_insert(tree, key, row_num, payload)) {}
+}
 
-        for (int j = 0; j < new_leaf->num_keys; j++) {
-            new_leaf->keys[j] = node->keys[split + j];
-            new_leaf->pointers[j] = node->pointers[split + j];
+// finds the entry and returns its leaf write locked, NULL when the tree doesn't hold it
+static BPTreeNode* lock_entry(const BPTree* tree, const uint32_t key, const uint32_t row_num, int* entry_index) {
+    while (1) {
+        uint64_t version;
+        BPTreeNode* node = bpt_find_leaf(tree, key, &version);
+        int restart = 0;
+
+        while (node != NULL) {
+            upgrade_to_write_lock_or_restart(node, version, &restart);
+            if (restart) break;
+
+            for (int i = 0; i < node->num_keys; i++) {
+                if (node->keys[i] > key) {
+                    write_unlock(node);
+                    return NULL;
+                }
+                if (node->keys[i] == key && node->row_nums[i] == row_num) {
+                    *entry_index = i;
+                    return node;
+                }
+            }
+
+            BPTreeNode* next = node->next;
+            write_unlock(node);
+            node = next;
+            if (node != NULL) version = read_lock_or_restart(node, &restart);
+            if (restart) break;
         }
+        if (!restart) return NULL;
+    }
+}
 
-        node->num_keys = split;
-
-        new_leaf->next = node->next;
-        if (new_leaf->next) new_leaf->next->previous = new_leaf;
-        new_leaf->previous = node;
-        node->next = new_leaf;
-
-        const uint32_t promoted_key = new_leaf->keys[0];
+int bpt_delete(BPTree* tree, const uint32_t key, const uint32_t row_num) {
+    // lazy deletion: entries are removed from their leaf without merging, empty leaves stay in the chain
+    int index;
+    BPTreeNode* node = lock_entry(tree, key, row_num, &index);
+    if (node == NULL) return 0;
 
-        if (node == tree->root) {
-            BPTreeNode* new_root = create_node(0);
-            new_root->keys[0] = promoted_key;
-            new_root->pointers[0] = node;
-            new_root->pointers[1] = new_leaf;
-            new_root->num_keys = 1;
-            tree->root = new_root;
-        } else {
-            bpt_insert_internal(tree, parent, promoted_key, new_leaf);
-        }
+    for (int j = index; j < node->num_keys - 1; j++) {
+        node->keys[j] = node->keys[j + 1];
+        node->row_nums[j] = node->row_nums[j + 1];
+        copy_payload(tree, node, j, node, j + 1);
     }
+    node->num_keys--;
+    write_unlock(node);
+    return 1;
+}
 
+int bpt_update(BPTree* tree, const uint32_t key, const uint32_t old_row_num, const uint32_t new_row_num) {
+    int index;
+    BPTreeNode* node = lock_entry(tree, key, old_row_num, &index);
+    if (node == NULL) return 0;
+
+    node->row_nums[index] = new_row_num;
+    write_unlock(node);
+    return 1;
 }
 
+int bpt_update_payload(BPTree* tree, const uint32_t key, const uint32_t row_num, const void* payload) {
+    int index;
+    BPTreeNode* node = lock_entry(tree, key, row_num, &index);
+    if (node == NULL) return 0;
 
+    memcpy(node->payloads + index * tree->payload_size, payload, tree->payload_size);
+    write_unlock(node);
+    return 1;
+}
 
-BPTreeNode* find_parent(BPTreeNode* root, BPTreeNode* child) {
-    if (root == NULL || root->is_leaf) return NULL;
 
-    for (int i = 0; i <= root->num_keys; i++) {
-        if ((BPTreeNode*)root->pointers[i] == child) return root;
-    }
 
-    for (int i = 0; i <= root->num_keys; i++) {
-        BPTreeNode* ptr = root->pointers[i];
-        if (!ptr) continue;
-        BPTreeNode* result = find_parent(ptr, child);
-        if (result) return result;
+int bpt_height(const BPTree* tree) {
+    // every leaf is at the same depth, the leftmost path is as long as any
+    int height = 0;
+    for (const BPTreeNode* node = load_root(tree); node != NULL; height++) {
+        node = node->is_leaf ? NULL : node->pointers[0];
     }
-    return NULL;
+    return height;
 }
 
-
-
 void free_node(BPTreeNode* node) {
     if (node == NULL) return;
 
@@ -183,12 +617,14 @@ void free_node(BPTreeNode* node) {
             free_node(node->pointers[i]);
         }
     }
+    free(node->payloads);
     free(node);
 }
 
 void free_tree(BPTree* tree) {
     free_node(tree->root);
     tree->root = NULL;
+    tree->rightmost = NULL;
 
     free(tree);
 }
@@ -0,0 +1,55 @@
+#include "bloom.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t hash_update(uint64_t hash, const char* bytes, const size_t length) {
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (uint8_t)bytes[i]) * FNV_PRIME;
+    return hash;
+}
+
+static uint64_t hash_finish(uint64_t hash) {
+    // FNV leaves the high bits poorly mixed, the double hashing below uses both halves
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ hash >> 33;
+}
+
+uint64_t bloom_hash(const char* bytes, const size_t length) {
+    return hash_finish(hash_update(FNV_OFFSET, bytes, length));
+}
+
+uint64_t bloom_hash_text(const TextValue* value) {
+    // hashes the whole value, a spilled one through its overflow chain
+    uint64_t hash = hash_update(FNV_OFFSET, value->bytes, value->inline_length);
+    for (const OverflowPage* page = value->rest; page != NULL; page = page->next) {
+        hash = hash_update(hash, page->data, page->length);
+    }
+    return hash_finish(hash);
+}
+
+uint32_t bloom_words(const uint32_t values) {
+    // a power of two, so a bit is picked with a mask
+    uint32_t words = 1;
+    while (words * 64 < values * BLOOM_BITS_PER_VALUE) words <<= 1;
+    return words;
+}
+
+void bloom_add(uint64_t* bits, const uint32_t words, const uint64_t hash) {
+    const uint32_t mask = words * 64 - 1;
+    const uint32_t step = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0, bit = (uint32_t)hash; i < BLOOM_HASHES; i++, bit += step) {
+        __atomic_fetch_or(&bits[(bit & mask) / 64], 1ULL << (bit & 63), __ATOMIC_RELAXED);
+    }
+}
+
+int bloom_may_contain(const uint64_t* bits, const uint32_t words, const uint64_t hash) {
+    const uint32_t mask = words * 64 - 1;
+    const uint32_t step = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0, bit = (uint32_t)hash; i < BLOOM_HASHES; i++, bit += step) {
+        if (!(__atomic_load_n(&bits[(bit & mask) / 64], __ATOMIC_RELAXED) & 1ULL << (bit & 63))) return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,185 @@
+#include "compression.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t read_u32(const uint8_t* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(uint32_t));
+    return value;
+}
+
+static uint32_t hash_sequence(const uint8_t* bytes) {
+    return (read_u32(bytes) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// writes a length continuing past a 15 in its nibble, returns NULL when it doesn't fit
+static uint8_t* write_length(uint8_t* out, const uint8_t* end, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (out >= end) return NULL;
+        *out++ = 255;
+    }
+    if (out >= end) return NULL;
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+static uint8_t* write_sequence(uint8_t* out, const uint8_t* end, const uint8_t* literals, const size_t literal_count,
+                               const size_t match_length, const uint16_t offset) {
+    if (out >= end) return NULL;
+    uint8_t* token = out++;
+    *token = (uint8_t)((literal_count < 15 ? literal_count : 15) << 4);
+    if (literal_count >= 15 && (out = write_length(out, end, literal_count - 15)) == NULL) return NULL;
+
+    if ((size_t)(end - out) < literal_count) return NULL;
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+    if (match_length == 0) return out;
+
+    if (end - out < 2) return NULL;
+    out[0] = (uint8_t)offset;
+    out[1] = (uint8_t)(offset >> 8);
+    out += 2;
+
+    const size_t extra = match_length - LZ_MIN_MATCH;
+    *token |= (uint8_t)(extra < 15 ? extra : 15);
+    if (extra >= 15 && (out = write_length(out, end, extra - 15)) == NULL) return NULL;
+    return out;
+}
+
+// returns the compressed length, or 0 when the output would not fit in output_capacity
+size_t lz_compress(const uint8_t* input, const size_t input_length, uint8_t* output, const size_t output_capacity) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0}; // position + 1 of the last sequence with each hash
+    const uint8_t* end = output + output_capacity;
+    uint8_t* out = output;
+    size_t anchor = 0;
+    size_t position = 0;
+
+    while (position + LZ_MIN_MATCH <= input_length) {
+        const uint32_t hash = hash_sequence(input + position);
+        const size_t candidate = table[hash];
+        table[hash] = (uint32_t)position + 1;
+
+        if (candidate == 0 || position - (candidate - 1) > UINT16_MAX ||
+            read_u32(input + candidate - 1) != read_u32(input + position)) {
+            position++;
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (position + length < input_length && input[match + length] == input[position + length]) length++;
+
+        out = write_sequence(out, end, input + anchor, position - anchor, length, (uint16_t)(position - match));
+        if (out == NULL) return 0;
+        position += length;
+        anchor = position;
+    }
+
+    out = write_sequence(out, end, input + anchor, input_length - anchor, 0, 0);
+    return out == NULL ? 0 : (size_t)(out - output);
+}
+
+static int read_length(const uint8_t** in, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (*in >= end) return -1;
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+// returns -1 when the input is corrupt or doesn't decode to exactly output_length bytes
+int lz_decompress(const uint8_t* input, const size_t input_length, uint8_t* output, const size_t output_length) {
+    const uint8_t* in = input;
+    const uint8_t* in_end = input + input_length;
+    size_t position = 0;
+
+    while (in < in_end) {
+        const uint8_t token = *in++;
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && read_length(&in, in_end, &literal_count) != 0) return -1;
+        if ((size_t)(in_end - in) < literal_count || output_length - position < literal_count) return -1;
+        memcpy(output + position, in, literal_count);
+        in += literal_count;
+        position += literal_count;
+        if (in == in_end) break;
+
+        if (in_end - in < 2) return -1;
+        const size_t offset = in[0] | (size_t)in[1] << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && read_length(&in, in_end, &length) != 0) return -1;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > position || output_length - position < length) return -1;
+
+        // matches may overlap their own output, so copy forward byte by byte
+        for (size_t i = 0; i < length; i++, position++) output[position] = output[position - offset];
+    }
+    return position == output_length ? 0 : -1;
+}
+
+static uint64_t next_page_id = 1;
+
+CompressedPage* compress_page(const void* page, const size_t page_size) {
+    uint8_t* buffer = malloc(page_size);
+    if (!buffer) {
+        perror("malloc failed");
+        exit(1);
+    }
+
+    // a page that doesn't shrink below three quarters of its size is not worth decompressing on every read
+    const size_t length = lz_compress(page, page_size, buffer, page_size * 3 / 4);
+    if (length == 0) {
+        free(buffer);
+        return NULL;
+    }
+
+    CompressedPage* compressed = malloc(sizeof(CompressedPage) + length);
+    if (!compressed) {
+        perror("malloc failed");
+        exit(1);
+    }
+    compressed->id = __atomic_fetch_add(&next_page_id, 1, __ATOMIC_RELAXED);
+    compressed->length = (uint32_t)length;
+    memcpy(compressed->data, buffer, length);
+    free(buffer);
+    return compressed;
+}
+
+void decompress_page(const CompressedPage* compressed, void* page, const size_t page_size) {
+    if (lz_decompress(compressed->data, compressed->length, page, page_size) != 0) {
+        fprintf(stderr, "corrupt compressed page %llu\n", (unsigned long long)compressed->id);
+        abort();
+    }
+}
+
+typedef struct {
+    uint64_t id;
+    uint8_t* page;
+} PageCacheEntry;
+
+static __thread PageCacheEntry page_cache[PAGE_CACHE_ENTRIES];
+static __thread uint32_t page_cache_hand;
+
+const void* cached_page(const CompressedPage* compressed, const size_t page_size) {
+    for (uint32_t i = 0; i < PAGE_CACHE_ENTRIES; i++) {
+        if (page_cache[i].id == compressed->id) return page_cache[i].page;
+    }
+
+    // round robin eviction, scans move through pages in order so the oldest entry is the coldest
+    PageCacheEntry* entry = &page_cache[page_cache_hand];
+    page_cache_hand = (page_cache_hand + 1) % PAGE_CACHE_ENTRIES;
+    if (entry->page == NULL) {
+        entry->page = malloc(page_size);
+        if (!entry->page) {
+            perror("malloc failed");
+            exit(1);
+        }
+    }
+    decompress_page(compressed, entry->page, page_size);
+    entry->id = compressed->id;
+    return entry->page;
+}
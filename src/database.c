@@ -2,8 +2,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include "database.h"
+#include "session.h"
 
-Database global_db;
+Database global_db = { .lock = PTHREAD_RWLOCK_INITIALIZER };
 
 void init_database(Database* db, const char* name) {
     strncpy(db->name, name, sizeof(db->name));
@@ -11,6 +12,7 @@ void init_database(Database* db, const char* name) {
     for (int i = 0; i < MAX_TABLES; i++) {
         db->tables[i] = NULL;
     }
+    pthread_rwlock_init(&db->lock, NULL);
 }
 
 Table* find_table(const Database* db, const char* table_name) {
@@ -24,11 +26,11 @@ Table* find_table(const Database* db, const char* table_name) {
 
 int add_table(Database* db, Table* table) {
     if (db->num_tables >= MAX_TABLES) {
-        printf("Error: too many tables in database.\n");
+        fprintf(current_session->out, "Error: too many tables in database.\n");
         return -1;
     }
     if (find_table(db, table->name) != NULL) {
-        printf("Error: table '%s' already exists.\n", table->name);
+        fprintf(current_session->out, "Error: table '%s' already exists.\n", table->name);
         return -1;
     }
     db->tables[db->num_tables] = table;
@@ -0,0 +1,122 @@
+#include "dictionary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DICTIONARY_INITIAL_CAPACITY 64
+
+static uint32_t hash_text(const char* text, const uint32_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void* checked_calloc(const size_t count, const size_t size) {
+    void* memory = calloc(count, size);
+    if (!memory) {
+        perror("calloc failed");
+        exit(1);
+    }
+    return memory;
+}
+
+Dictionary* new_dictionary() {
+    Dictionary* dictionary = checked_calloc(1, sizeof(Dictionary));
+    dictionary->capacity = DICTIONARY_INITIAL_CAPACITY;
+    dictionary->buckets = checked_calloc(dictionary->capacity, sizeof(uint32_t));
+    pthread_mutex_init(&dictionary->lock, NULL);
+    return dictionary;
+}
+
+void free_dictionary(Dictionary* dictionary) {
+    for (uint32_t code = 0; code < dictionary->count; code++) {
+        free(dictionary->blocks[code / DICTIONARY_BLOCK_SIZE][code % DICTIONARY_BLOCK_SIZE].text);
+    }
+    for (uint32_t block = 0; block < DICTIONARY_MAX_CODES / DICTIONARY_BLOCK_SIZE; block++) {
+        free(dictionary->blocks[block]);
+    }
+    free(dictionary->buckets);
+    pthread_mutex_destroy(&dictionary->lock);
+    free(dictionary);
+}
+
+const DictionaryEntry* dictionary_entry(const Dictionary* dictionary, const uint16_t code) {
+    return &dictionary->blocks[code / DICTIONARY_BLOCK_SIZE][code % DICTIONARY_BLOCK_SIZE];
+}
+
+// returns the bucket holding the string or the empty bucket it would go into
+static uint32_t* find_bucket(const Dictionary* dictionary, const char* text, const uint32_t length) {
+    uint32_t index = hash_text(text, length) & (dictionary->capacity - 1);
+    while (dictionary->buckets[index] != 0) {
+        const DictionaryEntry* entry = dictionary_entry(dictionary, (uint16_t)(dictionary->buckets[index] - 1));
+        if (entry->length == length && memcmp(entry->text, text, length) == 0) break;
+        index = (index + 1) & (dictionary->capacity - 1);
+    }
+    return &dictionary->buckets[index];
+}
+
+static void grow_buckets(Dictionary* dictionary) {
+    const uint32_t* old_buckets = dictionary->buckets;
+    const uint32_t old_capacity = dictionary->capacity;
+
+    dictionary->capacity *= 2;
+    dictionary->buckets = checked_calloc(dictionary->capacity, sizeof(uint32_t));
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old_buckets[i] == 0) continue;
+        const DictionaryEntry* entry = dictionary_entry(dictionary, (uint16_t)(old_buckets[i] - 1));
+        *find_bucket(dictionary, entry->text, entry->length) = old_buckets[i];
+    }
+    free((void*)old_buckets);
+}
+
+// returns -1 when the string is new and every code is taken
+int dictionary_encode(Dictionary* dictionary, const char* text, const uint32_t length, uint16_t* code) {
+    pthread_mutex_lock(&dictionary->lock);
+    uint32_t* bucket = find_bucket(dictionary, text, length);
+    if (*bucket != 0) {
+        *code = (uint16_t)(*bucket - 1);
+        pthread_mutex_unlock(&dictionary->lock);
+        return 0;
+    }
+
+    const uint32_t count = dictionary->count;
+    if (count == DICTIONARY_MAX_CODES) {
+        pthread_mutex_unlock(&dictionary->lock);
+        return -1;
+    }
+
+    DictionaryEntry** block = &dictionary->blocks[count / DICTIONARY_BLOCK_SIZE];
+    if (*block == NULL) *block = checked_calloc(DICTIONARY_BLOCK_SIZE, sizeof(DictionaryEntry));
+    DictionaryEntry* entry = &(*block)[count % DICTIONARY_BLOCK_SIZE];
+    entry->text = malloc(length + 1);
+    if (!entry->text) {
+        perror("malloc failed");
+        exit(1);
+    }
+    memcpy(entry->text, text, length);
+    entry->text[length] = '\0';
+    entry->length = length;
+
+    *bucket = count + 1;
+    // the entry is complete before the count makes its code valid
+    __atomic_store_n(&dictionary->count, count + 1, __ATOMIC_RELEASE);
+    if (2 * (count + 1) > dictionary->capacity) grow_buckets(dictionary);
+
+    *code = (uint16_t)count;
+    pthread_mutex_unlock(&dictionary->lock);
+    return 0;
+}
+
+// returns the code of the string or DICTIONARY_NO_CODE, size is the number of codes handed out so far
+int32_t dictionary_lookup(Dictionary* dictionary, const char* text, const uint32_t length, uint32_t* size) {
+    pthread_mutex_lock(&dictionary->lock);
+    const uint32_t bucket = *find_bucket(dictionary, text, length);
+    *size = dictionary->count;
+    pthread_mutex_unlock(&dictionary->lock);
+    return bucket == 0 ? DICTIONARY_NO_CODE : (int32_t)(bucket - 1);
+}
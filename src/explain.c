@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <string.h>
+#include "statement.h"
+#include "database.h"
+#include "session.h"
+#include "planner.h"
+#include "profile.h"
+
+/*
+ * EXPLAIN prints the plan a SELECT, UPDATE or DELETE runs with, root first:
+ *
+ *   Select on users
+ *     -> Filter: age > 30 AND name = 'bob'
+ *       -> Index Scan on users using the primary key: id >= 100
+ *
+ * followed by the planner's row estimate and the cost of every access path it could have taken.
+ * EXPLAIN ANALYZE also runs the statement, throwing away the rows a SELECT returns, and adds what every
+ * operator actually did. An explained UPDATE or DELETE changes the table like it would on its own.
+ */
+typedef struct {
+    const char* operation;
+    const char* table_name;
+    const Condition* conditions;
+    uint32_t condition_count;
+    int covered; // a SELECT the leaves of the index answer on their own
+} ExplainedStatement;
+
+static void describe_statement(const Statement* statement, ExplainedStatement* explained) {
+    explained->covered = 0;
+    switch (statement->type) {
+        case STATEMENT_SELECT: {
+            const SelectStatement* select_statement = &statement->select_stmt;
+            explained->operation = "Select";
+            explained->table_name = select_statement->table_name;
+            explained->conditions = select_statement->conditions;
+            explained->condition_count = select_statement->has_condition ? select_statement->condition_count : 0;
+            explained->covered = index_covers(select_statement, find_table(&global_db, select_statement->table_name));
+            break;
+        }
+        case STATEMENT_UPDATE:
+            explained->operation = "Update";
+            explained->table_name = statement->update_stmt.table_name;
+            explained->conditions = statement->update_stmt.conditions;
+            explained->condition_count = statement->update_stmt.condition_count;
+            break;
+        default:
+            explained->operation = "Delete";
+            explained->table_name = statement->delete_stmt.table_name;
+            explained->conditions = statement->delete_stmt.conditions;
+            explained->condition_count = statement->delete_stmt.has_condition ? statement->delete_stmt.condition_count : 0;
+            break;
+    }
+}
+
+static const char* condition_operator(const TokenType type) {
+    switch (type) {
+        case TOKEN_EQUAL: return "=";
+        case TOKEN_NOT_EQUAL: return "!=";
+        case TOKEN_GREATER: return ">";
+        case TOKEN_GREATER_EQUAL: return ">=";
+        case TOKEN_LESS: return "<";
+        case TOKEN_LESSER_EQUAL: return "<=";
+        default: return "?";
+    }
+}
+
+static void print_condition(FILE* out, const Table* table, const Condition* condition) {
+    const Column* column = &table->schema.columns[condition->column_index];
+    if (condition->type == TOKEN_IN) {
+        fprintf(out, "%s IN (%u values)", column->name, condition->in_list->count);
+    } else if (column->type == COLUMN_VARCHAR) {
+        fprintf(out, "%s %s '%s'", column->name, condition_operator(condition->type), condition->value);
+    } else {
+        fprintf(out, "%s %s %s", column->name, condition_operator(condition->type), condition->value);
+    }
+}
+
+static void print_conditions(FILE* out, const Table* table, const Condition* conditions, const uint32_t condition_count) {
+    // groups are ORed, a group of several ANDed conditions is put in parentheses when there is more than one
+    const int grouped = condition_count > 0 && conditions[condition_count - 1].group > 0;
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        const uint32_t end = group_end(conditions, condition_count, first);
+        if (first > 0) fprintf(out, " OR ");
+        if (grouped && end - first > 1) fprintf(out, "(");
+        for (uint32_t i = first; i < end; i++) {
+            if (i > first) fprintf(out, " AND ");
+            print_condition(out, table, &conditions[i]);
+        }
+        if (grouped && end - first > 1) fprintf(out, ")");
+    }
+}
+
+static void print_access_path(FILE* out, const Table* table, const ExplainedStatement* explained,
+                              const Condition* conditions, const AccessPath path) {
+    switch (path) {
+        case ACCESS_HEAP_SCAN:
+            fprintf(out, "Seq Scan on %s", table->name);
+            return;
+        case ACCESS_ZONE_MAP_SCAN:
+            fprintf(out, "Zone Map Scan on %s", table->name);
+            return;
+        case ACCESS_INDEX:
+            break;
+    }
+
+    // every OR group probes the index with its own condition and the rows they find are unioned
+    const uint32_t count = explained->condition_count;
+    const int grouped = conditions[count - 1].group > 0;
+    fprintf(out, "%s on %s using the primary key: ",
+            grouped ? "Index Union" : explained->covered ? "Index Only Scan" : "Index Scan", table->name);
+    for (uint32_t first = 0; first < count; first = group_end(conditions, count, first)) {
+        if (first > 0) fprintf(out, " OR ");
+        print_condition(out, table, &conditions[usable_condition_in_group(conditions, first, group_end(conditions, count, first), table)]);
+    }
+}
+
+static void print_plan(FILE* out, const Table* table, const ExplainedStatement* explained, const Condition* conditions,
+                       const AccessPlan* plan, const QueryProfile* profile) {
+    int depth = 0;
+    fprintf(out, "%s on %s", explained->operation, table->name);
+    if (profile != NULL) print_operator_profile(profile, OPERATOR_ROOT, out);
+    fprintf(out, "\n");
+
+    if (explained->condition_count > 0) {
+        fprintf(out, "%*s-> Filter: ", 2 * ++depth, "");
+        print_conditions(out, table, conditions, explained->condition_count);
+        if (profile != NULL) print_operator_profile(profile, OPERATOR_FILTER, out);
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "%*s-> ", 2 * ++depth, "");
+    print_access_path(out, table, explained, conditions, plan->path);
+    if (profile != NULL) print_operator_profile(profile, OPERATOR_ACCESS, out);
+    fprintf(out, "\n");
+
+    fprintf(out, "Estimated rows: %.0f from %s. Costs:", plan->rows, plan->analyzed ? "statistics" : "default selectivities");
+    const char* separator = " ";
+    for (int path = 0; path < ACCESS_PATHS; path++) {
+        if (plan->costs[path] < 0) continue;
+        fprintf(out, "%s%s %.1f%s", separator, access_path_name((AccessPath)path), plan->costs[path], path == plan->path ? " (chosen)" : "");
+        separator = ", ";
+    }
+    fprintf(out, ".\n");
+    if (profile != NULL) print_profile_totals(profile, out);
+}
+
+static ExecuteResult run_profiled(const Statement* statement, QueryProfile* profile) {
+    // the rows a SELECT returns are produced and printed as usual, just not to the client
+    FILE* out = current_session->out;
+    FILE* sink = statement->type == STATEMENT_SELECT ? fopen("/dev/null", "w") : NULL;
+    if (sink != NULL) current_session->out = sink;
+
+    current_session->profile = profile;
+    profile_start(profile);
+    const ExecuteResult result = execute_statement(statement);
+    profile_stop(profile);
+    current_session->profile = NULL;
+
+    current_session->out = out;
+    if (sink != NULL) fclose(sink);
+    return result;
+}
+
+ExecuteResult execute_explain(const ExplainStatement* explain_statement) {
+    ExplainedStatement explained;
+    describe_statement(explain_statement->statement, &explained);
+    Table* table = find_table(&global_db, explained.table_name);
+    if (table == NULL) return EXECUTE_FAIL;
+
+    // the plan is made the way the executor makes it, on a copy of the conditions the planner may reorder
+    Condition conditions[MAX_COLUMNS];
+    memcpy(conditions, explained.conditions, explained.condition_count * sizeof(Condition));
+    AccessPlan plan;
+    pthread_rwlock_rdlock(&table->lock);
+    plan_access(table, conditions, explained.condition_count, explained.covered, &plan);
+    pthread_rwlock_unlock(&table->lock);
+
+    if (!explain_statement->analyze) {
+        print_plan(current_session->out, table, &explained, conditions, &plan, NULL);
+        return EXECUTE_SUCCESS;
+    }
+
+    QueryProfile profile;
+    if (run_profiled(explain_statement->statement, &profile) != EXECUTE_SUCCESS) return EXECUTE_FAIL;
+    print_plan(current_session->out, table, &explained, conditions, &plan, &profile);
+    return EXECUTE_SUCCESS;
+}
@@ -0,0 +1,150 @@
+#include "in_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void* checked_realloc(void* memory, const size_t size) {
+    void* resized = realloc(memory, size);
+    if (!resized) {
+        perror("realloc failed");
+        exit(1);
+    }
+    return resized;
+}
+
+InList* new_in_list() {
+    InList* list = calloc(1, sizeof(InList));
+    if (!list) {
+        perror("calloc failed");
+        exit(1);
+    }
+    return list;
+}
+
+// takes ownership of the value
+void in_list_add(InList* list, char* value) {
+    list->values = checked_realloc(list->values, (list->count + 1) * sizeof(char*));
+    list->values[list->count++] = value;
+}
+
+static uint32_t key_slot(const InList* list, const uint64_t key) {
+    return (uint32_t)(key ^ key >> 32) * 2654435761u & list->slot_mask;
+}
+
+static void build_slots(InList* list) {
+    uint32_t capacity = 4;
+    while (capacity < list->count * 2) capacity <<= 1;
+    list->slot_mask = capacity - 1;
+    list->slots = calloc(capacity, sizeof(uint32_t));
+    if (!list->slots) {
+        perror("calloc failed");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < list->count; i++) {
+        if (list->codes != NULL && list->codes[i] == DICTIONARY_NO_CODE) continue;
+        uint32_t slot = key_slot(list, list->keys[i]);
+        while (list->slots[slot] != 0) slot = (slot + 1) & list->slot_mask;
+        list->slots[slot] = i + 1;
+    }
+}
+
+static void drop_non_numbers(InList* list) {
+    // an INT column holds no value that isn't an int32, such entries can't match
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < list->count; i++) {
+        char* end;
+        const long number = strtol(list->values[i], &end, 10);
+        if (end == list->values[i] || *end != '\0' || number != (int32_t)number) {
+            free(list->values[i]);
+            continue;
+        }
+        list->values[kept] = list->values[i];
+        list->numbers[kept++] = (int32_t)number;
+    }
+    list->count = kept;
+}
+
+void resolve_in_list(const Table* table, const int col_index, InList* list) {
+    const Column* column = &table->schema.columns[col_index];
+    const size_t count = list->count > 0 ? list->count : 1;
+    list->lengths = checked_realloc(NULL, count * sizeof(uint32_t));
+    list->hashes = checked_realloc(NULL, count * sizeof(uint64_t));
+    list->keys = checked_realloc(NULL, count * sizeof(uint64_t));
+
+    if (column->type == COLUMN_INT) {
+        list->numbers = checked_realloc(NULL, count * sizeof(int32_t));
+        drop_non_numbers(list);
+    }
+    if (column->dictionary_encoded) {
+        list->codes = checked_realloc(NULL, count * sizeof(int32_t));
+        list->dictionary_size = UINT32_MAX;
+    }
+
+    for (uint32_t i = 0; i < list->count; i++) {
+        if (column->type == COLUMN_INT) {
+            list->hashes[i] = bloom_hash((const char*)&list->numbers[i], sizeof(int32_t));
+            list->keys[i] = list->hashes[i];
+            continue;
+        }
+        list->lengths[i] = (uint32_t)strnlen(list->values[i], column->size);
+        list->hashes[i] = bloom_hash(list->values[i], list->lengths[i]);
+        list->keys[i] = list->hashes[i];
+        if (list->codes == NULL) continue;
+
+        // codes only grow, the smallest size seen is one every code below was already handed out at
+        uint32_t size;
+        list->codes[i] = dictionary_lookup(table->dictionaries[col_index], list->values[i], list->lengths[i], &size);
+        if (size < list->dictionary_size) list->dictionary_size = size;
+        list->keys[i] = (uint64_t)list->codes[i];
+    }
+    if (list->codes != NULL && list->count == 0) list->dictionary_size = 0;
+    build_slots(list);
+}
+
+int in_list_contains_int(const InList* list, const int32_t value) {
+    const uint64_t key = bloom_hash((const char*)&value, sizeof(value));
+    for (uint32_t slot = key_slot(list, key); list->slots[slot] != 0; slot = (slot + 1) & list->slot_mask) {
+        const uint32_t i = list->slots[slot] - 1;
+        if (list->keys[i] == key && list->numbers[i] == value) return 1;
+    }
+    return 0;
+}
+
+int in_list_contains_text(const InList* list, const TextValue* value) {
+    if (list->codes != NULL) {
+        // the set of a DICTIONARY column is keyed by code, its text is only compared for codes newer than the list
+        for (uint32_t i = 0; i < list->count; i++) {
+            if (compare_text(value, list->values[i], list->lengths[i]) == 0) return 1;
+        }
+        return 0;
+    }
+
+    const uint64_t key = bloom_hash_text(value);
+    for (uint32_t slot = key_slot(list, key); list->slots[slot] != 0; slot = (slot + 1) & list->slot_mask) {
+        const uint32_t i = list->slots[slot] - 1;
+        if (list->keys[i] == key && compare_text(value, list->values[i], list->lengths[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// for codes below dictionary_size, the others go through in_list_contains_text
+int in_list_contains_code(const InList* list, const uint16_t code) {
+    for (uint32_t slot = key_slot(list, code); list->slots[slot] != 0; slot = (slot + 1) & list->slot_mask) {
+        if (list->keys[list->slots[slot] - 1] == code) return 1;
+    }
+    return 0;
+}
+
+void free_in_list(InList* list) {
+    if (list == NULL) return;
+    for (uint32_t i = 0; i < list->count; i++) free(list->values[i]);
+    free(list->values);
+    free(list->lengths);
+    free(list->numbers);
+    free(list->codes);
+    free(list->hashes);
+    free(list->keys);
+    free(list->slots);
+    free(list);
+}
@@ -38,13 +38,26 @@ int is_keyword(const char *str, TokenType *type) {
     if (strcasecmp(str, "DATABASE") == 0) { *type = TOKEN_DATABASE; return 1; }
     if (strcasecmp(str, "PRIMARY") == 0) { *type = TOKEN_PRIMARY; return 1; }
     if (strcasecmp(str, "AND") == 0) { *type = TOKEN_AND; return 1; }
+    if (strcasecmp(str, "OR") == 0) { *type = TOKEN_OR; return 1; }
+    if (strcasecmp(str, "IN") == 0) { *type = TOKEN_IN; return 1; }
     if (strcasecmp(str, "KEY") == 0) { *type = TOKEN_KEY; return 1; }
     if (strcasecmp(str, "DELETE") == 0) { *type = TOKEN_DELETE; return 1; }
+    if (strcasecmp(str, "UPDATE") == 0) { *type = TOKEN_UPDATE; return 1; }
+    if (strcasecmp(str, "SET") == 0) { *type = TOKEN_SET; return 1; }
     if (strncasecmp(str, "VARCHAR", 7) == 0) { *type = TOKEN_VARCHAR; return 1; }
     if (strncasecmp(str, "INT", 3) == 0) { *type = TOKEN_INT; return 1; }
     if (strcasecmp(str, "DROP") == 0) { *type = TOKEN_DROP; return 1; }
     if (strcasecmp(str, "SHOW") == 0) { *type = TOKEN_SHOW; return 1; }
     if (strcasecmp(str, "DATABASES") == 0) { *type = TOKEN_DATABASES; return 1; }
+    if (strcasecmp(str, "BEGIN") == 0) { *type = TOKEN_BEGIN; return 1; }
+    if (strcasecmp(str, "COMMIT") == 0) { *type = TOKEN_COMMIT; return 1; }
+    if (strcasecmp(str, "ROLLBACK") == 0) { *type = TOKEN_ROLLBACK; return 1; }
+    if (strcasecmp(str, "VACUUM") == 0) { *type = TOKEN_VACUUM; return 1; }
+    if (strcasecmp(str, "ANALYZE") == 0) { *type = TOKEN_ANALYZE; return 1; }
+    if (strcasecmp(str, "EXPLAIN") == 0) { *type = TOKEN_EXPLAIN; return 1; }
+    if (strcasecmp(str, "WITH") == 0) { *type = TOKEN_WITH; return 1; }
+    if (strcasecmp(str, "DICTIONARY") == 0) { *type = TOKEN_DICTIONARY; return 1; }
+    if (strcasecmp(str, "INCLUDE") == 0) { *type = TOKEN_INCLUDE; return 1; }
 
 
 
@@ -56,6 +69,8 @@ Token make_token(const TokenType type, const char *text) {
     token.type = type;
     strncpy(token.text, text, sizeof(token.text));
     token.text[sizeof(token.text)-1] = '\0';
+    token.start = NULL;
+    token.length = strlen(token.text);
     return token;
 }
 
@@ -92,12 +107,19 @@ Token next_token(Lexer *lexer) {
 
     if (chr == '\'' || chr == '"') {
         const char quote = advance(lexer);
+        const size_t start = lexer->pos;
         char buffer[256]; size_t i = 0;
-        while (peek(lexer) != quote && peek(lexer) != '\0' && i < sizeof(buffer)-1)
-            buffer[i++] = advance(lexer);
+        while (peek(lexer) != quote && peek(lexer) != '\0') {
+            const char next = advance(lexer);
+            if (i < sizeof(buffer)-1) buffer[i++] = next;
+        }
+        const size_t length = lexer->pos - start;
         if (peek(lexer) == quote) advance(lexer); // consume closing quote
         buffer[i] = '\0';
-        return make_token(TOKEN_STRING, buffer);
+        Token token = make_token(TOKEN_STRING, buffer);
+        token.start = lexer->input + start;
+        token.length = length;
+        return token;
     }
 
 
@@ -1,65 +1,68 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "input_buffer.h"
-#include "meta_command.h"
-#include "statement.h"
-#include "schema.h"
+#include "session.h"
+#include "server.h"
+#include "transaction.h"
+#include "slow_log.h"
+#include "perf_counters.h"
 
 
 void print_prompt() { printf("> "); }
 
-int main(void) {
-    InputBuffer* input_buffer = new_input_buffer();
-    while (1) {
-        print_prompt();
-        read_input(input_buffer);
+int main(int argc, char* argv[]) {
+    const char* listen_path = NULL;
+    const char* connect_path = NULL;
+    int workers = 0;
+    const char* slow_log_path = NULL;
+    double slow_ms = 100;
+    int perf = 0;
 
-        if (input_buffer->buffer[0] == '.') {
-            switch (do_meta_command(input_buffer)) {
-                case META_COMMAND_SUCCESS:
-                    break;
-                case META_COMMAND_UNRECOGNIZED:
-                    printf("Unrecognized meta-command '%s'\n", input_buffer->buffer);
-                    break;
-                case META_COMMAND_EXIT:
-                    close_input_buffer(input_buffer);
-                    exit(EXIT_SUCCESS);
-            }
-
-            continue;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_path = argv[++i];
+        } else if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) {
+            connect_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--slow-log") == 0 && i + 1 < argc) {
+            slow_log_path = argv[++i];
+        } else if (strcmp(argv[i], "--slow-ms") == 0 && i + 1 < argc) {
+            slow_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--listen socket_path [--workers n] | --connect socket_path] [--slow-log file [--slow-ms ms]] [--perf]\n", argv[0]);
+            exit(EXIT_FAILURE);
         }
+    }
+
+    if (connect_path != NULL) return run_client(connect_path);
+    if (slow_log_path != NULL && open_slow_log(slow_log_path, slow_ms) != 0) {
+        fprintf(stderr, "Could not open the slow query log %s\n", slow_log_path);
+        exit(EXIT_FAILURE);
+    }
+    // without hardware counters the engine runs as it would without --perf
+    if (perf && enable_perf_counters() != 0) {
+        fprintf(stderr, "Hardware counters are unavailable: %s\n", perf_counters_error());
+    }
 
-        Statement statement;
-        switch (prepare_statement(input_buffer, &statement)) {
-            case PREPARE_SUCCESS:
-                break;
-            case PREPARE_SYNTAX_ERROR:
-                printf("Syntax error. Could not parse statement.\n");
-                continue;
-            case PREPARE_UNRECOGNIZED_STATEMENT:
-                printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
-                continue;
-            case PREPARE_INSERT_TYPE_ERROR:
-                printf("Insert type error.\n");
-                continue;
-            case PREPARE_INSERT_VARCHAR_SIZE_ERROR:
-                printf("The size of the VARCHAR given is larger than the determined size.\n");
-                continue;
-            case PREPARE_TABLE_NOT_FOUND_ERROR:
-                printf("Table not found.\n");
-                continue;
-            }
+    start_cleaner();
+    if (listen_path != NULL) return run_server(listen_path, workers);
 
+    Session session;
+    init_session(&session, &global_db, stdout);
 
+    InputBuffer* input_buffer = new_input_buffer();
+    while (1) {
+        print_prompt();
+        read_input(input_buffer);
 
-        switch (execute_statement(&statement)) {
-            case EXECUTE_SUCCESS:
-                printf("Executed.\n");
-                break;
-            case EXECUTE_FAIL:
-                printf("Error.\n");
-                break;
-            }
-        free_statement(&statement);
+        if (run_input(&session, input_buffer) == SESSION_EXIT) {
+            close_session(&session);
+            close_input_buffer(input_buffer);
+            exit(EXIT_SUCCESS);
+        }
     }
-}
\ No newline at end of file
+}
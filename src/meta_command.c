@@ -4,7 +4,150 @@
 
 #include "meta_command.h"
 #include "input_buffer.h"
+#include "session.h"
+#include "database.h"
+#include "binary_plus_tree.h"
+#include "metrics.h"
+#include "statement.h"
+#include "slow_log.h"
+#include "perf_counters.h"
 
+// statements that take longer than this are logged when .slowlog is given no threshold
+#define DEFAULT_SLOW_MS 100.0
+
+static uint32_t table_pages(Table* table) {
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    return (__atomic_load_n(&table->num_rows, __ATOMIC_ACQUIRE) + rows_per_page - 1) / rows_per_page;
+}
+
+static void print_stats(FILE* out, const MetricsSnapshot* metrics) {
+    fprintf(out, "Counters:\n");
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        fprintf(out, "  %-28s %llu\n", counter_name((Counter)i), (unsigned long long)metrics->counters[i]);
+    }
+    if (metrics->counters[METRIC_CYCLES] > 0) {
+        fprintf(out, "  %-28s %.2f\n", "instructions_per_cycle",
+                (double)metrics->counters[METRIC_INSTRUCTIONS] / (double)metrics->counters[METRIC_CYCLES]);
+    }
+    print_perf_settings(out);
+    fprintf(out, "Histograms:\n");
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const Histogram* histogram = &metrics->histograms[i];
+        fprintf(out, "  %-28s count %llu, mean %.1f, p50 %llu, p99 %llu, max %llu\n", histogram_name((HistogramMetric)i),
+                (unsigned long long)histogram->count, histogram->count ? (double)histogram->sum / (double)histogram->count : 0.0,
+                (unsigned long long)histogram_percentile(histogram, 50), (unsigned long long)histogram_percentile(histogram, 99),
+                (unsigned long long)histogram->max);
+    }
+    fprintf(out, "Tables:\n");
+    for (uint32_t i = 0; i < global_db.num_tables; i++) {
+        Table* table = global_db.tables[i];
+        fprintf(out, "  %-28s %u live rows, %u dead versions, %u pages, index height %d\n", table->name,
+                __atomic_load_n(&table->live_rows, __ATOMIC_RELAXED), __atomic_load_n(&table->dead_versions, __ATOMIC_RELAXED),
+                table_pages(table), bpt_height(table->tree));
+    }
+}
+
+static void print_stats_json(FILE* out, const MetricsSnapshot* metrics) {
+    fprintf(out, "{\"counters\":{");
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        fprintf(out, "%s\"%s\":%llu", i ? "," : "", counter_name((Counter)i), (unsigned long long)metrics->counters[i]);
+    }
+    fprintf(out, "},\"histograms\":{");
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) {
+        const Histogram* histogram = &metrics->histograms[i];
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"sum\":%llu,\"p50\":%llu,\"p99\":%llu,\"max\":%llu}", i ? "," : "",
+                histogram_name((HistogramMetric)i), (unsigned long long)histogram->count, (unsigned long long)histogram->sum,
+                (unsigned long long)histogram_percentile(histogram, 50), (unsigned long long)histogram_percentile(histogram, 99),
+                (unsigned long long)histogram->max);
+    }
+    fprintf(out, "},\"tables\":[");
+    for (uint32_t i = 0; i < global_db.num_tables; i++) {
+        Table* table = global_db.tables[i];
+        fprintf(out, "%s{\"name\":\"%s\",\"live_rows\":%u,\"dead_versions\":%u,\"pages\":%u,\"index_height\":%d}",
+                i ? "," : "", table->name, __atomic_load_n(&table->live_rows, __ATOMIC_RELAXED),
+                __atomic_load_n(&table->dead_versions, __ATOMIC_RELAXED), table_pages(table), bpt_height(table->tree));
+    }
+    fprintf(out, "]}\n");
+}
+
+static void do_stats_command(const char* argument) {
+    if (strcmp(argument, "reset") == 0) {
+        reset_metrics();
+        fprintf(current_session->out, "Statistics reset.\n");
+        return;
+    }
+
+    // the latency histograms make a snapshot too large for the stack of a worker
+    MetricsSnapshot* metrics = malloc(sizeof(MetricsSnapshot));
+    if (!metrics) {
+        perror("malloc failed");
+        exit(1);
+    }
+    read_metrics(metrics);
+    // tables can't be dropped while their trees are measured
+    pthread_rwlock_rdlock(&global_db.lock);
+    if (strcmp(argument, "json") == 0) print_stats_json(current_session->out, metrics);
+    else print_stats(current_session->out, metrics);
+    pthread_rwlock_unlock(&global_db.lock);
+    free(metrics);
+}
+
+
+static void print_latency(FILE* out) {
+    MetricsSnapshot* metrics = malloc(sizeof(MetricsSnapshot));
+    if (!metrics) {
+        perror("malloc failed");
+        exit(1);
+    }
+    read_metrics(metrics);
+
+    static const char* const phase_names[LATENCY_PHASES] = { "prepare", "execute" };
+    fprintf(out, "%-16s %-8s %10s %12s %12s %12s %12s\n", "statement", "phase", "count", "p50 us", "p99 us", "p999 us", "max us");
+    for (int type = 0; type <= STATEMENT_EXPLAIN; type++) {
+        for (int phase = 0; phase < LATENCY_PHASES; phase++) {
+            const Histogram* histogram = &metrics->latencies[type][phase];
+            if (histogram->count == 0) continue;
+            fprintf(out, "%-16s %-8s %10llu %12.1f %12.1f %12.1f %12.1f\n", statement_type_name((StatementType)type),
+                    phase_names[phase], (unsigned long long)histogram->count, (double)histogram_percentile(histogram, 50) / 1e3,
+                    (double)histogram_percentile(histogram, 99) / 1e3, (double)histogram_percentile(histogram, 99.9) / 1e3,
+                    (double)histogram->max / 1e3);
+        }
+    }
+    free(metrics);
+}
+
+static void do_slow_log_command(const char* argument) {
+    char path[256];
+    double threshold_ms = DEFAULT_SLOW_MS;
+    if (*argument == '\0') {
+        print_slow_log_settings(current_session->out);
+    } else if (strcmp(argument, "off") == 0) {
+        close_slow_log();
+        fprintf(current_session->out, "Slow query log is off.\n");
+    } else if (strcmp(argument, "on") == 0 || strncmp(argument, "on ", 3) == 0) {
+        if (sscanf(argument, "on %lf", &threshold_ms) == 0 || reopen_slow_log(threshold_ms) != 0) {
+            fprintf(current_session->out, "Error: could not open the slow query log.\n");
+        } else {
+            print_slow_log_settings(current_session->out);
+        }
+    } else if (current_session->remote) {
+        // a client would otherwise get the server to create or append to any file it can write
+        fprintf(current_session->out, "Error: only the local session can choose the slow query log file.\n");
+    } else if (sscanf(argument, "%255s %lf", path, &threshold_ms) < 1 || open_slow_log(path, threshold_ms) != 0) {
+        fprintf(current_session->out, "Error: could not open the slow query log.\n");
+    } else {
+        print_slow_log_settings(current_session->out);
+    }
+}
+
+static void do_perf_command(const char* argument) {
+    if (strcmp(argument, "on") == 0 && enable_perf_counters() != 0) {
+        fprintf(current_session->out, "Error: hardware counters are unavailable: %s.\n", perf_counters_error());
+        return;
+    }
+    if (strcmp(argument, "off") == 0) disable_perf_counters();
+    print_perf_settings(current_session->out);
+}
 
 MetaCommandResult do_meta_command(const InputBuffer* input_buffer) {
     if (strcmp(input_buffer->buffer, ".exit") == 0) {
@@ -12,9 +155,31 @@ MetaCommandResult do_meta_command(const InputBuffer* input_buffer) {
 
     }
     if (strcmp(input_buffer->buffer, ".help") == 0) {
-        printf("\nMeta-commands:\n");
-        printf("  .help      Show this help\n");
-        printf("  .exit      Exit the program\n\n");
+        fprintf(current_session->out, "\nMeta-commands:\n");
+        fprintf(current_session->out, "  .help      Show this help\n");
+        fprintf(current_session->out, "  .stats     Show engine counters, .stats json for JSON, .stats reset to clear them\n");
+        fprintf(current_session->out, "  .latency   Show prepare and execute latency percentiles per statement type\n");
+        fprintf(current_session->out, "  .slowlog   Log statements slower than ms to a file: .slowlog file [ms], .slowlog on [ms]|off\n");
+        fprintf(current_session->out, "  .perf      Count cycles, instructions, LLC and branch misses per statement: .perf on|off\n");
+        fprintf(current_session->out, "  .exit      Exit the program\n\n");
+        return META_COMMAND_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, ".stats") == 0 || strcmp(input_buffer->buffer, ".stats json") == 0 ||
+        strcmp(input_buffer->buffer, ".stats reset") == 0) {
+        do_stats_command(input_buffer->buffer[6] == ' ' ? input_buffer->buffer + 7 : "");
+        return META_COMMAND_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, ".latency") == 0) {
+        print_latency(current_session->out);
+        return META_COMMAND_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, ".slowlog") == 0 || strncmp(input_buffer->buffer, ".slowlog ", 9) == 0) {
+        do_slow_log_command(input_buffer->buffer[8] == ' ' ? input_buffer->buffer + 9 : "");
+        return META_COMMAND_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, ".perf") == 0 || strcmp(input_buffer->buffer, ".perf on") == 0 ||
+        strcmp(input_buffer->buffer, ".perf off") == 0) {
+        do_perf_command(input_buffer->buffer[5] == ' ' ? input_buffer->buffer + 6 : "");
         return META_COMMAND_SUCCESS;
     }
 
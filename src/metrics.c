@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "metrics.h"
+
+_Thread_local MetricsShard* metrics_shard = NULL;
+
+static MetricsShard* shards = NULL;
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+// sums at the last reset, guarded by baseline_lock since only readers and reset touch it
+static pthread_mutex_t baseline_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsSnapshot baseline;
+
+static const char* const counter_names[METRIC_COUNTERS] = {
+    "statements", "statement_errors", "rows_scanned", "rows_returned", "rows_inserted", "rows_updated",
+    "rows_deleted", "pages_allocated", "pages_skipped", "overflow_pages_allocated", "overflow_pages_freed",
+    "index_lookups", "index_nodes_visited", "index_nodes_created", "index_splits", "index_restarts", "commits",
+    "rollbacks", "cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+static const char* const histogram_names[METRIC_HISTOGRAMS] = {
+    "rows_scanned_per_statement", "rows_returned_per_statement"
+};
+
+const char* counter_name(const Counter counter) {
+    return counter_names[counter];
+}
+
+const char* histogram_name(const HistogramMetric metric) {
+    return histogram_names[metric];
+}
+
+static void release_shard(void* shard) {
+    __atomic_store_n(&((MetricsShard*)shard)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void create_shard_key(void) {
+    pthread_key_create(&shard_key, release_shard);
+}
+
+MetricsShard* claim_metrics_shard(void) {
+    pthread_once(&shard_key_once, create_shard_key);
+
+    // a shard left by a thread that exited is taken over before a new one is added to the list
+    MetricsShard* shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+    for (; shard != NULL; shard = shard->next) {
+        int free_shard = 0;
+        if (__atomic_compare_exchange_n(&shard->in_use, &free_shard, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    }
+    if (shard == NULL) {
+        shard = calloc(1, sizeof(MetricsShard));
+        if (!shard) {
+            perror("calloc failed");
+            exit(1);
+        }
+        shard->in_use = 1;
+        shard->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&shards, &shard->next, shard, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(shard_key, shard);
+    metrics_shard = shard;
+    return shard;
+}
+
+static int bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) return (int)value;
+    if (value >> HISTOGRAM_MAX_BITS) value = (1ULL << HISTOGRAM_MAX_BITS) - 1;
+    const int exponent = 63 - __builtin_clzll(value);
+    const int sub = (int)(value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// the largest value that falls into a bucket
+static uint64_t bucket_upper_bound(const int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) return (uint64_t)index;
+    const int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    const uint64_t lower = (uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+static void add_relaxed(uint64_t* value, const uint64_t amount) {
+    __atomic_store_n(value, *value + amount, __ATOMIC_RELAXED);
+}
+
+void histogram_record(Histogram* histogram, const uint64_t value) {
+    add_relaxed(&histogram->buckets[bucket_index(value)], 1);
+    add_relaxed(&histogram->count, 1);
+    add_relaxed(&histogram->sum, value);
+    if (value > histogram->max) __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+void histogram_merge(Histogram* into, const Histogram* from) {
+    into->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+    into->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+    const uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+    if (max > into->max) into->max = max;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) into->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+}
+
+uint64_t histogram_percentile(const Histogram* histogram, const double percentile) {
+    // the bucket the rank falls in is reported by its upper bound, never past the largest value seen
+    if (histogram->count == 0) return 0;
+    uint64_t rank = (uint64_t)(percentile / 100 * (double)histogram->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            const uint64_t bound = bucket_upper_bound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void metrics_record(const HistogramMetric metric, const uint64_t value) {
+    histogram_record(&thread_metrics()->histograms[metric], value);
+}
+
+void metrics_record_latency(const int statement_type, const LatencyPhase phase, const uint64_t nanos) {
+    histogram_record(&thread_metrics()->latencies[statement_type][phase], nanos);
+}
+
+static void sum_shards(MetricsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(MetricsSnapshot));
+    for (const MetricsShard* shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); shard != NULL; shard = shard->next) {
+        for (int i = 0; i < METRIC_COUNTERS; i++) snapshot->counters[i] += __atomic_load_n(&shard->counters[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < METRIC_HISTOGRAMS; i++) histogram_merge(&snapshot->histograms[i], &shard->histograms[i]);
+        for (int type = 0; type < LATENCY_STATEMENT_TYPES; type++) {
+            for (int phase = 0; phase < LATENCY_PHASES; phase++) {
+                histogram_merge(&snapshot->latencies[type][phase], &shard->latencies[type][phase]);
+            }
+        }
+    }
+}
+
+static void subtract_histogram(Histogram* histogram, const Histogram* since) {
+    histogram->count -= since->count;
+    histogram->sum -= since->sum;
+    int highest = -1;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->buckets[i] -= since->buckets[i];
+        if (histogram->buckets[i] > 0) highest = i;
+    }
+    // the largest value isn't kept per reset, the top bucket left bounds it
+    if (highest < 0) histogram->max = 0;
+    else if (bucket_upper_bound(highest) < histogram->max) histogram->max = bucket_upper_bound(highest);
+}
+
+void read_metrics(MetricsSnapshot* snapshot) {
+    sum_shards(snapshot);
+    pthread_mutex_lock(&baseline_lock);
+    for (int i = 0; i < METRIC_COUNTERS; i++) snapshot->counters[i] -= baseline.counters[i];
+    for (int i = 0; i < METRIC_HISTOGRAMS; i++) subtract_histogram(&snapshot->histograms[i], &baseline.histograms[i]);
+    for (int type = 0; type < LATENCY_STATEMENT_TYPES; type++) {
+        for (int phase = 0; phase < LATENCY_PHASES; phase++) {
+            subtract_histogram(&snapshot->latencies[type][phase], &baseline.latencies[type][phase]);
+        }
+    }
+    pthread_mutex_unlock(&baseline_lock);
+}
+
+void reset_metrics(void) {
+    pthread_mutex_lock(&baseline_lock);
+    sum_shards(&baseline);
+    pthread_mutex_unlock(&baseline_lock);
+}
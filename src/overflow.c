@@ -0,0 +1,90 @@
+#include "overflow.h"
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void spill_text(SpilledText* spilled, const char* text, const uint32_t length) {
+    memset(spilled, 0, sizeof(SpilledText));
+    spilled->length = length;
+
+    const uint32_t prefix_length = length < VARCHAR_PREFIX_SIZE ? length : VARCHAR_PREFIX_SIZE;
+    memcpy(spilled->prefix, text, prefix_length);
+
+    OverflowPage** link = &spilled->rest;
+    for (uint32_t offset = prefix_length; offset < length;) {
+        OverflowPage* page = malloc(sizeof(OverflowPage));
+        if (!page) {
+            perror("malloc failed");
+            exit(1);
+        }
+        const uint32_t chunk = length - offset < OVERFLOW_PAGE_DATA ? length - offset : (uint32_t)OVERFLOW_PAGE_DATA;
+        memcpy(page->data, text + offset, chunk);
+        page->length = chunk;
+        page->next = NULL;
+        *link = page;
+        link = &page->next;
+        offset += chunk;
+        metrics_add(METRIC_OVERFLOW_PAGES_ALLOCATED, 1);
+    }
+}
+
+void free_spilled_text(const SpilledText* spilled) {
+    OverflowPage* page = spilled->rest;
+    while (page != NULL) {
+        OverflowPage* next = page->next;
+        free(page);
+        page = next;
+        metrics_add(METRIC_OVERFLOW_PAGES_FREED, 1);
+    }
+}
+
+TextValue inline_text(const char* text, const uint32_t length) {
+    const TextValue value = { .bytes = text, .inline_length = length, .length = length, .rest = NULL };
+    return value;
+}
+
+TextValue spilled_text_value(const SpilledText* spilled) {
+    const uint32_t prefix_length = spilled->length < VARCHAR_PREFIX_SIZE ? spilled->length : VARCHAR_PREFIX_SIZE;
+    const TextValue value = { .bytes = spilled->prefix, .inline_length = prefix_length,
+                              .length = spilled->length, .rest = spilled->rest };
+    return value;
+}
+
+void read_text(const TextValue* value, char* out) {
+    memcpy(out, value->bytes, value->inline_length);
+    out += value->inline_length;
+    for (const OverflowPage* page = value->rest; page != NULL; page = page->next) {
+        memcpy(out, page->data, page->length);
+        out += page->length;
+    }
+}
+
+static int compare_chunk(const char* bytes, const uint32_t length, const char* target, const size_t target_length,
+                         size_t* position) {
+    // compares the next chunk of the value against the same stretch of the target
+    if (*position >= target_length) return 0;
+    const size_t remaining = target_length - *position;
+    const size_t count = length < remaining ? length : remaining;
+    const int result = memcmp(bytes, target + *position, count);
+    *position += count;
+    return result;
+}
+
+int compare_text(const TextValue* value, const char* target, const size_t target_length) {
+    // the chain is only walked while the prefix is equal, most comparisons are decided in the row
+    size_t position = 0;
+    int result = compare_chunk(value->bytes, value->inline_length, target, target_length, &position);
+    for (const OverflowPage* page = value->rest; result == 0 && page != NULL && position < target_length; page = page->next) {
+        result = compare_chunk(page->data, page->length, target, target_length, &position);
+    }
+    if (result != 0) return result;
+    return (value->length > target_length) - (value->length < target_length);
+}
+
+void print_text(FILE* out, const TextValue* value) {
+    fwrite(value->bytes, 1, value->inline_length, out);
+    for (const OverflowPage* page = value->rest; page != NULL; page = page->next) {
+        fwrite(page->data, 1, page->length, out);
+    }
+}
@@ -7,6 +7,9 @@
 #include "table.h"
 #include "parser_helpers.h"
 
+static PrepareResult parse_insert_values(Lexer* lexer, const TableSchema* schema, InsertStatement* insert_statement);
+static PrepareResult parse_assignment(Lexer* lexer, const TableSchema* schema, Assignment* assignment);
+
 /*
  * TODO: Apply both types of the INSERT INTO statements
  *  INSERT INTO table_name (column1, column2, column3, ...) VALUES (value1, value2, value3, ...);
@@ -27,11 +30,23 @@ PrepareResult parse_insert(Lexer* lexer, Statement* statement, Token token) {
     }
     const TableSchema schema = table->schema;
 
-    const Row* row = create_row(&table->schema);
+    Row* row = create_row(&table->schema);
     insert_statement.row = *row;
+    free(row);
 
+    const PrepareResult result = parse_insert_values(lexer, &schema, &insert_statement);
+    if (result != PREPARE_SUCCESS) {
+        free(insert_statement.row.data);
+        return result;
+    }
 
-    token = next_token(lexer);
+    statement->type = STATEMENT_INSERT;
+    statement->insert_stmt = insert_statement;
+    return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_insert_values(Lexer* lexer, const TableSchema* schema, InsertStatement* insert_statement) {
+    Token token = next_token(lexer);
     if (token.type != TOKEN_VALUES) return PREPARE_SYNTAX_ERROR;
 
     token = next_token(lexer);
@@ -42,8 +57,9 @@ PrepareResult parse_insert(Lexer* lexer, Statement* statement, Token token) {
     int col_index = 0;
     while (1) {
         token = next_token(lexer);
+        if (col_index >= schema->num_columns) return PREPARE_SYNTAX_ERROR;
 
-        const ColumnType column_type = schema.columns[col_index].type;
+        const ColumnType column_type = schema->columns[col_index].type;
 
         switch (column_type) {
             case COLUMN_INT: {
@@ -53,13 +69,14 @@ PrepareResult parse_insert(Lexer* lexer, Statement* statement, Token token) {
                 if (endptr == token.text || *endptr != '\0' || token.type != TOKEN_NUMBER) {
                     return PREPARE_INSERT_TYPE_ERROR;
                 }
-                set_int_value(&table->schema, &insert_statement.row, col_index, (int32_t)num);
+                set_int_value(schema, &insert_statement->row, col_index, (int32_t)num);
                 break;
             }
             case COLUMN_VARCHAR: {
+                // the token text is truncated, long strings are copied straight from the input
                 if (token.type != TOKEN_STRING) return PREPARE_INSERT_TYPE_ERROR;
-                if (schema.columns[col_index].size < strlen(token.text)) return PREPARE_INSERT_VARCHAR_SIZE_ERROR;
-                set_text_value(&table->schema, &insert_statement.row, col_index, token.text);
+                if (schema->columns[col_index].size < token.length) return PREPARE_INSERT_VARCHAR_SIZE_ERROR;
+                memcpy(insert_statement->row.data + get_column_offset(schema, col_index), token.start, token.length);
                 break;
             }
             default:
@@ -73,8 +90,6 @@ PrepareResult parse_insert(Lexer* lexer, Statement* statement, Token token) {
         if (next.type != TOKEN_COMMA) return PREPARE_SYNTAX_ERROR;
     }
 
-    statement->type = STATEMENT_INSERT;
-    statement->insert_stmt = insert_statement;
     return PREPARE_SUCCESS;
 }
 
@@ -118,6 +133,7 @@ PrepareResult parse_select(Lexer* lexer, Statement* statement, Token token) {
                 return PREPARE_SYNTAX_ERROR;
             }
             select_statement.conditions[condition_index].column_index = col_index;
+            resolve_condition(table, &select_statement.conditions[condition_index]);
         }
     }
 
@@ -151,6 +167,10 @@ PrepareResult parse_create(Lexer* lexer, Statement* statement, const InputBuffer
         if (parse_columns(lexer, &create_statement) != PARSE_SUCCESS)
             return PREPARE_SYNTAX_ERROR;
 
+        token = next_token(lexer);
+        if (token.type == TOKEN_WITH && parse_table_options(lexer, &create_statement) != PARSE_SUCCESS)
+            return PREPARE_SYNTAX_ERROR;
+
         statement->type = STATEMENT_CREATE_TABLE;
         statement->create_table_stmt = create_statement;
         return PREPARE_SUCCESS;
@@ -240,9 +260,200 @@ PrepareResult parse_delete(Lexer* lexer, Statement* statement, Token token) {
             }
 
             delete_statement.conditions[j].column_index = col_index;
+            resolve_condition(table, &delete_statement.conditions[j]);
         }
     }
     statement->type = STATEMENT_DELETE;
     statement->delete_stmt = delete_statement;
     return PREPARE_SUCCESS;
+}
+
+PrepareResult parse_update(Lexer* lexer, Statement* statement, Token token) {
+    // UPDATE table_name SET column = value, ... [WHERE ...]
+    UpdateStatement update_statement = {0};
+
+    if (parse_table_name(lexer, update_statement.table_name, sizeof(update_statement.table_name)) != PARSE_SUCCESS)
+        return PREPARE_SYNTAX_ERROR;
+    const Table* table = find_table(&global_db, update_statement.table_name);
+    if (table == NULL) {
+        return PREPARE_TABLE_NOT_FOUND_ERROR;
+    }
+
+    token = next_token(lexer);
+    if (token.type != TOKEN_SET) return PREPARE_SYNTAX_ERROR;
+
+    PrepareResult result = PREPARE_SUCCESS;
+    while (result == PREPARE_SUCCESS) {
+        if (update_statement.assignment_count == MAX_COLUMNS) {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        Assignment* assignment = &update_statement.assignments[update_statement.assignment_count];
+        result = parse_assignment(lexer, &table->schema, assignment);
+        if (assignment->value != NULL) update_statement.assignment_count++;
+        if (result != PREPARE_SUCCESS) break;
+
+        token = next_token(lexer);
+        if (token.type == TOKEN_COMMA) continue;
+        if (token.type == TOKEN_WHERE) {
+            // the conditions are already freed when they fail to parse
+            if (parse_where_conditions(lexer, &update_statement.condition_count, update_statement.conditions) != PARSE_SUCCESS) {
+                update_statement.condition_count = 0;
+                result = PREPARE_SYNTAX_ERROR;
+            } else {
+                update_statement.has_condition = 1;
+            }
+        } else if (token.type != TOKEN_EOF && token.type != TOKEN_SEMICOLON) {
+            result = PREPARE_SYNTAX_ERROR;
+        }
+        break;
+    }
+
+    for (uint32_t i = 0; i < update_statement.condition_count && result == PREPARE_SUCCESS; i++) {
+        const int col_index = get_column_index(&table->schema, update_statement.conditions[i].column_name);
+        if (col_index < 0) {
+            result = PREPARE_SYNTAX_ERROR;
+            break;
+        }
+        update_statement.conditions[i].column_index = col_index;
+        resolve_condition(table, &update_statement.conditions[i]);
+    }
+
+    statement->type = STATEMENT_UPDATE;
+    statement->update_stmt = update_statement;
+    if (result != PREPARE_SUCCESS) free_statement(statement);
+    return result;
+}
+
+static PrepareResult parse_assignment(Lexer* lexer, const TableSchema* schema, Assignment* assignment) {
+    // column = literal, or column = int_column [+|- number]
+    Token token = next_token(lexer);
+    if (token.type != TOKEN_IDENTIFIER) return PREPARE_SYNTAX_ERROR;
+    const int col_index = get_column_index(schema, token.text);
+    if (col_index < 0) return PREPARE_SYNTAX_ERROR;
+    assignment->column_index = (uint32_t)col_index;
+    assignment->source_index = -1;
+    assignment->delta = 0;
+
+    token = next_token(lexer);
+    if (token.type != TOKEN_EQUAL) return PREPARE_SYNTAX_ERROR;
+
+    token = next_token(lexer);
+    const Column* column = &schema->columns[col_index];
+    switch (token.type) {
+        case TOKEN_NUMBER: {
+            if (column->type != COLUMN_INT) return PREPARE_INSERT_TYPE_ERROR;
+            assignment->value = strdup(token.text);
+            return PREPARE_SUCCESS;
+        }
+        case TOKEN_STRING:
+            if (column->type != COLUMN_VARCHAR) return PREPARE_INSERT_TYPE_ERROR;
+            if (column->size < token.length) return PREPARE_INSERT_VARCHAR_SIZE_ERROR;
+            assignment->value = strndup(token.start, token.length);
+            return PREPARE_SUCCESS;
+        case TOKEN_IDENTIFIER:
+            break;
+        default:
+            return PREPARE_SYNTAX_ERROR;
+    }
+
+    assignment->source_index = get_column_index(schema, token.text);
+    if (assignment->source_index < 0) return PREPARE_SYNTAX_ERROR;
+    if (column->type != COLUMN_INT || schema->columns[assignment->source_index].type != COLUMN_INT)
+        return PREPARE_INSERT_TYPE_ERROR;
+    assignment->value = strdup(token.text);
+
+    // the operator is left for the caller when the value is the column alone
+    Lexer after_source = *lexer;
+    token = next_token(&after_source);
+    if (strcmp(token.text, "+") != 0 && strcmp(token.text, "-") != 0) return PREPARE_SUCCESS;
+    const int negative = token.text[0] == '-';
+    token = next_token(&after_source);
+    if (token.type != TOKEN_NUMBER) return PREPARE_SYNTAX_ERROR;
+    const long delta = strtol(token.text, NULL, 10);
+    assignment->delta = (int32_t)(negative ? -delta : delta);
+    *lexer = after_source;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult parse_vacuum(Lexer* lexer, Statement* statement, Token token) {
+    VacuumStatement vacuum_statement;
+
+    if (parse_table_name(lexer, vacuum_statement.table_name, sizeof(vacuum_statement.table_name)) != PARSE_SUCCESS)
+        return PREPARE_SYNTAX_ERROR;
+    if (find_table(&global_db, vacuum_statement.table_name) == NULL)
+        return PREPARE_TABLE_NOT_FOUND_ERROR;
+
+    token = next_token(lexer);
+    if (token.type != TOKEN_EOF && token.type != TOKEN_SEMICOLON) return PREPARE_SYNTAX_ERROR;
+
+    statement->type = STATEMENT_VACUUM;
+    statement->vacuum_stmt = vacuum_statement;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult parse_analyze(Lexer* lexer, Statement* statement, Token token) {
+    AnalyzeStatement analyze_statement;
+
+    if (parse_table_name(lexer, analyze_statement.table_name, sizeof(analyze_statement.table_name)) != PARSE_SUCCESS)
+        return PREPARE_SYNTAX_ERROR;
+    if (find_table(&global_db, analyze_statement.table_name) == NULL)
+        return PREPARE_TABLE_NOT_FOUND_ERROR;
+
+    token = next_token(lexer);
+    if (token.type != TOKEN_EOF && token.type != TOKEN_SEMICOLON) return PREPARE_SYNTAX_ERROR;
+
+    statement->type = STATEMENT_ANALYZE;
+    statement->analyze_stmt = analyze_statement;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult parse_explain(Lexer* lexer, Statement* statement, Token token) {
+    ExplainStatement explain_statement;
+    token = next_token(lexer);
+    explain_statement.analyze = token.type == TOKEN_ANALYZE;
+    if (explain_statement.analyze) token = next_token(lexer);
+
+    // only statements that find rows through a plan have one to explain
+    Statement* explained = malloc(sizeof(Statement));
+    if (!explained) {
+        perror("malloc failed");
+        exit(1);
+    }
+    PrepareResult result;
+    switch (token.type) {
+        case TOKEN_SELECT:
+            result = parse_select(lexer, explained, token);
+            break;
+        case TOKEN_UPDATE:
+            result = parse_update(lexer, explained, token);
+            break;
+        case TOKEN_DELETE:
+            result = parse_delete(lexer, explained, token);
+            break;
+        default:
+            result = PREPARE_SYNTAX_ERROR;
+    }
+    if (result != PREPARE_SUCCESS) {
+        free(explained);
+        return result;
+    }
+
+    explain_statement.statement = explained;
+    statement->type = STATEMENT_EXPLAIN;
+    statement->explain_stmt = explain_statement;
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult parse_transaction_control(Lexer* lexer, Statement* statement, const Token token) {
+    switch (token.type) {
+        case TOKEN_BEGIN: statement->type = STATEMENT_BEGIN; break;
+        case TOKEN_COMMIT: statement->type = STATEMENT_COMMIT; break;
+        case TOKEN_ROLLBACK: statement->type = STATEMENT_ROLLBACK; break;
+        default: return PREPARE_SYNTAX_ERROR;
+    }
+
+    const Token next = next_token(lexer);
+    if (next.type != TOKEN_EOF && next.type != TOKEN_SEMICOLON) return PREPARE_SYNTAX_ERROR;
+    return PREPARE_SUCCESS;
 }
\ No newline at end of file
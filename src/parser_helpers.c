@@ -2,7 +2,7 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <_string.h>
+#include <strings.h>
 
 ParseResult parse_table_name(Lexer* lexer, char* table_name, size_t size) {
     const Token token = next_token(lexer);
@@ -27,22 +27,50 @@ ParseResult parse_condition(Lexer* lexer, Condition* condition) {
         case TOKEN_GREATER_EQUAL: condition->type = TOKEN_GREATER_EQUAL; break;
         case TOKEN_LESSER_EQUAL: condition->type = TOKEN_LESSER_EQUAL; break;
         case TOKEN_NOT_EQUAL: condition->type = TOKEN_NOT_EQUAL; break;
+        case TOKEN_IN:
+            condition->type = TOKEN_IN;
+            return parse_in_list(lexer, condition);
         default: return PARSE_SYNTAX_ERROR;
     }
 
     token = next_token(lexer);
     if (token.type != TOKEN_NUMBER && token.type != TOKEN_STRING)
         return PARSE_SYNTAX_ERROR;
-    condition->value = strdup(token.text);
+    condition->value = token.type == TOKEN_STRING ? strndup(token.start, token.length) : strdup(token.text);
 
     return PARSE_SUCCESS;
 }
-ParseResult parse_where_conditions(Lexer* lexer, uint32_t* condition_count, Condition* conditions){
+
+ParseResult parse_in_list(Lexer* lexer, Condition* condition) {
+    // IN (value, ...)
+    if (parse_open_paren(lexer) != PARSE_SUCCESS) return PARSE_SYNTAX_ERROR;
+    condition->in_list = new_in_list();
 
     while (1) {
+        const Token token = next_token(lexer);
+        if (token.type != TOKEN_NUMBER && token.type != TOKEN_STRING) return PARSE_SYNTAX_ERROR;
+        in_list_add(condition->in_list, token.type == TOKEN_STRING ? strndup(token.start, token.length) : strdup(token.text));
+
+        const Token next = next_token(lexer);
+        if (next.type == TOKEN_CLOSE_PAREN) break;
+        if (next.type != TOKEN_COMMA) return PARSE_SYNTAX_ERROR;
+    }
+    return PARSE_SUCCESS;
+}
+
+ParseResult parse_where_conditions(Lexer* lexer, uint32_t* condition_count, Condition* conditions){
+    // AND binds tighter than OR, every OR starts a new group
+    uint32_t group = 0;
+    while (1) {
+        if (*condition_count == MAX_COLUMNS) {
+            free_conditions(*condition_count, conditions);
+            return PARSE_SYNTAX_ERROR;
+        }
         Condition* condition = &conditions[*condition_count];
         condition->column_name = NULL;
         condition->value = NULL;
+        condition->in_list = NULL;
+        condition->group = group;
 
         if (parse_condition(lexer, condition) != PARSE_SUCCESS) {
             free_conditions(*condition_count + 1, conditions);
@@ -54,6 +82,10 @@ ParseResult parse_where_conditions(Lexer* lexer, uint32_t* condition_count, Cond
         const Token token = next_token(lexer);
         if (token.type == TOKEN_SEMICOLON || token.type == TOKEN_EOF) break;
         if (token.type == TOKEN_AND) continue;
+        if (token.type == TOKEN_OR) {
+            group++;
+            continue;
+        }
 
         free_conditions(*condition_count, conditions);
         return PARSE_SYNTAX_ERROR;
@@ -187,6 +219,12 @@ ParseResult parse_create_table_column(Lexer* lexer, CreateTableStatement* create
 
         token = next_token(lexer);
         if (token.type != TOKEN_CLOSE_PAREN) return PARSE_SYNTAX_ERROR;
+
+        // VARCHAR(n) DICTIONARY
+        const Lexer before_encoding = *lexer;
+        token = next_token(lexer);
+        if (token.type == TOKEN_DICTIONARY) create_statement->columns[create_statement->num_columns].dictionary_encoded = 1;
+        else *lexer = before_encoding;
         create_statement->num_columns++;
 
     }
@@ -217,5 +255,91 @@ ParseResult parse_primary_key(Lexer* lexer, CreateTableStatement* create_stateme
     token = next_token(lexer);
     if (token.type != TOKEN_CLOSE_PAREN) return PARSE_SYNTAX_ERROR;
 
+    // PRIMARY KEY (column) INCLUDE (column, ...)
+    const Lexer before_include = *lexer;
+    token = next_token(lexer);
+    if (token.type != TOKEN_INCLUDE) {
+        *lexer = before_include;
+        return PARSE_SUCCESS;
+    }
+    return parse_include_columns(lexer, create_statement);
+}
+
+ParseResult parse_include_columns(Lexer* lexer, CreateTableStatement* create_statement) {
+    if (parse_open_paren(lexer) != PARSE_SUCCESS) return PARSE_SYNTAX_ERROR;
+
+    while (1) {
+        Token token = next_token(lexer);
+        if (token.type != TOKEN_IDENTIFIER) return PARSE_SYNTAX_ERROR;
+
+        int column = -1;
+        for (uint32_t i = 0; i < create_statement->num_columns; i++) {
+            if (strcmp(token.text, create_statement->columns[i].name) == 0) column = (int)i;
+        }
+        if (column < 0) return PARSE_SYNTAX_ERROR;
+        for (uint32_t i = 0; i < create_statement->include_count; i++) {
+            if (create_statement->include_columns[i] == (uint32_t)column) return PARSE_SYNTAX_ERROR;
+        }
+        create_statement->include_columns[create_statement->include_count++] = (uint32_t)column;
+
+        token = next_token(lexer);
+        if (token.type == TOKEN_CLOSE_PAREN) break;
+        if (token.type != TOKEN_COMMA) return PARSE_SYNTAX_ERROR;
+    }
+    return PARSE_SUCCESS;
+}
+
+ParseResult parse_table_options(Lexer* lexer, CreateTableStatement* create_statement) {
+    // WITH (option = value, ...)
+    if (parse_open_paren(lexer) != PARSE_SUCCESS) return PARSE_SYNTAX_ERROR;
+
+    while (1) {
+        const Token name = next_token(lexer);
+        if (name.type != TOKEN_IDENTIFIER) return PARSE_SYNTAX_ERROR;
+
+        const Token token = next_token(lexer);
+        if (token.type != TOKEN_EQUAL) return PARSE_SYNTAX_ERROR;
+
+        if (parse_table_option(lexer, create_statement, &name) != PARSE_SUCCESS) return PARSE_SYNTAX_ERROR;
+
+        const Token next = next_token(lexer);
+        if (next.type == TOKEN_CLOSE_PAREN) break;
+        if (next.type != TOKEN_COMMA) return PARSE_SYNTAX_ERROR;
+    }
+
     return PARSE_SUCCESS;
-}
\ No newline at end of file
+}
+
+ParseResult parse_table_option(Lexer* lexer, CreateTableStatement* create_statement, const Token* name) {
+    const Token value = next_token(lexer);
+
+    if (strcasecmp(name->text, "storage") == 0) {
+        if (value.type != TOKEN_IDENTIFIER) return PARSE_SYNTAX_ERROR;
+        if (strcasecmp(value.text, "row") == 0) create_statement->storage = STORAGE_ROW;
+        else if (strcasecmp(value.text, "column") == 0) create_statement->storage = STORAGE_COLUMN;
+        else return PARSE_SYNTAX_ERROR;
+        return PARSE_SUCCESS;
+    }
+
+    if (strcasecmp(name->text, "compression") == 0) {
+        if (value.type != TOKEN_IDENTIFIER) return PARSE_SYNTAX_ERROR;
+        if (strcasecmp(value.text, "none") == 0) create_statement->compression = COMPRESSION_NONE;
+        else if (strcasecmp(value.text, "lz") == 0) create_statement->compression = COMPRESSION_LZ;
+        else return PARSE_SYNTAX_ERROR;
+        return PARSE_SUCCESS;
+    }
+
+    // bloom = column, once for every column that gets filters
+    if (strcasecmp(name->text, "bloom") == 0) {
+        if (value.type != TOKEN_IDENTIFIER) return PARSE_SYNTAX_ERROR;
+        for (uint32_t i = 0; i < create_statement->num_columns; i++) {
+            if (strcmp(value.text, create_statement->columns[i].name) == 0) {
+                create_statement->columns[i].bloom_filter = 1;
+                return PARSE_SUCCESS;
+            }
+        }
+        return PARSE_SYNTAX_ERROR;
+    }
+
+    return PARSE_SYNTAX_ERROR;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char* const event_names[PERF_EVENTS] = { "cycles", "instructions", "LLC misses", "branch misses" };
+
+static int counting = 0;
+
+// the counters of one thread, members[] lists the events in the order a group read returns them
+typedef struct {
+    int opened;
+    int error; // errno of the first event that failed to open
+    int fds[PERF_EVENTS];
+    PerfEvent members[PERF_EVENTS];
+    int member_count;
+    unsigned available;
+} ThreadCounters;
+
+static _Thread_local ThreadCounters thread_counters;
+static pthread_key_t counters_key;
+static pthread_once_t counters_key_once = PTHREAD_ONCE_INIT;
+
+const char* perf_event_name(const PerfEvent event) {
+    return event_names[event];
+}
+
+static void close_counters(void* arg) {
+    ThreadCounters* counters = arg;
+    for (int i = 0; i < counters->member_count; i++) close(counters->fds[i]);
+    counters->member_count = 0;
+    counters->available = 0;
+}
+
+static void create_counters_key(void) {
+    pthread_key_create(&counters_key, close_counters);
+}
+
+#ifdef __linux__
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} event_configs[PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }, // last level cache misses on the CPUs that name one
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+static void open_counters(ThreadCounters* counters) {
+    counters->opened = 1;
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event_configs[event].type;
+        attr.config = event_configs[event].config;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // the first event that opens leads the group, the others join it
+        const int leader = counters->member_count > 0 ? counters->fds[0] : -1;
+        const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0) {
+            if (counters->error == 0) counters->error = errno;
+            continue;
+        }
+        counters->fds[counters->member_count] = fd;
+        counters->members[counters->member_count++] = (PerfEvent)event;
+        counters->available |= 1u << event;
+    }
+    if (counters->member_count > 0) {
+        pthread_once(&counters_key_once, create_counters_key);
+        pthread_setspecific(counters_key, counters);
+    }
+}
+
+static int read_group(const ThreadCounters* counters, PerfReading* reading) {
+    uint64_t buffer[3 + PERF_EVENTS];
+    if (read(counters->fds[0], buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) return 0;
+
+    // buffer holds the member count, the time enabled and running, then a value per member
+    const uint64_t enabled = buffer[1];
+    const uint64_t running = buffer[2];
+    if (running == 0) return 0;
+    for (uint64_t i = 0; i < buffer[0] && i < (uint64_t)counters->member_count; i++) {
+        const uint64_t value = buffer[3 + i];
+        reading->values[counters->members[i]] = running < enabled ? (uint64_t)((double)value * enabled / running) : value;
+    }
+    reading->available = counters->available;
+    return 1;
+}
+#else
+static void open_counters(ThreadCounters* counters) {
+    counters->opened = 1;
+    counters->error = ENOSYS;
+}
+
+static int read_group(const ThreadCounters* counters, PerfReading* reading) {
+    (void)counters;
+    (void)reading;
+    return 0;
+}
+#endif
+
+int enable_perf_counters(void) {
+    ThreadCounters* counters = &thread_counters;
+    if (!counters->opened) open_counters(counters);
+    if (counters->member_count == 0) return -1;
+    __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void disable_perf_counters(void) {
+    __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+}
+
+int perf_counters_enabled(void) {
+    return __atomic_load_n(&counting, __ATOMIC_RELAXED);
+}
+
+int read_perf_counters(PerfReading* reading) {
+    memset(reading, 0, sizeof(PerfReading));
+    if (!perf_counters_enabled()) return 0;
+    ThreadCounters* counters = &thread_counters;
+    if (!counters->opened) open_counters(counters);
+    if (counters->member_count == 0) return 0;
+    return read_group(counters, reading);
+}
+
+// turns end into what was counted between the two readings
+void perf_counters_since(const PerfReading* start, PerfReading* end) {
+    end->available &= start->available;
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        end->values[event] = end->values[event] > start->values[event] ? end->values[event] - start->values[event] : 0;
+    }
+}
+
+// the counted events as a comma separated list, nothing when none were counted
+void print_perf_counters(const PerfReading* reading, FILE* out) {
+    const char* separator = "";
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        if (reading->available & 1u << event) {
+            fprintf(out, "%s%s %llu", separator, event_names[event], (unsigned long long)reading->values[event]);
+            separator = ", ";
+        }
+    }
+    const unsigned both = 1u << PERF_CYCLES | 1u << PERF_INSTRUCTIONS;
+    if ((reading->available & both) == both && reading->values[PERF_CYCLES] > 0) {
+        fprintf(out, ", IPC %.2f", (double)reading->values[PERF_INSTRUCTIONS] / (double)reading->values[PERF_CYCLES]);
+    }
+}
+
+void print_perf_settings(FILE* out) {
+    ThreadCounters* counters = &thread_counters;
+    if (!perf_counters_enabled()) {
+        fprintf(out, "Hardware counters are off.\n");
+        return;
+    }
+    if (!counters->opened) open_counters(counters);
+    fprintf(out, "Hardware counters are on:");
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        fprintf(out, "%s %s %s", event ? "," : "", event_names[event],
+                counters->available & 1u << event ? "counted" : "unavailable");
+    }
+    fprintf(out, ".\n");
+}
+
+// why the calling thread could not open its counters, for the error .perf on reports
+const char* perf_counters_error(void) {
+    return strerror(thread_counters.error != 0 ? thread_counters.error : ENOENT);
+}
@@ -0,0 +1,136 @@
+#include <math.h>
+#include "planner.h"
+#include "statistics.h"
+
+// index one past the last condition of the group starting at first
+uint32_t group_end(const Condition* conditions, const uint32_t condition_count, const uint32_t first) {
+    uint32_t end = first + 1;
+    while (end < condition_count && conditions[end].group == conditions[first].group) end++;
+    return end;
+}
+
+static int primary_condition_usable(const Condition* condition, const Table* table) {
+    // the index answers =, >, >= and IN on the primary key, everything else is a scan
+    if (condition->column_index != table->primary_key_index) return 0;
+    int ok = 0;
+    switch (condition->type) {
+        case TOKEN_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+            parse_target_value(condition->value, &ok);
+            return ok;
+        case TOKEN_IN:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+uint32_t usable_condition_in_group(const Condition* conditions, const uint32_t first, const uint32_t end,
+                                   const Table* table) {
+    for (uint32_t i = first; i < end; i++) {
+        if (primary_condition_usable(&conditions[i], table)) return i;
+    }
+    return -1;
+}
+
+int conditions_use_index(const Condition* conditions, const uint32_t condition_count, const Table* table) {
+    // with OR every group needs a condition the index answers, the rows they find are unioned
+    if (table->primary_key_index < 0) return 0;
+
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        if (usable_condition_in_group(conditions, first, group_end(conditions, condition_count, first), table) == -1) return 0;
+    }
+    return condition_count > 0;
+}
+
+const char* access_path_name(const AccessPath path) {
+    static const char* const names[ACCESS_PATHS] = { "seq scan", "zone map scan", "index" };
+    return names[path];
+}
+
+static double estimate_selectivity(const TableStats* stats, const Table* table, const Condition* condition) {
+    if (stats != NULL) return condition_selectivity(stats, table, condition);
+    switch (condition->type) {
+        case TOKEN_EQUAL: return DEFAULT_EQUAL_SELECTIVITY;
+        case TOKEN_NOT_EQUAL: return 1 - DEFAULT_EQUAL_SELECTIVITY;
+        case TOKEN_IN: return fmin(1.0, condition->in_list->count * DEFAULT_EQUAL_SELECTIVITY);
+        default: return DEFAULT_RANGE_SELECTIVITY;
+    }
+}
+
+static void order_conditions(Condition* conditions, double* selectivities, const uint32_t condition_count) {
+    // insertion sort inside each group, the groups keep their order
+    for (uint32_t i = 1; i < condition_count; i++) {
+        const Condition condition = conditions[i];
+        const double selectivity = selectivities[i];
+        uint32_t j = i;
+        while (j > 0 && conditions[j - 1].group == condition.group && selectivities[j - 1] > selectivity) {
+            conditions[j] = conditions[j - 1];
+            selectivities[j] = selectivities[j - 1];
+            j--;
+        }
+        conditions[j] = condition;
+        selectivities[j] = selectivity;
+    }
+}
+
+static double index_group_cost(const Table* table, const Condition* conditions, const double* selectivities,
+                               const uint32_t first, const uint32_t end, const double rows, const int covered) {
+    // every probe descends the tree, then the entries in the key range are read off the leaf chain
+    const Condition* probe = &conditions[usable_condition_in_group(conditions, first, end, table)];
+    const double probes = probe->type == TOKEN_IN ? probe->in_list->count : 1;
+    const double height = fmax(1.0, ceil(log(fmax(rows, 2.0)) / log(MAX_KEYS)));
+
+    double key_selectivity = 1;
+    for (uint32_t i = first; i < end; i++) {
+        if (conditions[i].column_index != table->primary_key_index || conditions[i].type == TOKEN_NOT_EQUAL) continue;
+        key_selectivity = fmin(key_selectivity, selectivities[i]);
+    }
+    return probes * height * COST_INDEX_LEVEL + key_selectivity * rows * (covered ? COST_INDEX_ENTRY : COST_INDEX_ROW);
+}
+
+void plan_access(const Table* table, Condition* conditions, const uint32_t condition_count, const int covered,
+                 AccessPlan* plan) {
+    const TableStats* stats = table->stats;
+    double selectivities[MAX_COLUMNS];
+    for (uint32_t i = 0; i < condition_count; i++) selectivities[i] = estimate_selectivity(stats, table, &conditions[i]);
+    if (stats != NULL) order_conditions(conditions, selectivities, condition_count);
+
+    // scans read every slot, dead versions included, the index is priced by the live rows it finds
+    const double rows = __atomic_load_n(&table->live_rows, __ATOMIC_RELAXED);
+    const double slots = table->num_rows;
+    const double pages = ceil(slots / table_rows_per_page(table));
+    const int can_use_index = conditions_use_index(conditions, condition_count, table);
+
+    double missed = 1;
+    double page_fraction = 0;
+    double index_cost = 0;
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        const uint32_t end = group_end(conditions, condition_count, first);
+        double group_selectivity = 1;
+        double group_pages = 1;
+        for (uint32_t i = first; i < end; i++) {
+            group_selectivity *= selectivities[i];
+            if (stats != NULL) group_pages = fmin(group_pages, condition_page_fraction(stats, table, &conditions[i]));
+        }
+        missed *= 1 - group_selectivity;
+        page_fraction += group_pages;
+        if (can_use_index) index_cost += index_group_cost(table, conditions, selectivities, first, end, rows, covered);
+    }
+
+    plan->analyzed = stats != NULL;
+    plan->rows = condition_count > 0 ? (1 - missed) * rows : rows;
+    plan->costs[ACCESS_HEAP_SCAN] = slots;
+    plan->costs[ACCESS_ZONE_MAP_SCAN] = condition_count > 0 ? pages * COST_PAGE_CHECK + fmin(1.0, page_fraction) * slots : -1;
+    plan->costs[ACCESS_INDEX] = can_use_index ? index_cost : -1;
+
+    if (stats == NULL) {
+        plan->path = can_use_index ? ACCESS_INDEX : condition_count > 0 ? ACCESS_ZONE_MAP_SCAN : ACCESS_HEAP_SCAN;
+        return;
+    }
+    plan->path = ACCESS_HEAP_SCAN;
+    for (int path = 0; path < ACCESS_PATHS; path++) {
+        if (plan->costs[path] >= 0 && plan->costs[path] < plan->costs[plan->path]) plan->path = (AccessPath)path;
+    }
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "profile.h"
+#include "binary_plus_tree.h"
+
+void profile_start(QueryProfile* profile) {
+    // the totals hold the clock and counter readings at the start until profile_stop turns them into spans
+    memset(profile, 0, sizeof(QueryProfile));
+    profile->index_nodes = bpt_nodes_visited();
+    profile->counting = read_perf_counters(&profile->counters);
+    profile->cpu_nanos = profile_clock(CLOCK_THREAD_CPUTIME_ID);
+    profile->wall_nanos = profile_clock(CLOCK_MONOTONIC);
+}
+
+void profile_stop(QueryProfile* profile) {
+    profile->wall_nanos = profile_clock(CLOCK_MONOTONIC) - profile->wall_nanos;
+    profile->cpu_nanos = profile_clock(CLOCK_THREAD_CPUTIME_ID) - profile->cpu_nanos;
+    profile->index_nodes = bpt_nodes_visited() - profile->index_nodes;
+
+    const uint64_t timed = profile->operators[OPERATOR_FILTER].nanos + profile->operators[OPERATOR_ROOT].nanos;
+    profile->operators[OPERATOR_ACCESS].nanos = profile->wall_nanos > timed ? profile->wall_nanos - timed : 0;
+
+    if (!profile->counting) return;
+    PerfReading end;
+    read_perf_counters(&end);
+    perf_counters_since(&profile->counters, &end);
+    profile->counters = end;
+
+    PerfReading* access = &profile->operators[OPERATOR_ACCESS].counters;
+    const PerfReading* filter = &profile->operators[OPERATOR_FILTER].counters;
+    const PerfReading* root = &profile->operators[OPERATOR_ROOT].counters;
+    access->available = end.available;
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        const uint64_t counted = filter->values[event] + root->values[event];
+        access->values[event] = end.values[event] > counted ? end.values[event] - counted : 0;
+    }
+}
+
+// the start of an operator call, returns the clock for profile_operator and marks the counters
+uint64_t profile_begin(QueryProfile* profile) {
+    if (profile->counting) read_perf_counters(&profile->mark);
+    return profile_clock(CLOCK_MONOTONIC);
+}
+
+void profile_row(QueryProfile* profile, const int visible) {
+    OperatorProfile* access = &profile->operators[OPERATOR_ACCESS];
+    access->rows_in++;
+    access->rows_out += visible != 0;
+}
+
+void profile_page(QueryProfile* profile, const uint32_t page_num) {
+    if (!profile->page_touched[page_num]) {
+        profile->page_touched[page_num] = 1;
+        profile->pages_touched++;
+    }
+}
+
+void profile_operator(QueryProfile* profile, const ProfileOperator op, const uint64_t start, const int passed) {
+    OperatorProfile* operator = &profile->operators[op];
+    operator->nanos += profile_clock(CLOCK_MONOTONIC) - start;
+    if (profile->counting) {
+        PerfReading end;
+        read_perf_counters(&end);
+        perf_counters_since(&profile->mark, &end);
+        operator->counters.available = end.available;
+        for (int event = 0; event < PERF_EVENTS; event++) operator->counters.values[event] += end.values[event];
+    }
+    operator->rows_in++;
+    operator->rows_out += passed != 0;
+}
+
+void print_operator_profile(const QueryProfile* profile, const ProfileOperator op, FILE* out) {
+    const OperatorProfile* operator = &profile->operators[op];
+    fprintf(out, " (actual rows in %llu, out %llu, time %.3f ms", (unsigned long long)operator->rows_in,
+            (unsigned long long)operator->rows_out, (double)operator->nanos / 1e6);
+    if (profile->counting && operator->counters.available != 0) {
+        fprintf(out, ", ");
+        print_perf_counters(&operator->counters, out);
+    }
+    fprintf(out, ")");
+}
+
+void print_profile_totals(const QueryProfile* profile, FILE* out) {
+    fprintf(out, "Pages touched: %u, skipped: %u. Index nodes visited: %llu.\n", profile->pages_touched,
+            profile->pages_skipped, (unsigned long long)profile->index_nodes);
+    fprintf(out, "Execution time: wall %.3f ms, CPU %.3f ms.\n", (double)profile->wall_nanos / 1e6,
+            (double)profile->cpu_nanos / 1e6);
+    if (profile->counting) {
+        fprintf(out, "Hardware counters: ");
+        print_perf_counters(&profile->counters, out);
+        fprintf(out, ".\n");
+    } else if (perf_counters_enabled()) {
+        fprintf(out, "Hardware counters: unavailable.\n");
+    }
+}
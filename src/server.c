@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "database.h"
+#include "input_buffer.h"
+
+static int epoll_fd = -1;
+
+// connections with at least one complete frame, handed from the event loop to the workers
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static Connection* queue_head = NULL;
+static Connection* queue_tail = NULL;
+
+static void enqueue_connection(Connection* connection) {
+    connection->next_ready = NULL;
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail) queue_tail->next_ready = connection;
+    else queue_head = connection;
+    queue_tail = connection;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static Connection* dequeue_connection() {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_head == NULL) pthread_cond_wait(&queue_ready, &queue_lock);
+    Connection* connection = queue_head;
+    queue_head = connection->next_ready;
+    if (queue_head == NULL) queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+    return connection;
+}
+
+static void arm_connection(Connection* connection, const int op) {
+    // one shot: a connection is owned by either the event loop or a single worker, never both
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = connection;
+    epoll_ctl(epoll_fd, op, connection->fd, &event);
+}
+
+static void close_connection(Connection* connection) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    close_session(&connection->session);
+    free(connection->buffer);
+    free(connection);
+}
+
+static int write_all(const int fd, const char* data, size_t length) {
+    while (length > 0) {
+        const ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int send_frame(const int fd, const char* payload, const size_t length) {
+    const uint32_t header = htonl((uint32_t)length);
+    if (write_all(fd, (const char*)&header, FRAME_HEADER_SIZE) != 0) return -1;
+    return write_all(fd, payload, length);
+}
+
+static size_t frame_length(const Connection* connection) {
+    uint32_t header;
+    memcpy(&header, connection->buffer, FRAME_HEADER_SIZE);
+    return ntohl(header);
+}
+
+static int has_complete_frame(const Connection* connection) {
+    if (connection->buffer_length < FRAME_HEADER_SIZE) return 0;
+    return connection->buffer_length >= FRAME_HEADER_SIZE + frame_length(connection);
+}
+
+// runs every buffered request of the connection, returns -1 once the connection should be closed
+static int serve_requests(Connection* connection) {
+    while (has_complete_frame(connection)) {
+        const size_t length = frame_length(connection);
+        char* statement = malloc(length + 1);
+        memcpy(statement, connection->buffer + FRAME_HEADER_SIZE, length);
+        statement[length] = '\0';
+
+        connection->buffer_length -= FRAME_HEADER_SIZE + length;
+        memmove(connection->buffer, connection->buffer + FRAME_HEADER_SIZE + length, connection->buffer_length);
+
+        char* response = NULL;
+        size_t response_length = 0;
+        FILE* out = open_memstream(&response, &response_length);
+        connection->session.out = out;
+
+        InputBuffer input_buffer = { .buffer = statement, .buffer_length = length + 1, .input_length = (ssize_t)length };
+        const SessionResult result = run_input(&connection->session, &input_buffer);
+        fclose(out);
+        free(statement);
+
+        const int sent = send_frame(connection->fd, response, response_length);
+        free(response);
+        if (sent != 0 || result == SESSION_EXIT) return -1;
+    }
+    return 0;
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    while (1) {
+        Connection* connection = dequeue_connection();
+        if (serve_requests(connection) != 0 || connection->peer_closed) {
+            close_connection(connection);
+            continue;
+        }
+        arm_connection(connection, EPOLL_CTL_MOD);
+    }
+    return NULL;
+}
+
+// reads whatever the socket has, returns -1 when the connection broke or the peer broke the protocol
+static int fill_buffer(Connection* connection) {
+    while (1) {
+        if (connection->buffer_capacity - connection->buffer_length < 4096) {
+            const size_t capacity = connection->buffer_capacity ? connection->buffer_capacity * 2 : 8192;
+            char* buffer = realloc(connection->buffer, capacity);
+            if (!buffer) return -1;
+            connection->buffer = buffer;
+            connection->buffer_capacity = capacity;
+        }
+
+        const ssize_t bytes_read = read(connection->fd, connection->buffer + connection->buffer_length,
+                                        connection->buffer_capacity - connection->buffer_length);
+        if (bytes_read == 0) {
+            connection->peer_closed = 1;
+            break;
+        }
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        connection->buffer_length += (size_t)bytes_read;
+    }
+
+    if (connection->buffer_length >= FRAME_HEADER_SIZE && frame_length(connection) > MAX_FRAME_SIZE) return -1;
+    return 0;
+}
+
+static void accept_connections(const int listen_fd) {
+    while (1) {
+        const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        Connection* connection = calloc(1, sizeof(Connection));
+        connection->fd = fd;
+        init_session(&connection->session, &global_db, NULL);
+        connection->session.remote = 1;
+        arm_connection(connection, EPOLL_CTL_ADD);
+    }
+}
+
+int run_server(const char* socket_path, int workers) {
+    if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0) workers = 1;
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("socket failed");
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    unlink(socket_path);
+
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        perror("bind failed");
+        return EXIT_FAILURE;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event;
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, NULL) != 0) {
+            perror("pthread_create failed");
+            return EXIT_FAILURE;
+        }
+        pthread_detach(thread);
+    }
+    printf("Listening on %s with %d workers.\n", socket_path, workers);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (1) {
+        const int ready = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        for (int i = 0; i < ready; i++) {
+            Connection* connection = events[i].data.ptr;
+            if (connection == NULL) {
+                accept_connections(listen_fd);
+                continue;
+            }
+
+            if (fill_buffer(connection) != 0) {
+                close_connection(connection);
+                continue;
+            }
+            // a client that half-closed still gets the answers to the frames it sent, then the connection closes
+            if (has_complete_frame(connection)) enqueue_connection(connection);
+            else if (connection->peer_closed) close_connection(connection);
+            else arm_connection(connection, EPOLL_CTL_MOD);
+        }
+    }
+}
+
+static int read_all(const int fd, char* data, size_t length) {
+    while (length > 0) {
+        const ssize_t bytes_read = read(fd, data, length);
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) return -1;
+        data += bytes_read;
+        length -= (size_t)bytes_read;
+    }
+    return 0;
+}
+
+int run_client(const char* socket_path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        perror("connect failed");
+        return EXIT_FAILURE;
+    }
+
+    InputBuffer* input_buffer = new_input_buffer();
+    while (1) {
+        printf("> ");
+        read_input(input_buffer);
+
+        uint32_t header;
+        if (send_frame(fd, input_buffer->buffer, (size_t)input_buffer->input_length) != 0 ||
+            read_all(fd, (char*)&header, FRAME_HEADER_SIZE) != 0) break;
+
+        const size_t length = ntohl(header);
+        char* response = malloc(length + 1);
+        if (read_all(fd, response, length) != 0) {
+            free(response);
+            break;
+        }
+        fwrite(response, 1, length, stdout);
+        free(response);
+
+        if (strcmp(input_buffer->buffer, ".exit") == 0) break;
+    }
+
+    close_input_buffer(input_buffer);
+    close(fd);
+    return EXIT_SUCCESS;
+}
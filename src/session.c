@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "session.h"
+#include "meta_command.h"
+#include "statement.h"
+#include "metrics.h"
+#include "slow_log.h"
+#include "perf_counters.h"
+
+_Thread_local Session* current_session = NULL;
+
+void init_session(Session* session, Database* db, FILE* out) {
+    session->db = db;
+    session->out = out;
+    session->profile = NULL;
+    session->planned = 0;
+    session->remote = 0;
+    session->transaction.active = 0;
+    session->transaction.undo_log = NULL;
+    session->transaction.undo_count = 0;
+    session->transaction.undo_capacity = 0;
+    session->transaction.next_active = NULL;
+}
+
+void close_session(Session* session) {
+    // a client that goes away mid-transaction must not leave its versions locked up
+    if (session->transaction.active) {
+        pthread_rwlock_rdlock(&session->db->lock);
+        rollback_transaction(&session->transaction);
+        pthread_rwlock_unlock(&session->db->lock);
+    }
+    free(session->transaction.undo_log);
+    session->transaction.undo_log = NULL;
+    session->transaction.undo_capacity = 0;
+}
+
+static int is_schema_change(const Statement* statement) {
+    return statement->type == STATEMENT_CREATE_TABLE || statement->type == STATEMENT_DROP_TABLE;
+}
+
+static uint64_t rows_written_by_thread(void) {
+    return metrics_thread_counter(METRIC_ROWS_INSERTED) + metrics_thread_counter(METRIC_ROWS_UPDATED) +
+           metrics_thread_counter(METRIC_ROWS_DELETED);
+}
+
+_Static_assert(STATEMENT_EXPLAIN < LATENCY_STATEMENT_TYPES, "every statement type needs latency histograms");
+
+// the hardware counters are added up in the metrics in PerfEvent order
+_Static_assert(METRIC_BRANCH_MISSES - METRIC_CYCLES == PERF_BRANCH_MISSES, "a counter for every hardware event");
+
+static void count_perf_events(const PerfReading* start) {
+    PerfReading end;
+    if (!read_perf_counters(&end)) return;
+    perf_counters_since(start, &end);
+    for (int event = 0; event < PERF_EVENTS; event++) {
+        if (end.available & 1u << event) metrics_add((Counter)(METRIC_CYCLES + event), end.values[event]);
+    }
+}
+
+static void record_statement(const StatementType type, const StatementRecord* record) {
+    metrics_record_latency(type, LATENCY_PREPARE, record->prepare_nanos);
+    metrics_record_latency(type, LATENCY_EXECUTE, record->execute_nanos);
+    metrics_record(HISTOGRAM_ROWS_SCANNED, record->rows_scanned);
+    metrics_record(HISTOGRAM_ROWS_RETURNED, record->rows_returned);
+    if (record->failed) metrics_add(METRIC_STATEMENT_ERRORS, 1);
+    if (slow_log_wants(record->prepare_nanos + record->execute_nanos)) log_slow_statement(record);
+}
+
+SessionResult run_input(Session* session, const InputBuffer* input_buffer) {
+    current_session = session;
+    FILE* out = session->out;
+
+    if (input_buffer->buffer[0] == '.') {
+        switch (do_meta_command(input_buffer)) {
+            case META_COMMAND_SUCCESS:
+                break;
+            case META_COMMAND_UNRECOGNIZED:
+                fprintf(out, "Unrecognized meta-command '%s'\n", input_buffer->buffer);
+                break;
+            case META_COMMAND_EXIT:
+                return SESSION_EXIT;
+        }
+        return SESSION_CONTINUE;
+    }
+
+    // the catalog is read locked from prepare to the end of execution so the table can't be dropped under us
+    pthread_rwlock_rdlock(&session->db->lock);
+
+    Statement statement;
+    const uint64_t prepare_start = profile_clock(CLOCK_MONOTONIC);
+    PrepareResult prepare_result = prepare_statement(input_buffer, &statement);
+    const uint64_t prepare_nanos = profile_clock(CLOCK_MONOTONIC) - prepare_start;
+    switch (prepare_result) {
+        case PREPARE_SUCCESS:
+            break;
+        case PREPARE_SYNTAX_ERROR:
+            fprintf(out, "Syntax error. Could not parse statement.\n");
+            break;
+        case PREPARE_UNRECOGNIZED_STATEMENT:
+            fprintf(out, "Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
+            break;
+        case PREPARE_INSERT_TYPE_ERROR:
+            fprintf(out, "Insert type error.\n");
+            break;
+        case PREPARE_INSERT_VARCHAR_SIZE_ERROR:
+            fprintf(out, "The size of the VARCHAR given is larger than the determined size.\n");
+            break;
+        case PREPARE_TABLE_NOT_FOUND_ERROR:
+            fprintf(out, "Table not found.\n");
+            break;
+    }
+    metrics_add(METRIC_STATEMENTS, 1);
+    if (prepare_result != PREPARE_SUCCESS) {
+        metrics_add(METRIC_STATEMENT_ERRORS, 1);
+        pthread_rwlock_unlock(&session->db->lock);
+        return SESSION_CONTINUE;
+    }
+
+    if (is_schema_change(&statement)) {
+        pthread_rwlock_unlock(&session->db->lock);
+        pthread_rwlock_wrlock(&session->db->lock);
+    }
+
+    // the thread's own counters tell the work of this statement apart from what other sessions do
+    const uint64_t rows_scanned = metrics_thread_counter(METRIC_ROWS_SCANNED);
+    const uint64_t rows_returned = metrics_thread_counter(METRIC_ROWS_RETURNED);
+    const uint64_t rows_written = rows_written_by_thread();
+    session->planned = 0;
+    PerfReading perf_start;
+    const int counting = read_perf_counters(&perf_start);
+    const uint64_t execute_start = profile_clock(CLOCK_MONOTONIC);
+    const ExecuteResult execute_result = execute_statement(&statement);
+    const uint64_t execute_nanos = profile_clock(CLOCK_MONOTONIC) - execute_start;
+    if (counting) count_perf_events(&perf_start);
+    pthread_rwlock_unlock(&session->db->lock);
+
+    const StatementRecord record = {
+        .text = input_buffer->buffer,
+        .type_name = statement_type_name(statement.type),
+        .prepare_nanos = prepare_nanos,
+        .execute_nanos = execute_nanos,
+        .plan = session->planned ? &session->plan : NULL,
+        .rows_scanned = metrics_thread_counter(METRIC_ROWS_SCANNED) - rows_scanned,
+        .rows_returned = metrics_thread_counter(METRIC_ROWS_RETURNED) - rows_returned,
+        .rows_written = rows_written_by_thread() - rows_written,
+        .failed = execute_result != EXECUTE_SUCCESS
+    };
+    record_statement(statement.type, &record);
+
+    switch (execute_result) {
+        case EXECUTE_SUCCESS:
+            fprintf(out, "Executed.\n");
+            break;
+        case EXECUTE_FAIL:
+        case EXECUTE_TABLE_FULL:
+            fprintf(out, "Error.\n");
+            break;
+    }
+    free_statement(&statement);
+    return SESSION_CONTINUE;
+}
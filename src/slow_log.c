@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "slow_log.h"
+
+// the file and its path change under log_lock, the threshold is read by every statement without it
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* log_file = NULL;
+static char log_path[256];
+static uint64_t threshold_nanos = UINT64_MAX;
+
+int open_slow_log(const char* path, const double threshold_ms) {
+    if (threshold_ms < 0 || strlen(path) >= sizeof(log_path)) return -1;
+    FILE* file = fopen(path, "a");
+    if (file == NULL) return -1;
+
+    pthread_mutex_lock(&log_lock);
+    if (log_file != NULL) fclose(log_file);
+    log_file = file;
+    strcpy(log_path, path);
+    __atomic_store_n(&threshold_nanos, (uint64_t)(threshold_ms * 1e6), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&log_lock);
+    return 0;
+}
+
+int reopen_slow_log(const double threshold_ms) {
+    char path[sizeof(log_path)];
+    pthread_mutex_lock(&log_lock);
+    strcpy(path, log_path);
+    pthread_mutex_unlock(&log_lock);
+    return path[0] != '\0' ? open_slow_log(path, threshold_ms) : -1;
+}
+
+void close_slow_log(void) {
+    pthread_mutex_lock(&log_lock);
+    __atomic_store_n(&threshold_nanos, UINT64_MAX, __ATOMIC_RELAXED);
+    if (log_file != NULL) fclose(log_file);
+    log_file = NULL;
+    pthread_mutex_unlock(&log_lock);
+}
+
+int slow_log_wants(const uint64_t nanos) {
+    const uint64_t threshold = __atomic_load_n(&threshold_nanos, __ATOMIC_RELAXED);
+    return threshold != UINT64_MAX && nanos >= threshold;
+}
+
+void log_slow_statement(const StatementRecord* record) {
+    char timestamp[32];
+    const time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    pthread_mutex_lock(&log_lock);
+    if (log_file != NULL) {
+        fprintf(log_file, "%s %s %.3f ms (prepare %.3f ms, execute %.3f ms)%s", timestamp, record->type_name,
+                (double)(record->prepare_nanos + record->execute_nanos) / 1e6, (double)record->prepare_nanos / 1e6,
+                (double)record->execute_nanos / 1e6, record->failed ? " failed" : "");
+        if (record->plan != NULL) {
+            fprintf(log_file, " plan: %s, %.0f rows estimated;", access_path_name(record->plan->path), record->plan->rows);
+        }
+        fprintf(log_file, " rows scanned %llu, returned %llu, written %llu: %s\n", (unsigned long long)record->rows_scanned,
+                (unsigned long long)record->rows_returned, (unsigned long long)record->rows_written, record->text);
+        fflush(log_file);
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+void print_slow_log_settings(FILE* out) {
+    pthread_mutex_lock(&log_lock);
+    if (log_file == NULL) fprintf(out, "Slow query log is off.\n");
+    else fprintf(out, "Slow query log: %s, statements over %.3f ms.\n", log_path, (double)threshold_nanos / 1e6);
+    pthread_mutex_unlock(&log_lock);
+}
@@ -8,10 +8,14 @@
 #include "database.h"
 #include "lexer.h"
 #include "binary_plus_tree.h"
+#include "transaction.h"
+#include "session.h"
+#include "planner.h"
+#include "statistics.h"
+#include "profile.h"
+#include "metrics.h"
 
 
-Database global_db;
-
 
 PrepareResult prepare_statement(const InputBuffer* input_buffer, Statement* statement) {
 
@@ -32,6 +36,18 @@ PrepareResult prepare_statement(const InputBuffer* input_buffer, Statement* stat
             return parse_show(&lexer, statement, token);
         case TOKEN_DELETE:
             return parse_delete(&lexer, statement, token);
+        case TOKEN_UPDATE:
+            return parse_update(&lexer, statement, token);
+        case TOKEN_BEGIN:
+        case TOKEN_COMMIT:
+        case TOKEN_ROLLBACK:
+            return parse_transaction_control(&lexer, statement, token);
+        case TOKEN_VACUUM:
+            return parse_vacuum(&lexer, statement, token);
+        case TOKEN_ANALYZE:
+            return parse_analyze(&lexer, statement, token);
+        case TOKEN_EXPLAIN:
+            return parse_explain(&lexer, statement, token);
         default:
             return PREPARE_UNRECOGNIZED_STATEMENT;
     }
@@ -42,9 +58,9 @@ PrepareResult prepare_statement(const InputBuffer* input_buffer, Statement* stat
 ExecuteResult execute_statement(const Statement* statement) {
     switch (statement->type) {
         case STATEMENT_INSERT:
-            return execute_insert(&statement->insert_stmt);
+            return execute_write_statement(statement);
         case STATEMENT_SELECT:
-            return execute_select(&statement->select_stmt);
+            return execute_read_statement(statement);
         case STATEMENT_CREATE_TABLE:
             return execute_create_table(&statement->create_table_stmt);
         case STATEMENT_DROP_TABLE:
@@ -52,124 +68,386 @@ ExecuteResult execute_statement(const Statement* statement) {
         case STATEMENT_SHOW_TABLES:
             return execute_show_tables();
         case STATEMENT_DELETE:
-            return execute_delete(&statement->delete_stmt);
+        case STATEMENT_UPDATE:
+            return execute_write_statement(statement);
+        case STATEMENT_BEGIN:
+            return execute_begin();
+        case STATEMENT_COMMIT:
+            return execute_commit();
+        case STATEMENT_ROLLBACK:
+            return execute_rollback();
+        case STATEMENT_VACUUM:
+            return execute_vacuum(&statement->vacuum_stmt);
+        case STATEMENT_ANALYZE:
+            return execute_analyze(&statement->analyze_stmt);
+        case STATEMENT_EXPLAIN:
+            return execute_explain(&statement->explain_stmt);
         case STATEMENT_CREATE_DATABASE:
-            printf("CREATE DATABASE (to be completed)\n"); // TODO
+            fprintf(current_session->out, "CREATE DATABASE (to be completed)\n"); // TODO
             return EXECUTE_SUCCESS;
         case STATEMENT_SHOW_DATABASES:
-            printf("SHOW DATABASES (to be completed)\n"); // TODO
+            fprintf(current_session->out, "SHOW DATABASES (to be completed)\n"); // TODO
             return EXECUTE_SUCCESS;
     }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_insert(const InsertStatement* insert_statement) {
-    Table* table = find_table(&global_db, insert_statement->table_name);
+const char* statement_type_name(const StatementType type) {
+    static const char* const names[] = {
+        "insert", "select", "create table", "drop table", "show tables", "create database", "show databases",
+        "delete", "begin", "commit", "rollback", "vacuum", "update", "analyze", "explain"
+    };
+    return names[type];
+}
+
+static const char* write_table_name(const Statement* statement) {
+    switch (statement->type) {
+        case STATEMENT_INSERT: return statement->insert_stmt.table_name;
+        case STATEMENT_UPDATE: return statement->update_stmt.table_name;
+        default: return statement->delete_stmt.table_name;
+    }
+}
 
-    if (table->num_rows >= TABLE_MAX_ROWS) {
+static ExecuteResult run_write(const Statement* statement, Table* table) {
+    // writers to the same table are serialized, writers to different tables and readers run side by side
+    pthread_rwlock_rdlock(&table->lock);
+    pthread_mutex_lock(&table->write_lock);
+    ExecuteResult result = EXECUTE_FAIL;
+    switch (statement->type) {
+        case STATEMENT_INSERT:
+            result = execute_insert(&statement->insert_stmt);
+            break;
+        case STATEMENT_DELETE:
+            result = execute_delete(&statement->delete_stmt);
+            break;
+        case STATEMENT_UPDATE:
+            result = execute_update(&statement->update_stmt);
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&table->write_lock);
+    pthread_rwlock_unlock(&table->lock);
+    return result;
+}
+
+ExecuteResult execute_write_statement(const Statement* statement) {
+    Table* table = find_table(&global_db, write_table_name(statement));
+    if (table == NULL) return EXECUTE_FAIL;
+
+    // outside of BEGIN ... COMMIT every write runs as its own transaction
+    const int implicit = !current_session->transaction.active;
+    if (implicit) begin_transaction(&current_session->transaction);
+    const uint32_t savepoint = current_session->transaction.undo_count;
+
+    ExecuteResult result = run_write(statement, table);
+    if (result == EXECUTE_TABLE_FULL) {
+        // dead versions the cleaner hasn't got to yet may hold the slots, free them and run the statement once more
+        rollback_to_savepoint(&current_session->transaction, savepoint);
+        reclaim_dead_versions(table);
+        result = run_write(statement, table);
+        if (result == EXECUTE_TABLE_FULL) {
+            fprintf(current_session->out, "Error: Table full.\n");
+            result = EXECUTE_FAIL;
+        }
+    }
+
+    // a failed statement leaves no partial changes behind, the rest of the transaction is kept
+    if (result != EXECUTE_SUCCESS) rollback_to_savepoint(&current_session->transaction, savepoint);
+
+    if (implicit) commit_transaction(&current_session->transaction);
+    return result;
+}
+
+ExecuteResult execute_read_statement(const Statement* statement) {
+    // reads outside of a transaction still need a snapshot, and registering it keeps the cleaner away
+    Table* table = find_table(&global_db, statement->select_stmt.table_name);
+    if (table == NULL) return EXECUTE_FAIL;
+
+    const int implicit = !current_session->transaction.active;
+    if (implicit) begin_transaction(&current_session->transaction);
+
+    pthread_rwlock_rdlock(&table->lock);
+    const ExecuteResult result = execute_select(&statement->select_stmt);
+    pthread_rwlock_unlock(&table->lock);
+
+    if (implicit) commit_transaction(&current_session->transaction);
+    return result;
+}
+
+ExecuteResult execute_begin() {
+    if (begin_transaction(&current_session->transaction) != 0) {
+        fprintf(current_session->out, "Error: a transaction is already in progress.\n");
         return EXECUTE_FAIL;
     }
+    return EXECUTE_SUCCESS;
+}
 
-    const Row* row_to_insert = &insert_statement->row;
-    void* destination = row_slot(table, table->num_rows);
+ExecuteResult execute_commit() {
+    if (!current_session->transaction.active) {
+        fprintf(current_session->out, "Error: no transaction in progress.\n");
+        return EXECUTE_FAIL;
+    }
+    commit_transaction(&current_session->transaction);
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_rollback() {
+    if (!current_session->transaction.active) {
+        fprintf(current_session->out, "Error: no transaction in progress.\n");
+        return EXECUTE_FAIL;
+    }
+    rollback_transaction(&current_session->transaction);
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_vacuum(const VacuumStatement* vacuum_statement) {
+    Table* table = find_table(&global_db, vacuum_statement->table_name);
+    if (table == NULL) return EXECUTE_FAIL;
+
+    // rows written by our own open transaction could not be moved, and it would hold back the horizon
+    if (current_session->transaction.active) {
+        fprintf(current_session->out, "Error: VACUUM is not allowed inside a transaction.\n");
+        return EXECUTE_FAIL;
+    }
 
-    serialize_row(&table->schema, row_to_insert, destination);
-    table->num_rows += 1;
+    pthread_rwlock_wrlock(&table->lock);
+    const uint32_t reclaimed = collect_dead_versions(table, oldest_active_snapshot());
+    const uint32_t pages_released = compact_table(table);
+    compress_table(table);
+    mark_all_visible(table, oldest_active_snapshot());
+    const uint32_t compressed_count = table->compressed_count;
+    const uint64_t compressed_bytes = table->compressed_bytes;
+    const uint32_t live_rows = __atomic_load_n(&table->live_rows, __ATOMIC_RELAXED);
+    const uint32_t dead_versions = __atomic_load_n(&table->dead_versions, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&table->lock);
+
+    fprintf(current_session->out, "Vacuumed %s: %u live rows, %u dead versions reclaimed, %u still visible to open snapshots, %u pages released.\n",
+            table->name, live_rows, reclaimed, dead_versions, pages_released);
+    if (table->compression != COMPRESSION_NONE && compressed_count > 0) {
+        fprintf(current_session->out, "%u pages compressed to %llu bytes, ratio %.2f.\n", compressed_count,
+                (unsigned long long)compressed_bytes, (double)compressed_count * PAGE_SIZE / (double)compressed_bytes);
+    }
+    return EXECUTE_SUCCESS;
+}
 
-    // TODO as i have not implemented a primary key attribute i will for now use the row number as the key for bpt
-    //bpt_insert(table->tree, (int)table->primary_key_index, destination);
+// writes the row as a new version of the current transaction and indexes it, -1 when the table has no room
+static int insert_version(Table* table, const Row* row_to_insert) {
+    uint32_t row_num;
+    if (allocate_row(table, row_to_insert, &row_num) != 0) {
+        return -1;
+    }
+
+    serialize_row(table, row_to_insert, row_num);
+    zone_map_add(table, row_num);
 
+    void* destination = row_slot_for_write(table, row_num);
+    stamp_insert(&current_session->transaction, destination);
+    // readers scan up to num_rows without taking the writer lock, so publish it after the row is in place
+    if (row_num >= table->num_rows) __atomic_store_n(&table->num_rows, row_num + 1, __ATOMIC_RELEASE);
+
+    // the index maps the key to this version's row number, older versions of the key keep their own entries
+    uint32_t key = 0;
     if (table->primary_key_index >= 0) {
-        const uint32_t key = extract_primary_key(&table->schema, row_to_insert, table->primary_key_index);
-        bpt_insert(table->tree, key, destination);
+        key = extract_primary_key(&table->schema, row_to_insert, table->primary_key_index);
+        uint8_t payload[BPT_MAX_PAYLOAD];
+        build_index_payload(table, row_to_insert, payload);
+        bpt_insert(table->tree, key, row_num, payload);
+    }
+    log_insert(&current_session->transaction, table, row_num, destination, table->primary_key_index >= 0, key);
+    return 0;
+}
+
+static ExecuteResult encode_or_fail(Table* table, const Row* row) {
+    const int full_column = encode_row_values(table, row);
+    if (full_column >= 0) {
+        fprintf(current_session->out, "Error: dictionary of column %s is full.\n", table->schema.columns[full_column].name);
+        return EXECUTE_FAIL;
     }
+    return EXECUTE_SUCCESS;
+}
 
+ExecuteResult execute_analyze(const AnalyzeStatement* analyze_statement) {
+    Table* table = find_table(&global_db, analyze_statement->table_name);
+    if (table == NULL) return EXECUTE_FAIL;
+
+    // the statistics describe what the snapshot sees, the write lock keeps planners from reading them meanwhile
+    const int implicit = !current_session->transaction.active;
+    if (implicit) begin_transaction(&current_session->transaction);
+    pthread_rwlock_wrlock(&table->lock);
+    TableStats* stats = analyze_table(table, &current_session->transaction.snapshot);
+    free(table->stats);
+    table->stats = stats;
+    pthread_rwlock_unlock(&table->lock);
+    if (implicit) commit_transaction(&current_session->transaction);
+
+    fprintf(current_session->out, "Analyzed %s: %u rows on %u pages.\n", table->name, stats->row_count, stats->page_count);
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        const ColumnStats* column = &stats->columns[col_index];
+        fprintf(current_session->out, "  %s: %u distinct values, %u histogram buckets, a page spans %.1f%% of the range.\n",
+                table->schema.columns[col_index].name, column->distinct, column->bucket_count, column->page_span * 100);
+    }
+    return EXECUTE_SUCCESS;
+}
 
+ExecuteResult execute_insert(const InsertStatement* insert_statement) {
+    Table* table = find_table(&global_db, insert_statement->table_name);
+    if (encode_or_fail(table, &insert_statement->row) != EXECUTE_SUCCESS) return EXECUTE_FAIL;
+    if (insert_version(table, &insert_statement->row) != 0) return EXECUTE_TABLE_FULL;
+    metrics_add(METRIC_ROWS_INSERTED, 1);
     return EXECUTE_SUCCESS;
 }
 
+// the slow query log reports how the statement found its rows
+static void remember_plan(const AccessPlan* plan) {
+    current_session->plan = *plan;
+    current_session->planned = 1;
+}
+
+// the access path reads the header of a version, EXPLAIN ANALYZE counts the slot and the page it is on
+static int slot_visible(Table* table, const uint32_t row_num) {
+    const int visible = version_visible(&current_session->transaction.snapshot, row_slot(table, row_num));
+    metrics_add(METRIC_ROWS_SCANNED, 1);
+    QueryProfile* profile = current_session->profile;
+    if (profile != NULL) {
+        profile_row(profile, visible);
+        profile_page(profile, row_num / table_rows_per_page(table));
+    }
+    return visible;
+}
+
+static int filter_row(const Condition* conditions, const uint32_t condition_count, Table* table, const uint32_t row_num) {
+    QueryProfile* profile = current_session->profile;
+    if (profile == NULL) return filter_rows(conditions, condition_count, table, row_num);
+    const uint64_t start = profile_begin(profile);
+    const int matches = filter_rows(conditions, condition_count, table, row_num);
+    profile_operator(profile, OPERATOR_FILTER, start, matches == 1);
+    return matches;
+}
+
+static void output_row(Table* table, const uint32_t row_num, const SelectStatement* select_statement) {
+    metrics_add(METRIC_ROWS_RETURNED, 1);
+    QueryProfile* profile = current_session->profile;
+    if (profile == NULL) {
+        print_row(table, row_num, select_statement);
+        return;
+    }
+    const uint64_t start = profile_begin(profile);
+    print_row(table, row_num, select_statement);
+    profile_operator(profile, OPERATOR_ROOT, start, 1);
+}
 
 ExecuteResult execute_select(const SelectStatement* select_statement) {
     Table* table = find_table(&global_db, select_statement->table_name);
     const TableSchema* schema = &table->schema;
-    Row row;
-    row.data = malloc(compute_row_size(&table->schema));
-    if (!row.data) return EXECUTE_FAIL;
 
     print_select_header(select_statement, schema);
 
     if (!select_statement->has_condition) {
-
-        for (uint32_t row_index = 0; row_index < table->num_rows; row_index++) {
-            void* row_ptr = row_slot(table, row_index);
-            if (*(uint8_t*)row_ptr) continue;
-            deserialize_row(&table->schema, row_slot(table, row_index), &row);
-            print_row(&table->schema, &row, select_statement);
+        AccessPlan plan;
+        plan_access(table, NULL, 0, 0, &plan);
+        remember_plan(&plan);
+
+        const uint32_t num_rows = __atomic_load_n(&table->num_rows, __ATOMIC_ACQUIRE);
+        for (uint32_t row_index = table_next_row(table, 0); row_index < num_rows; row_index = table_next_row(table, row_index + 1)) {
+            if (!slot_visible(table, row_index)) continue;
+            output_row(table, row_index, select_statement);
         }
-        free(row.data);
         return EXECUTE_SUCCESS;
     }
 
-    if (table->primary_key_index >= 0) {
-        const ExecuteResult result = execute_bpt_search(select_statement, table, row);
-        switch (result) {
-            case EXECUTE_SUCCESS:
-                free(row.data);
-                return EXECUTE_SUCCESS;
-            case EXECUTE_FAIL:
-                free(row.data);
-                return EXECUTE_FAIL;
-        }
+    // the planner orders the conditions of a copy, their values still belong to the statement
+    SelectStatement planned = *select_statement;
+    AccessPlan plan;
+    plan_access(table, planned.conditions, planned.condition_count, index_covers(&planned, table), &plan);
+    remember_plan(&plan);
+    if (plan.path == ACCESS_INDEX) {
+        return execute_bpt_search(&planned, table);
     }
 
-    for (uint32_t row_index = 0; row_index < table->num_rows; row_index++) {
-        void* row_ptr = row_slot(table, row_index);
-        if (*(uint8_t*)row_ptr) continue;
+    // predicates read the columns they name straight from the table, the row is only put together for output
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    const uint32_t num_rows = __atomic_load_n(&table->num_rows, __ATOMIC_ACQUIRE);
+    for (uint32_t row_index = table_next_row(table, 0); row_index < num_rows; row_index = table_next_row(table, row_index + 1)) {
+        if (plan.path == ACCESS_ZONE_MAP_SCAN && row_index % rows_per_page == 0 &&
+            !page_may_match(planned.conditions, planned.condition_count, table, row_index / rows_per_page)) {
+            metrics_add(METRIC_PAGES_SKIPPED, 1);
+            if (current_session->profile != NULL) current_session->profile->pages_skipped++;
+            row_index += rows_per_page - 1;
+            continue;
+        }
+        if (!slot_visible(table, row_index)) continue;
 
-        deserialize_row(&table->schema, row_slot(table, row_index), &row);
-        const int has_conditions = filter_rows(select_statement->conditions, select_statement->condition_count, table, row);
-        if (has_conditions) print_row(&table->schema, &row, select_statement);
+        const int has_conditions = filter_row(planned.conditions, planned.condition_count, table, row_index);
+        if (has_conditions) output_row(table, row_index, &planned);
 
     }
-    free(row.data);
     return EXECUTE_SUCCESS;
 
 }
 
 ExecuteResult execute_create_table(const CreateTableStatement* create_statement) {
-    Table* new_table = malloc(sizeof(Table));
-    if (!new_table) {
-        printf("Error: memory allocation failed.\n");
+    // column tables keep only row headers in their pages, there is nothing worth compressing
+    if (create_statement->compression != COMPRESSION_NONE && create_statement->storage != STORAGE_ROW) {
+        fprintf(current_session->out, "Error: compression needs row storage.\n");
         return EXECUTE_FAIL;
     }
 
-    strncpy(new_table->name, create_statement->table_name, sizeof(new_table->name));
-    new_table->schema.num_columns = create_statement->num_columns;
-    for (int i = 0; i < create_statement->num_columns; i++) {
-        new_table->schema.columns[i] = create_statement->columns[i];
+    Table* table = new_table();
+    if (!table) {
+        fprintf(current_session->out, "Error: memory allocation failed.\n");
+        return EXECUTE_FAIL;
     }
 
-    //TODO don't forget to add free_table function to DROP TABLE statement when you implement it
-    new_table->tree = malloc(sizeof(BPTree));
-    new_table->tree->root = NULL;
+    strncpy(table->name, create_statement->table_name, sizeof(table->name));
+    table->schema.num_columns = create_statement->num_columns;
+    for (int i = 0; i < create_statement->num_columns; i++) {
+        table->schema.columns[i] = create_statement->columns[i];
+    }
 
-    new_table->num_rows = 0;
-    new_table->primary_key_index = (int)create_statement->primary_col_index;
+    table->tree = malloc(sizeof(BPTree));
+    table->tree->root = NULL;
+    table->tree->rightmost = NULL;
+    table->tree->payload_size = 0;
+    table->primary_key_index = (int)create_statement->primary_col_index;
+    table->include_count = create_statement->include_count;
+    for (uint32_t i = 0; i < create_statement->include_count; i++) {
+        table->include_columns[i] = create_statement->include_columns[i];
+    }
+    if (index_payload_size(table) > BPT_MAX_PAYLOAD) {
+        fprintf(current_session->out, "Error: INCLUDE columns take more than %d bytes.\n", BPT_MAX_PAYLOAD);
+        free_table(table);
+        return EXECUTE_FAIL;
+    }
+    table->tree->payload_size = (uint32_t)index_payload_size(table);
+    table->storage = create_statement->storage;
+    table->compression = create_statement->compression;
+    for (int i = 0; i < create_statement->num_columns; i++) {
+        if (table->schema.columns[i].dictionary_encoded) table->dictionaries[i] = new_dictionary();
+    }
 
 
-    if (add_table(&global_db, new_table) != 0) {
-        free(new_table);
+    if (add_table(&global_db, table) != 0) {
+        free_table(table);
         return EXECUTE_FAIL;
     }
 
-    printf("Table %s created with %d columns.\n", new_table->name, new_table->schema.num_columns);
+    fprintf(current_session->out, "Table %s created with %d columns.\n", table->name, table->schema.num_columns);
     return EXECUTE_SUCCESS;
 }
 
 ExecuteResult execute_drop_table(const DropTableStatement* drop_table_statement) {
+    if (current_session->transaction.active) {
+        fprintf(current_session->out, "Error: DROP TABLE is not allowed inside a transaction.\n");
+        return EXECUTE_FAIL;
+    }
     Table* table = find_table(&global_db, drop_table_statement->table_name);
     if (table == NULL) {
-        printf("Table not found.\n");
+        fprintf(current_session->out, "Table not found.\n");
+        return EXECUTE_FAIL;
+    }
+    if (table_in_use(table)) {
+        fprintf(current_session->out, "Error: table is used by an open transaction.\n");
         return EXECUTE_FAIL;
     }
     free_table(table);
@@ -190,54 +468,11 @@ ExecuteResult execute_drop_table(const DropTableStatement* drop_table_statement)
 
 ExecuteResult execute_show_tables() {
     for (uint32_t i = 0; i < global_db.num_tables; i++) {
-        printf("%s\n", global_db.tables[i]->name);
+        fprintf(current_session->out, "%s\n", global_db.tables[i]->name);
     }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_delete(const DeleteStatement* delete_statement) {
-    Table* table = find_table(&global_db, delete_statement->table_name);
-    if (table == NULL) {
-        return EXECUTE_FAIL;
-    }
-
-    Row row;
-    row.data = malloc(compute_row_size(&table->schema));
-    if (!row.data) return EXECUTE_FAIL;
-
-
-
-    for (uint32_t row_index = 0; row_index < table->num_rows; row_index++) {
-        void* row_ptr = row_slot(table, row_index);
-
-        //skips already deleted rows
-        if (*(uint8_t*)row_ptr) continue;
-
-        if (!delete_statement->has_condition) {
-            *(uint8_t*)row_ptr = 1; //deletes all of the rows if there is no condition
-            continue;
-        }
-        deserialize_row(&table->schema, row_slot(table, row_index), &row);
-        const int has_conditions = filter_rows(delete_statement->conditions, delete_statement->condition_count, table, row);
-        switch (has_conditions) {
-            case 1:
-                *(uint8_t*)row_ptr = 1;
-                break;
-            case -1:
-                free(row.data);
-                return EXECUTE_FAIL;
-            default:
-                break;
-        }
-
-    }
-
-    free(row.data);
-    return EXECUTE_SUCCESS;
-}
-
-
-
 const char* find_close_parenthesis(const char* open_parenthesis) {
     /*Function to find the matching closing parenthesis of an open parenthesis*/
     int open_paren_count = 0;
@@ -259,40 +494,32 @@ const char* find_close_parenthesis(const char* open_parenthesis) {
 }
 
 
-void print_row(const TableSchema* schema, const Row* row, const SelectStatement* select_statement) {
+static void print_column(Table* table, const uint32_t row_num, const uint32_t col_index) {
+    const Column* column = &table->schema.columns[col_index];
+    if (column->type == COLUMN_INT) {
+        fprintf(current_session->out, "%d", column_int(table, row_num, (int)col_index));
+    } else if (column->type == COLUMN_VARCHAR) {
+        // stored strings carry their length instead of a terminator
+        const TextValue text = column_text(table, row_num, (int)col_index);
+        print_text(current_session->out, &text);
+    }
+}
+
+void print_row(Table* table, const uint32_t row_num, const SelectStatement* select_statement) {
 
-    printf("(");
+    fprintf(current_session->out, "(");
     if (select_statement->selected_col_count == 0) {
-        for (int i = 0; i < schema->num_columns; i++) {
-            if (i > 0) printf(", ");
-            if (schema->columns[i].type == COLUMN_INT) {
-                int32_t val;
-                memcpy(&val, row->data + get_column_offset(schema, i), sizeof(int32_t));
-                printf("%d", val);
-            } else if (schema->columns[i].type == COLUMN_VARCHAR){
-                char buf[257];
-                memcpy(buf, row->data + get_column_offset(schema, i), 256);
-                buf[256] = '\0';
-                printf("%s", buf);
-            }
+        for (uint32_t i = 0; i < table->schema.num_columns; i++) {
+            if (i > 0) fprintf(current_session->out, ", ");
+            print_column(table, row_num, i);
         }
     } else {
         for (uint32_t i = 0; i < select_statement->selected_col_count; i++) {
-            if (i > 0) printf(", ");
-            const uint32_t index = select_statement->selected_col_indexes[i];
-            if (schema->columns[index].type == COLUMN_INT) {
-                int32_t val;
-                memcpy(&val, row->data + get_column_offset(schema, index), sizeof(int32_t));
-                printf("%d", val);
-            } else if (schema->columns[index].type == COLUMN_VARCHAR){
-                char buf[257];
-                memcpy(buf, row->data + get_column_offset(schema, index), 256);
-                buf[256] = '\0';
-                printf("%s", buf);
-            }
+            if (i > 0) fprintf(current_session->out, ", ");
+            print_column(table, row_num, select_statement->selected_col_indexes[i]);
         }
     }
-    printf(")\n");
+    fprintf(current_session->out, ")\n");
 
 }
 
@@ -305,6 +532,17 @@ void free_statement(const Statement* statement) {
         case STATEMENT_DELETE:
             free_conditions(statement->delete_stmt.condition_count, statement->delete_stmt.conditions);
             break;
+        case STATEMENT_INSERT:
+            free(statement->insert_stmt.row.data);
+            break;
+        case STATEMENT_UPDATE:
+            for (uint32_t i = 0; i < statement->update_stmt.assignment_count; i++) free(statement->update_stmt.assignments[i].value);
+            free_conditions(statement->update_stmt.condition_count, statement->update_stmt.conditions);
+            break;
+        case STATEMENT_EXPLAIN:
+            free_statement(statement->explain_stmt.statement);
+            free(statement->explain_stmt.statement);
+            break;
         default:;
     }
 }
@@ -313,90 +551,207 @@ void free_conditions(const uint32_t condition_count, const Condition* conditions
     for (uint32_t condition_index = 0; condition_index < condition_count; condition_index++) {
         free(conditions[condition_index].value);
         free(conditions[condition_index].column_name);
+        free_in_list(conditions[condition_index].in_list);
+    }
+}
+
+
+void resolve_condition(const Table* table, Condition* condition) {
+    condition->code = DICTIONARY_NO_CODE;
+    condition->dictionary_size = 0;
+    condition->hash = 0;
+    const Column* column = &table->schema.columns[condition->column_index];
+    const char* target = condition->value;
+    if (condition->type == TOKEN_IN) {
+        resolve_in_list(table, (int)condition->column_index, condition->in_list);
+        return;
+    }
+
+    if (column->type == COLUMN_INT) {
+        int ok = 0;
+        const int32_t value = (int32_t)parse_target_value(target, &ok);
+        condition->hash = bloom_hash((const char*)&value, sizeof(value));
+        return;
+    }
+
+    const size_t length = strnlen(target, column->size);
+    condition->hash = bloom_hash(target, length);
+    if (!column->dictionary_encoded) return;
+    condition->code = dictionary_lookup(table->dictionaries[condition->column_index], target,
+                                        (uint32_t)length, &condition->dictionary_size);
+}
+
+static int code_equals(const Condition* condition, Table* table, const uint32_t row_num) {
+    // codes handed out after the condition was prepared may belong to a value it didn't find then
+    const uint16_t code = column_code(table, row_num, (int)condition->column_index);
+    if (condition->code != DICTIONARY_NO_CODE) return code == condition->code;
+    if (code < condition->dictionary_size) return 0;
+
+    const TextValue text = column_text(table, row_num, (int)condition->column_index);
+    const char* target = condition->value;
+    return compare_text(&text, target, strnlen(target, table->schema.columns[condition->column_index].size)) == 0;
+}
+
+static int condition_matches(const TokenType type, const int comparison) {
+    // comparison is the sign of value - target, -1 for an operator the scan doesn't know
+    switch (type) {
+        case TOKEN_EQUAL: return comparison == 0;
+        case TOKEN_GREATER_EQUAL: return comparison >= 0;
+        case TOKEN_GREATER: return comparison > 0;
+        case TOKEN_LESSER_EQUAL: return comparison <= 0;
+        case TOKEN_LESS: return comparison < 0;
+        case TOKEN_NOT_EQUAL: return comparison != 0;
+        default: return -1;
     }
 }
 
+// 1 when the INT value satisfies the condition, 0 when not or the target is no number
+static int int_condition_matches(const Condition* condition, const long value) {
+    int ok = 0;
+    const long target = parse_target_value(condition->value, &ok);
+    if (!ok) return 0;
+    return condition_matches(condition->type, (value > target) - (value < target));
+}
 
-int filter_rows(const Condition* conditions, const uint32_t condition_count, const Table* table, const Row row) {
+static int in_list_matches_row(const Condition* condition, Table* table, const uint32_t row_num) {
+    const InList* list = condition->in_list;
+    const int index = (int)condition->column_index;
+    const Column* column = &table->schema.columns[index];
+    if (column->type == COLUMN_INT) return in_list_contains_int(list, column_int(table, row_num, index));
+    if (column->dictionary_encoded) {
+        const uint16_t code = column_code(table, row_num, index);
+        if (code < list->dictionary_size) return in_list_contains_code(list, code);
+    }
+    const TextValue text = column_text(table, row_num, index);
+    return in_list_contains_text(list, &text);
+}
 
-    int has_conditions = 1;
+static int row_condition_matches(const Condition* condition, Table* table, const uint32_t row_num) {
     const TableSchema* schema = &table->schema;
-    for (uint32_t condition_index = 0; condition_index < condition_count; condition_index++) {
-        if (!has_conditions) continue;
-        const uint32_t index = conditions[condition_index].column_index;
-        if (schema->columns[index].type == COLUMN_INT) {
-            int32_t val;
-            memcpy(&val, row.data + get_column_offset(schema, index), sizeof(int32_t));
-
-            char *endptr;
-            const char* value = conditions[condition_index].value;
-
-            const long int target = strtol(value, &endptr, 10);
-            if (endptr == value || *endptr != '\0') {has_conditions = 0; continue;}
-
-            switch (conditions[condition_index].type) {
-                case TOKEN_EQUAL:
-                    has_conditions = (target == val);
-                    break;
-                case TOKEN_GREATER_EQUAL:
-                    has_conditions = (val >= target);
-                    break;
-                case TOKEN_GREATER:
-                    has_conditions = (val > target);
-                    break;
-                case TOKEN_LESSER_EQUAL:
-                    has_conditions = (val <= target);
-                    break;
-                case TOKEN_LESS:
-                    has_conditions = (val < target);
-                    break;
-                case TOKEN_NOT_EQUAL:
-                    has_conditions = (val != target);
-                    break;
-                default:
-                    return -1;
-            }
+    const uint32_t index = condition->column_index;
+    if (condition->type == TOKEN_IN) return in_list_matches_row(condition, table, row_num);
+    if (schema->columns[index].type == COLUMN_INT) {
+        return int_condition_matches(condition, column_int(table, row_num, (int)index));
+    }
+    if (schema->columns[index].dictionary_encoded && (condition->type == TOKEN_EQUAL || condition->type == TOKEN_NOT_EQUAL)) {
+        const int equal = code_equals(condition, table, row_num);
+        return condition->type == TOKEN_EQUAL ? equal : !equal;
+    }
+    // like strncmp over the declared size, spilled values only read their overflow chain past an equal prefix
+    const TextValue text = column_text(table, row_num, (int)index);
+    const int result = compare_text(&text, condition->value, strnlen(condition->value, schema->columns[index].size));
+    return condition_matches(condition->type, (result > 0) - (result < 0));
+}
 
+int filter_rows(const Condition* conditions, const uint32_t condition_count, Table* table, const uint32_t row_num) {
+    // a row matches when every condition of one of the groups does
+    if (condition_count == 0) return 1;
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        int matches = 1;
+        const uint32_t end = group_end(conditions, condition_count, first);
+        for (uint32_t condition_index = first; condition_index < end && matches == 1; condition_index++) {
+            matches = row_condition_matches(&conditions[condition_index], table, row_num);
         }
-        else if (schema->columns[index].type == COLUMN_VARCHAR) {
-            char buf[257];
-            memcpy(buf, row.data + get_column_offset(schema, index), 256);
-            const int result = strcmp(buf, conditions[condition_index].value) != 0;
-
-            switch (conditions[condition_index].type) {
-                case TOKEN_EQUAL:
-                    has_conditions = (result == 0);
-                    break;
-                case TOKEN_GREATER_EQUAL:
-                    has_conditions = (result >= 0);
-                    break;
-                case TOKEN_GREATER:
-                    has_conditions = (result > 0);
-                    break;
-                case TOKEN_LESSER_EQUAL:
-                    has_conditions = (result <= 0);
-                    break;
-                case TOKEN_LESS:
-                    has_conditions = (result < 0);
-                    break;
-                default:
-                    return -1;
-            }
+        if (matches != 0) return matches;
+    }
+    return 0;
+}
 
-        }
+
+static int int_range_may_match(const TokenType type, const long target, const int32_t min, const int32_t max) {
+    switch (type) {
+        case TOKEN_EQUAL: return target >= min && target <= max;
+        case TOKEN_GREATER: return max > target;
+        case TOKEN_GREATER_EQUAL: return max >= target;
+        case TOKEN_LESS: return min < target;
+        case TOKEN_LESSER_EQUAL: return min <= target;
+        case TOKEN_NOT_EQUAL: return min != target || max != target;
+        default: return 1;
     }
+}
 
-    return has_conditions;
+static int prefix_range_may_match(const TokenType type, const uint64_t target, const uint64_t min, const uint64_t max) {
+    // equal prefixes say nothing about the rest of the string, so only strict prefix orderings rule a page out
+    switch (type) {
+        case TOKEN_EQUAL: return target >= min && target <= max;
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL: return max >= target;
+        case TOKEN_LESS:
+        case TOKEN_LESSER_EQUAL: return min <= target;
+        default: return 1;
+    }
 }
 
+static int value_may_match_page(const Table* table, const ZoneMap* zone_map, const uint32_t page_num,
+                                const uint32_t col_index, const TokenType type, const char* value, const uint64_t hash) {
+    const Column* column = &table->schema.columns[col_index];
+    const ColumnZone* zone = &zone_map->columns[col_index];
+
+    if (column->type == COLUMN_INT) {
+        int ok = 0;
+        const long target = parse_target_value(value, &ok);
+        if (!ok) return 1;
+        if (!int_range_may_match(type, target, __atomic_load_n(&zone->min_int, __ATOMIC_RELAXED),
+                                 __atomic_load_n(&zone->max_int, __ATOMIC_RELAXED))) return 0;
+    } else if (column->type == COLUMN_VARCHAR) {
+        const uint64_t target = text_prefix(value, column->size);
+        if (!prefix_range_may_match(type, target, __atomic_load_n(&zone->min_prefix, __ATOMIC_RELAXED),
+                                    __atomic_load_n(&zone->max_prefix, __ATOMIC_RELAXED))) return 0;
+    }
+    return type != TOKEN_EQUAL || !column->bloom_filter || page_may_contain(table, page_num, (int)col_index, hash);
+}
 
-uint32_t get_primary_condition_index(const SelectStatement* select_statement, const Table* table) {
-    for (uint32_t i = 0; i < select_statement->condition_count; i++) {
-        if (select_statement->conditions[i].column_index == table->primary_key_index) {
-            return i;
+static int condition_may_match_page(const Condition* condition, const Table* table, const ZoneMap* zone_map,
+                                    const uint32_t page_num) {
+    if (condition->type != TOKEN_IN) {
+        return value_may_match_page(table, zone_map, page_num, condition->column_index, condition->type,
+                                    condition->value, condition->hash);
+    }
+    const InList* list = condition->in_list;
+    for (uint32_t i = 0; i < list->count; i++) {
+        if (value_may_match_page(table, zone_map, page_num, condition->column_index, TOKEN_EQUAL, list->values[i],
+                                 list->hashes[i])) return 1;
+    }
+    return 0;
+}
+
+int page_may_match(const Condition* conditions, const uint32_t condition_count, const Table* table, const uint32_t page_num) {
+    const ZoneMap* zone_map = table->zone_maps[page_num];
+    if (zone_map == NULL || __atomic_load_n(&zone_map->row_count, __ATOMIC_ACQUIRE) == 0) return 0;
+    if (condition_count == 0) return 1;
+
+    // the page is skipped when no group can match on it
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        int may_match = 1;
+        const uint32_t end = group_end(conditions, condition_count, first);
+        for (uint32_t condition_index = first; condition_index < end && may_match; condition_index++) {
+            may_match = condition_may_match_page(&conditions[condition_index], table, zone_map, page_num);
         }
+        if (may_match) return 1;
     }
-    return -1;
+    return 0;
+}
+
+uint32_t get_primary_condition_index(const SelectStatement* select_statement, const Table* table) {
+    return usable_condition_in_group(select_statement->conditions, 0, select_statement->condition_count, table);
+}
+
+// the largest key the =, < and <= conditions of a group allow on the primary key, 0 when they don't bound it
+static int group_upper_bound(const Condition* conditions, const uint32_t first, const uint32_t end, const Table* table,
+                             long* last) {
+    int bounded = 0;
+    for (uint32_t i = first; i < end; i++) {
+        const Condition* condition = &conditions[i];
+        if (condition->column_index != table->primary_key_index) continue;
+        if (condition->type != TOKEN_EQUAL && condition->type != TOKEN_LESS && condition->type != TOKEN_LESSER_EQUAL) continue;
+        int ok = 0;
+        long bound = parse_target_value(condition->value, &ok);
+        if (!ok) continue;
+        if (condition->type == TOKEN_LESS) bound--;
+        if (!bounded || bound < *last) *last = bound;
+        bounded = 1;
+    }
+    return bounded;
 }
 
 long parse_target_value(const char* value, int* ok) {
@@ -406,63 +761,305 @@ long parse_target_value(const char* value, int* ok) {
     return result;
 }
 
-void print_matching_row(const TableSchema* schema, const SelectStatement* stmt, const Table* table, const Row* row, void* row_ptr) {
-    if (row_ptr == NULL || *(uint8_t*)row_ptr) return;
-    deserialize_row(schema, row_ptr, row);
-    if (filter_rows(stmt->conditions, stmt->condition_count, table, *row)) {
-        print_row(schema, row, stmt);
+void print_matching_row(const SelectStatement* stmt, Table* table, const uint32_t row_num) {
+    if (!slot_visible(table, row_num)) return;
+    if (filter_row(stmt->conditions, stmt->condition_count, table, row_num)) {
+        output_row(table, row_num, stmt);
     }
 }
 
-ExecuteResult process_equal_condition(const SelectStatement* stmt, const Table* table, const Row* row, const long target) {
-    void* row_ptr = bpt_search_equals(table->tree->root, target);
-    if (row_ptr == NULL || *(uint8_t*)row_ptr) return EXECUTE_FAIL;
+static int column_in_index(const Table* table, const int col_index) {
+    return col_index == table->primary_key_index || index_payload_offset(table, col_index) >= 0;
+}
 
-    const TableSchema* schema = &table->schema;
-    print_matching_row(schema, stmt, table, row, row_ptr);
+int index_covers(const SelectStatement* select_statement, const Table* table) {
+    // every column the statement projects or filters on is the key or is included in the leaves
+    if (select_statement->selected_col_count == 0) {
+        for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+            if (!column_in_index(table, col_index)) return 0;
+        }
+    }
+    for (uint32_t i = 0; i < select_statement->selected_col_count; i++) {
+        if (!column_in_index(table, (int)select_statement->selected_col_indexes[i])) return 0;
+    }
+    for (uint32_t i = 0; i < select_statement->condition_count; i++) {
+        if (!column_in_index(table, (int)select_statement->conditions[i].column_index)) return 0;
+    }
+    return 1;
+}
+
+static int32_t entry_int(const Table* table, const uint32_t key, const uint8_t* payload, const int col_index) {
+    if (col_index == table->primary_key_index) return (int32_t)key;
+    int32_t value;
+    memcpy(&value, payload + index_payload_offset(table, col_index), sizeof(int32_t));
+    return value;
+}
+
+static TextValue entry_text(const Table* table, const uint8_t* payload, const int col_index) {
+    // payloads hold VARCHARs at their declared width like a Row does
+    const char* text = (const char*)payload + index_payload_offset(table, col_index);
+    return inline_text(text, (uint32_t)strnlen(text, table->schema.columns[col_index].size));
+}
+
+static void print_entry_column(const Table* table, const uint32_t key, const uint8_t* payload, const int col_index) {
+    if (table->schema.columns[col_index].type == COLUMN_INT) {
+        fprintf(current_session->out, "%d", entry_int(table, key, payload, col_index));
+    } else {
+        const TextValue text = entry_text(table, payload, col_index);
+        print_text(current_session->out, &text);
+    }
+}
+
+// the index only answers statements without OR, the conditions are a single group
+static int filter_entry(const Condition* conditions, const uint32_t condition_count, const Table* table,
+                        const uint32_t key, const uint8_t* payload) {
+    for (uint32_t condition_index = 0; condition_index < condition_count; condition_index++) {
+        const Condition* condition = &conditions[condition_index];
+        const int col_index = (int)condition->column_index;
+        int matches;
+        if (condition->type == TOKEN_IN && table->schema.columns[col_index].type == COLUMN_INT) {
+            matches = in_list_contains_int(condition->in_list, entry_int(table, key, payload, col_index));
+        } else if (condition->type == TOKEN_IN) {
+            const TextValue text = entry_text(table, payload, col_index);
+            matches = in_list_contains_text(condition->in_list, &text);
+        } else if (table->schema.columns[col_index].type == COLUMN_INT) {
+            matches = int_condition_matches(condition, entry_int(table, key, payload, col_index));
+        } else {
+            const TextValue text = entry_text(table, payload, col_index);
+            const int result = compare_text(&text, condition->value, strnlen(condition->value, table->schema.columns[col_index].size));
+            matches = condition_matches(condition->type, (result > 0) - (result < 0));
+        }
+        if (matches != 1) return matches;
+    }
+    return 1;
+}
+
+static void print_covered_entry(const SelectStatement* stmt, Table* table, const uint32_t key, const uint32_t row_num,
+                                const uint8_t* payload) {
+    // rows on all-visible pages need no visibility check, the others still read their row header
+    const uint32_t page_num = row_num / table_rows_per_page(table);
+    QueryProfile* profile = current_session->profile;
+    if (__atomic_load_n(&table->all_visible[page_num], __ATOMIC_ACQUIRE)) {
+        metrics_add(METRIC_ROWS_SCANNED, 1);
+        if (profile != NULL) profile_row(profile, 1);
+    } else if (!slot_visible(table, row_num)) {
+        return;
+    }
+
+    uint64_t start = profile != NULL ? profile_begin(profile) : 0;
+    const int matches = filter_entry(stmt->conditions, stmt->condition_count, table, key, payload);
+    if (profile != NULL) profile_operator(profile, OPERATOR_FILTER, start, matches == 1);
+    if (matches != 1) return;
+
+    metrics_add(METRIC_ROWS_RETURNED, 1);
+    if (profile != NULL) start = profile_begin(profile);
+    fprintf(current_session->out, "(");
+    if (stmt->selected_col_count == 0) {
+        for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+            if (col_index > 0) fprintf(current_session->out, ", ");
+            print_entry_column(table, key, payload, col_index);
+        }
+    }
+    for (uint32_t i = 0; i < stmt->selected_col_count; i++) {
+        if (i > 0) fprintf(current_session->out, ", ");
+        print_entry_column(table, key, payload, (int)stmt->selected_col_indexes[i]);
+    }
+    fprintf(current_session->out, ")\n");
+    if (profile != NULL) profile_operator(profile, OPERATOR_ROOT, start, 1);
+}
+
+static void print_index_entry(const SelectStatement* stmt, Table* table, const BPTCursor* cursor, const uint32_t key,
+                              const uint32_t row_num, const int covered) {
+    if (covered) print_covered_entry(stmt, table, key, row_num, bpt_cursor_payload(cursor));
+    else print_matching_row(stmt, table, row_num);
+}
+
+// prints the entries of the key a cursor was sought to, 0 when the index doesn't hold the key
+static int print_key_entries(const SelectStatement* stmt, Table* table, BPTCursor* cursor, const long target,
+                             const int covered) {
+    uint32_t key;
+    uint32_t row_num;
+    if (!bpt_cursor_next(cursor, &key, &row_num) || key != target) return 0;
+
+    // every version of the key is indexed until the cleaner reclaims it, the snapshot picks the visible one
+    do {
+        print_index_entry(stmt, table, cursor, key, row_num, covered);
+    } while (bpt_cursor_next(cursor, &key, &row_num) && key == target);
+    return 1;
+}
+
+ExecuteResult process_equal_condition(const SelectStatement* stmt, Table* table, const long target, const int covered) {
+    BPTCursor cursor;
+    bpt_cursor_seek(&cursor, table->tree, target);
+    print_key_entries(stmt, table, &cursor, target, covered);
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult process_greater_condition(const SelectStatement* stmt, const Table* table, const Row* row, const long target, const int inclusive) {
-    const TableSchema* schema = &table->schema;
-    const BPTreeNode* node = bpt_search_greater_equal(table->tree->root, target);
-    if (node == NULL) return EXECUTE_FAIL;
+ExecuteResult process_greater_condition(const SelectStatement* stmt, Table* table, const long target, const int inclusive,
+                                        const int covered) {
+    BPTCursor cursor;
+    bpt_cursor_seek(&cursor, table->tree, inclusive ? target : target + 1);
+
+    uint32_t key;
+    uint32_t row_num;
+    if (!bpt_cursor_next(&cursor, &key, &row_num)) return EXECUTE_SUCCESS;
+
+    // the leaf chain is walked up to the bound a < or <= on the key sets, not to its end
+    long last = 0;
+    const int bounded = group_upper_bound(stmt->conditions, 0, stmt->condition_count, table, &last);
+    while (!bounded || key <= last) {
+        print_index_entry(stmt, table, &cursor, key, row_num, covered);
+        if (!bpt_cursor_next(&cursor, &key, &row_num)) break;
+    }
+    return EXECUTE_SUCCESS;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    const int32_t left = *(const int32_t*)a;
+    const int32_t right = *(const int32_t*)b;
+    return (left > right) - (left < right);
+}
+
+// sorted unique keys of an IN list on the primary key, the caller frees them
+static int32_t* sorted_keys(const InList* list, uint32_t* count) {
+    int32_t* keys = malloc((list->count > 0 ? list->count : 1) * sizeof(int32_t));
+    if (!keys) {
+        perror("malloc failed");
+        exit(1);
+    }
+    memcpy(keys, list->numbers, list->count * sizeof(int32_t));
+    qsort(keys, list->count, sizeof(int32_t), compare_keys);
+
+    *count = 0;
+    for (uint32_t i = 0; i < list->count; i++) {
+        if (*count == 0 || keys[*count - 1] != keys[i]) keys[(*count)++] = keys[i];
+    }
+    return keys;
+}
+
+// IN lists probe the index IN_PROBE_BATCH sorted keys at a time with one batched seek
+#define IN_PROBE_BATCH 64
+
+ExecuteResult process_in_condition(const SelectStatement* stmt, Table* table, const InList* list, const int covered) {
+    uint32_t count;
+    int32_t* keys = sorted_keys(list, &count);
+    BPTCursor cursors[IN_PROBE_BATCH];
+    long targets[IN_PROBE_BATCH];
+    for (uint32_t first = 0; first < count; first += IN_PROBE_BATCH) {
+        const uint32_t batch = count - first < IN_PROBE_BATCH ? count - first : IN_PROBE_BATCH;
+        for (uint32_t i = 0; i < batch; i++) targets[i] = keys[first + i];
+        bpt_cursor_seek_batch(cursors, table->tree, targets, (int)batch);
+        for (uint32_t i = 0; i < batch; i++) print_key_entries(stmt, table, &cursors[i], targets[i], covered);
+    }
+    free(keys);
+    return EXECUTE_SUCCESS;
+}
 
-    int found_index = -1;
-    for (int i = 0; i < node->num_keys; i++) {
-        if (node->keys[i] == target) { found_index = i; break; }
+typedef struct {
+    uint32_t* rows;
+    uint32_t count;
+    uint32_t capacity;
+} RowSet;
+
+static void row_set_add(RowSet* set, const uint32_t row_num) {
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 64;
+        set->rows = realloc(set->rows, set->capacity * sizeof(uint32_t));
+        if (!set->rows) {
+            perror("realloc failed");
+            exit(1);
+        }
     }
+    set->rows[set->count++] = row_num;
+}
+
+// adds the row of every entry left in a sought cursor, up to the last key when bounded
+static void collect_cursor_rows(RowSet* set, BPTCursor* cursor, const int bounded, const long last) {
+    uint32_t key;
+    uint32_t row_num;
+    while (bpt_cursor_next(cursor, &key, &row_num) && (!bounded || key <= last)) row_set_add(set, row_num);
+}
 
-    if (found_index == -1 && inclusive) return EXECUTE_FAIL;
-    int index = (found_index == -1) ? 0 : found_index;
+static void collect_index_range(RowSet* set, const Table* table, const long first, const int bounded, const long last) {
+    BPTCursor cursor;
+    bpt_cursor_seek(&cursor, table->tree, first);
+    collect_cursor_rows(set, &cursor, bounded, last);
+}
 
-    for (; node != NULL; node = node->next) {
-        for (; index < node->num_keys; index++) {
-            print_matching_row(schema, stmt, table, row, node->pointers[index]);
+// adds the rows the index holds for the usable condition of a group, a range stops at the group's upper bound
+static void collect_index_rows(RowSet* set, const Table* table, const Condition* conditions, const uint32_t first,
+                               const uint32_t end) {
+    const Condition* condition = &conditions[usable_condition_in_group(conditions, first, end, table)];
+    if (condition->type == TOKEN_IN) {
+        uint32_t count;
+        int32_t* keys = sorted_keys(condition->in_list, &count);
+        BPTCursor cursors[IN_PROBE_BATCH];
+        long targets[IN_PROBE_BATCH];
+        for (uint32_t first = 0; first < count; first += IN_PROBE_BATCH) {
+            const uint32_t batch = count - first < IN_PROBE_BATCH ? count - first : IN_PROBE_BATCH;
+            for (uint32_t i = 0; i < batch; i++) targets[i] = keys[first + i];
+            bpt_cursor_seek_batch(cursors, table->tree, targets, (int)batch);
+            for (uint32_t i = 0; i < batch; i++) collect_cursor_rows(set, &cursors[i], 1, targets[i]);
         }
-        index = 0;
+        free(keys);
+        return;
     }
+
+    int ok = 0;
+    const long target = parse_target_value(condition->value, &ok);
+    if (!ok) return;
+    long last = 0;
+    const int bounded = group_upper_bound(conditions, first, end, table, &last);
+    collect_index_range(set, table, condition->type == TOKEN_GREATER ? target + 1 : target, bounded, last);
+}
+
+static int compare_rows(const void* a, const void* b) {
+    const uint32_t left = *(const uint32_t*)a;
+    const uint32_t right = *(const uint32_t*)b;
+    return (left > right) - (left < right);
+}
+
+ExecuteResult execute_index_union(const SelectStatement* stmt, Table* table) {
+    // every group probes the index for its own condition, a row found by several groups is printed once
+    RowSet set = {0};
+    const Condition* conditions = stmt->conditions;
+    for (uint32_t first = 0; first < stmt->condition_count; first = group_end(conditions, stmt->condition_count, first)) {
+        collect_index_rows(&set, table, conditions, first, group_end(conditions, stmt->condition_count, first));
+    }
+
+    if (set.count > 1) qsort(set.rows, set.count, sizeof(uint32_t), compare_rows);
+    for (uint32_t i = 0; i < set.count; i++) {
+        if (i > 0 && set.rows[i] == set.rows[i - 1]) continue;
+        print_matching_row(stmt, table, set.rows[i]);
+    }
+    free(set.rows);
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_bpt_search(const SelectStatement* select_statement, const Table* table, const Row row) {
-    const Row mutable_row = row;
+ExecuteResult execute_bpt_search(const SelectStatement* select_statement, Table* table) {
+    if (select_statement->conditions[select_statement->condition_count - 1].group > 0) {
+        return execute_index_union(select_statement, table);
+    }
 
     const uint32_t cond_index = get_primary_condition_index(select_statement, table);
     if (cond_index == -1) return EXECUTE_FAIL;
 
     const TokenType type = select_statement->conditions[cond_index].type;
 
+    // an index-only scan answers from the leaves when they hold every column the statement needs
+    const int covered = index_covers(select_statement, table);
+    if (type == TOKEN_IN) return process_in_condition(select_statement, table, select_statement->conditions[cond_index].in_list, covered);
+
     int ok = 0;
     const long target = parse_target_value(select_statement->conditions[cond_index].value, &ok);
     if (!ok) return EXECUTE_FAIL;
 
     switch (type) {
         case TOKEN_EQUAL:
-            return process_equal_condition(select_statement, table, &mutable_row, target);
+            return process_equal_condition(select_statement, table, target, covered);
         case TOKEN_GREATER:
         case TOKEN_GREATER_EQUAL:
-            return process_greater_condition(select_statement, table, &mutable_row, target, type == TOKEN_GREATER_EQUAL);
+            return process_greater_condition(select_statement, table, target, type == TOKEN_GREATER_EQUAL, covered);
         default:
             return EXECUTE_SUCCESS;
     }
@@ -471,22 +1068,207 @@ ExecuteResult execute_bpt_search(const SelectStatement* select_statement, const
 void print_select_header(const SelectStatement* select_statement, const TableSchema* schema) {
 
     if (select_statement->selected_col_count == 0) {
-        printf("COLUMNS:\n");
-        printf("(");
+        fprintf(current_session->out, "COLUMNS:\n");
+        fprintf(current_session->out, "(");
         for (int column_index = 0; column_index < schema->num_columns; column_index++) {
-            if (column_index > 0) printf(", ");
-            printf("%s", schema->columns[column_index].name);
+            if (column_index > 0) fprintf(current_session->out, ", ");
+            fprintf(current_session->out, "%s", schema->columns[column_index].name);
         }
-        printf(")\n\n");
+        fprintf(current_session->out, ")\n\n");
     } else {
-        printf("COLUMNS:\n");
-        printf("(");
+        fprintf(current_session->out, "COLUMNS:\n");
+        fprintf(current_session->out, "(");
         for (uint32_t i = 0; i < select_statement->selected_col_count; i++) {
-            if (i > 0) printf(", ");
+            if (i > 0) fprintf(current_session->out, ", ");
             const uint32_t index = select_statement->selected_col_indexes[i];
-            printf("%s", schema->columns[index].name);
+            fprintf(current_session->out, "%s", schema->columns[index].name);
         }
-        printf(")\n\n");
+        fprintf(current_session->out, ")\n\n");
     }
 
-}
\ No newline at end of file
+}
+
+// the visible versions matching the conditions in row order, -1 when a condition can't be evaluated
+static int collect_matching_rows(RowSet* matches, Table* table, const Condition* statement_conditions,
+                                 const uint32_t condition_count) {
+    Condition conditions[MAX_COLUMNS];
+    memcpy(conditions, statement_conditions, condition_count * sizeof(Condition));
+    AccessPlan plan;
+    plan_access(table, conditions, condition_count, 0, &plan);
+    remember_plan(&plan);
+
+    if (plan.path != ACCESS_INDEX) {
+        const uint32_t rows_per_page = table_rows_per_page(table);
+        for (uint32_t row_index = table_next_row(table, 0); row_index < table->num_rows; row_index = table_next_row(table, row_index + 1)) {
+            if (plan.path == ACCESS_ZONE_MAP_SCAN && row_index % rows_per_page == 0 &&
+                !page_may_match(conditions, condition_count, table, row_index / rows_per_page)) {
+                metrics_add(METRIC_PAGES_SKIPPED, 1);
+                if (current_session->profile != NULL) current_session->profile->pages_skipped++;
+                row_index += rows_per_page - 1;
+                continue;
+            }
+            if (!slot_visible(table, row_index)) continue;
+            const int matches_row = filter_row(conditions, condition_count, table, row_index);
+            if (matches_row < 0) return -1;
+            if (matches_row) row_set_add(matches, row_index);
+        }
+        return 0;
+    }
+
+    RowSet candidates = {0};
+    for (uint32_t first = 0; first < condition_count; first = group_end(conditions, condition_count, first)) {
+        collect_index_rows(&candidates, table, conditions, first, group_end(conditions, condition_count, first));
+    }
+    if (candidates.count > 1) qsort(candidates.rows, candidates.count, sizeof(uint32_t), compare_rows);
+
+    int result = 0;
+    for (uint32_t i = 0; i < candidates.count && result == 0; i++) {
+        const uint32_t row_num = candidates.rows[i];
+        if (i > 0 && row_num == candidates.rows[i - 1]) continue;
+        if (!slot_visible(table, row_num)) continue;
+        const int matches_row = filter_row(conditions, condition_count, table, row_num);
+        if (matches_row < 0) result = -1;
+        else if (matches_row) row_set_add(matches, row_num);
+    }
+    free(candidates.rows);
+    return result;
+}
+
+static void apply_assignments(const UpdateStatement* update_statement, Table* table, const Row* before, const Row* after) {
+    // every value is computed from the row as it was, so SET a = b, b = a swaps them
+    const TableSchema* schema = &table->schema;
+    for (uint32_t i = 0; i < update_statement->assignment_count; i++) {
+        const Assignment* assignment = &update_statement->assignments[i];
+        const int col_index = (int)assignment->column_index;
+        if (schema->columns[col_index].type == COLUMN_INT) {
+            int32_t value;
+            if (assignment->source_index >= 0) {
+                int32_t source;
+                memcpy(&source, before->data + get_column_offset(schema, assignment->source_index), sizeof(int32_t));
+                value = (int32_t)((int64_t)source + assignment->delta);
+            } else {
+                value = (int32_t)strtol(assignment->value, NULL, 10);
+            }
+            set_int_value(schema, after, col_index, value);
+            continue;
+        }
+        char* field = (char*)after->data + get_column_offset(schema, col_index);
+        memset(field, 0, schema->columns[col_index].size);
+        memcpy(field, assignment->value, strlen(assignment->value));
+    }
+}
+
+static int column_changed(const TableSchema* schema, const Row* before, const Row* after, const int col_index) {
+    const size_t offset = get_column_offset(schema, col_index);
+    return memcmp(before->data + offset, after->data + offset, column_width(&schema->columns[col_index])) != 0;
+}
+
+static int updates_in_place(Table* table, const uint32_t row_num, const Row* before, const Row* after) {
+    // a committed version may still be read by older snapshots, only one this transaction wrote itself is
+    // invisible to everyone else. its changed columns also have to fit the fixed-width fields it already has
+    if (row_begin_ts(row_slot(table, row_num)) != (TS_TXN_BIT | current_session->transaction.snapshot.txn_id)) return 0;
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (!column_changed(&table->schema, before, after, col_index)) continue;
+        const Column* column = &table->schema.columns[col_index];
+        if (col_index == table->primary_key_index) return 0;
+        if (column->type != COLUMN_INT && !column->dictionary_encoded) return 0;
+    }
+    return 1;
+}
+
+static void update_fields(Table* table, const uint32_t row_num, const Row* before, const Row* after) {
+    // the index entry stays where it is, its payload is rewritten only when an INCLUDE column changed
+    int payload_changed = 0;
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (!column_changed(&table->schema, before, after, col_index)) continue;
+        const uint32_t old_value = write_field(table, row_num, col_index, field_value(table, after, col_index));
+        log_update(&current_session->transaction, table, row_num, col_index, old_value);
+        if (index_payload_offset(table, col_index) >= 0) payload_changed = 1;
+    }
+    zone_map_add(table, row_num);
+    if (payload_changed) update_index_payload(table, row_num);
+}
+
+static ExecuteResult update_row(Table* table, const uint32_t row_num, const Row* before, const Row* after) {
+    if (encode_or_fail(table, after) != EXECUTE_SUCCESS) return EXECUTE_FAIL;
+    if (updates_in_place(table, row_num, before, after)) {
+        update_fields(table, row_num, before, after);
+        return EXECUTE_SUCCESS;
+    }
+
+    // everyone else keeps reading the old version until we commit, the new one is indexed under its own row number
+    if (delete_version(&current_session->transaction, table, row_slot_for_write(table, row_num)) != WRITE_SUCCESS) {
+        fprintf(current_session->out, "Error: row was changed by a concurrent transaction.\n");
+        return EXECUTE_FAIL;
+    }
+    return insert_version(table, after) == 0 ? EXECUTE_SUCCESS : EXECUTE_TABLE_FULL;
+}
+
+ExecuteResult execute_update(const UpdateStatement* update_statement) {
+    Table* table = find_table(&global_db, update_statement->table_name);
+    if (table == NULL) return EXECUTE_FAIL;
+
+    // the rows are found before any is written, so a version the statement writes is never updated again
+    RowSet matches = {0};
+    if (collect_matching_rows(&matches, table, update_statement->conditions, update_statement->condition_count) != 0) {
+        free(matches.rows);
+        return EXECUTE_FAIL;
+    }
+
+    Row* before = create_row(&table->schema);
+    Row* after = create_row(&table->schema);
+    const size_t row_size = compute_row_size(&table->schema);
+    ExecuteResult result = EXECUTE_SUCCESS;
+    QueryProfile* profile = current_session->profile;
+    for (uint32_t i = 0; i < matches.count && result == EXECUTE_SUCCESS; i++) {
+        const uint64_t start = profile != NULL ? profile_begin(profile) : 0;
+        deserialize_row(table, matches.rows[i], before);
+        memcpy(after->data, before->data, row_size);
+        apply_assignments(update_statement, table, before, after);
+        // a row the assignments leave as it was gets no new version
+        const int changed = memcmp(before->data, after->data, row_size) != 0;
+        if (changed) result = update_row(table, matches.rows[i], before, after);
+        if (changed && result == EXECUTE_SUCCESS) metrics_add(METRIC_ROWS_UPDATED, 1);
+        if (profile != NULL) profile_operator(profile, OPERATOR_ROOT, start, changed);
+    }
+
+    free(before->data);
+    free(before);
+    free(after->data);
+    free(after);
+    free(matches.rows);
+    return result;
+}
+
+ExecuteResult execute_delete(const DeleteStatement* delete_statement) {
+    Table* table = find_table(&global_db, delete_statement->table_name);
+    if (table == NULL) {
+        return EXECUTE_FAIL;
+    }
+
+    // deletes all of the rows if there is no condition, a primary key condition finds them through the index.
+    // the index entries stay until the cleaner reclaims the versions, older snapshots still look them up
+    RowSet matches = {0};
+    const uint32_t condition_count = delete_statement->has_condition ? delete_statement->condition_count : 0;
+    if (collect_matching_rows(&matches, table, delete_statement->conditions, condition_count) != 0) {
+        free(matches.rows);
+        return EXECUTE_FAIL;
+    }
+
+    ExecuteResult result = EXECUTE_SUCCESS;
+    QueryProfile* profile = current_session->profile;
+    for (uint32_t i = 0; i < matches.count; i++) {
+        const uint64_t start = profile != NULL ? profile_begin(profile) : 0;
+        // the delete stamps the version in place, a compressed page is thawed for it
+        void* row_ptr = row_slot_for_write(table, matches.rows[i]);
+        if (delete_version(&current_session->transaction, table, row_ptr) != WRITE_SUCCESS) {
+            fprintf(current_session->out, "Error: row was changed by a concurrent transaction.\n");
+            result = EXECUTE_FAIL;
+            break;
+        }
+        metrics_add(METRIC_ROWS_DELETED, 1);
+        if (profile != NULL) profile_operator(profile, OPERATOR_ROOT, start, 1);
+    }
+    free(matches.rows);
+    return result;
+}
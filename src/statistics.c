@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "statistics.h"
+
+// share of a page's rows a Bloom filter wrongly lets through, about what BLOOM_BITS_PER_VALUE gives
+#define BLOOM_FALSE_POSITIVE_RATE 0.01
+
+uint64_t int_sort_key(const int32_t value) {
+    // flipping the sign bit orders negative numbers before positive ones as unsigned keys
+    return (uint32_t)value ^ 0x80000000u;
+}
+
+static uint64_t row_sort_key(Table* table, const uint32_t row_num, const int col_index) {
+    if (table->schema.columns[col_index].type == COLUMN_INT) return int_sort_key(column_int(table, row_num, col_index));
+    const TextValue text = column_text(table, row_num, col_index);
+    return text_prefix(text.bytes, text.inline_length);
+}
+
+static uint64_t zone_sort_key(const Column* column, const ColumnZone* zone, const int max) {
+    if (column->type == COLUMN_INT) return int_sort_key(max ? zone->max_int : zone->min_int);
+    return max ? zone->max_prefix : zone->min_prefix;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    const uint64_t left = *(const uint64_t*)a;
+    const uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+static uint32_t count_distinct(uint64_t* values, const uint32_t count) {
+    qsort(values, count, sizeof(uint64_t), compare_keys);
+    uint32_t distinct = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0 || values[i] != values[i - 1]) distinct++;
+    }
+    return distinct;
+}
+
+static void analyze_column(Table* table, const uint32_t* rows, const uint32_t count, uint64_t* keys, const int col_index,
+                           ColumnStats* stats) {
+    const Column* column = &table->schema.columns[col_index];
+    if (count == 0) return;
+
+    // prefixes of long strings collide, so strings are told apart by a hash of the whole value
+    if (column->type == COLUMN_VARCHAR) {
+        for (uint32_t i = 0; i < count; i++) {
+            const TextValue text = column_text(table, rows[i], col_index);
+            keys[i] = bloom_hash_text(&text);
+        }
+        stats->distinct = count_distinct(keys, count);
+    }
+    for (uint32_t i = 0; i < count; i++) keys[i] = row_sort_key(table, rows[i], col_index);
+    const uint32_t distinct_keys = count_distinct(keys, count);
+    if (column->type == COLUMN_INT) stats->distinct = distinct_keys;
+
+    stats->min_key = keys[0];
+    stats->max_key = keys[count - 1];
+    stats->bucket_count = count < STATS_BUCKETS ? count : STATS_BUCKETS;
+    for (uint32_t bucket = 0; bucket < stats->bucket_count; bucket++) {
+        stats->bounds[bucket] = keys[(uint64_t)(bucket + 1) * count / stats->bucket_count - 1];
+    }
+
+    // the zone maps also cover dead versions, which is what a scan reads too
+    stats->page_span = 1.0;
+    if (stats->max_key == stats->min_key) return;
+    double span = 0;
+    uint32_t pages = 0;
+    for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) {
+        const ZoneMap* zone_map = table->zone_maps[page_num];
+        if (zone_map == NULL || zone_map->row_count == 0) continue;
+        const uint64_t low = zone_sort_key(column, &zone_map->columns[col_index], 0);
+        const uint64_t high = zone_sort_key(column, &zone_map->columns[col_index], 1);
+        span += high > low ? (double)(high - low) / (double)(stats->max_key - stats->min_key) : 0;
+        pages++;
+    }
+    if (pages > 0) stats->page_span = fmin(1.0, span / pages);
+}
+
+TableStats* analyze_table(Table* table, const Snapshot* snapshot) {
+    TableStats* stats = calloc(1, sizeof(TableStats));
+    uint32_t* rows = malloc((table->num_rows > 0 ? table->num_rows : 1) * sizeof(uint32_t));
+    uint64_t* keys = malloc((table->num_rows > 0 ? table->num_rows : 1) * sizeof(uint64_t));
+    if (!stats || !rows || !keys) {
+        perror("malloc failed");
+        exit(1);
+    }
+
+    for (uint32_t row_index = table_next_row(table, 0); row_index < table->num_rows; row_index = table_next_row(table, row_index + 1)) {
+        if (version_visible(snapshot, row_slot(table, row_index))) rows[stats->row_count++] = row_index;
+    }
+    for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) {
+        if (table->zone_maps[page_num] != NULL && table->zone_maps[page_num]->row_count > 0) stats->page_count++;
+    }
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        analyze_column(table, rows, stats->row_count, keys, col_index, &stats->columns[col_index]);
+    }
+
+    free(rows);
+    free(keys);
+    return stats;
+}
+
+static int value_sort_key(const Column* column, const char* value, uint64_t* key) {
+    if (column->type != COLUMN_INT) {
+        *key = text_prefix(value, column->size);
+        return 1;
+    }
+    int ok = 0;
+    *key = int_sort_key((int32_t)parse_target_value(value, &ok));
+    return ok;
+}
+
+// share of the rows with a smaller key, read off the histogram and interpolated inside a bucket
+static double fraction_below(const ColumnStats* stats, const uint64_t key) {
+    if (stats->bucket_count == 0 || key <= stats->min_key) return 0;
+    if (key > stats->max_key) return 1;
+
+    uint32_t bucket = 0;
+    while (bucket < stats->bucket_count - 1 && stats->bounds[bucket] < key) bucket++;
+    const uint64_t low = bucket == 0 ? stats->min_key : stats->bounds[bucket - 1];
+    const uint64_t high = stats->bounds[bucket];
+    const double within = high > low && key > low ? (double)(key - low) / (double)(high - low) : 0;
+    return fmin(1.0, (bucket + within) / stats->bucket_count);
+}
+
+static double equal_selectivity(const ColumnStats* stats, const uint64_t key) {
+    if (stats->distinct == 0 || key < stats->min_key || key > stats->max_key) return 0;
+    return 1.0 / stats->distinct;
+}
+
+static double value_selectivity(const ColumnStats* stats, const TokenType type, const uint64_t key) {
+    const double equal = equal_selectivity(stats, key);
+    switch (type) {
+        case TOKEN_EQUAL: return equal;
+        case TOKEN_NOT_EQUAL: return 1 - equal;
+        case TOKEN_LESS: return fraction_below(stats, key);
+        case TOKEN_LESSER_EQUAL: return fmin(1.0, fraction_below(stats, key) + equal);
+        case TOKEN_GREATER: return fmax(0.0, 1 - fraction_below(stats, key) - equal);
+        case TOKEN_GREATER_EQUAL: return 1 - fraction_below(stats, key);
+        default: return 1;
+    }
+}
+
+double condition_selectivity(const TableStats* stats, const Table* table, const Condition* condition) {
+    const Column* column = &table->schema.columns[condition->column_index];
+    const ColumnStats* column_stats = &stats->columns[condition->column_index];
+    uint64_t key;
+    if (condition->type != TOKEN_IN) {
+        // a target that isn't a number matches no INT
+        return value_sort_key(column, condition->value, &key) ? value_selectivity(column_stats, condition->type, key) : 0;
+    }
+
+    double selectivity = 0;
+    for (uint32_t i = 0; i < condition->in_list->count; i++) {
+        if (value_sort_key(column, condition->in_list->values[i], &key)) selectivity += equal_selectivity(column_stats, key);
+    }
+    return fmin(1.0, selectivity);
+}
+
+static double value_page_fraction(const TableStats* stats, const Column* column, const ColumnStats* column_stats,
+                                  const TokenType type, const double selectivity) {
+    // a page is read when its range overlaps the values the condition keeps, or its Bloom filter lets the value through
+    if (selectivity == 0) return 0;
+    double fraction = fmin(1.0, selectivity + column_stats->page_span);
+    if (type == TOKEN_EQUAL && column->bloom_filter && stats->page_count > 0) {
+        const double rows_per_page = (double)stats->row_count / stats->page_count;
+        fraction = fmin(fraction, 1 - pow(1 - selectivity, rows_per_page) + BLOOM_FALSE_POSITIVE_RATE);
+    }
+    return fraction;
+}
+
+double condition_page_fraction(const TableStats* stats, const Table* table, const Condition* condition) {
+    // share of the pages a zone map scan still reads for the condition
+    const Column* column = &table->schema.columns[condition->column_index];
+    const ColumnStats* column_stats = &stats->columns[condition->column_index];
+    switch (condition->type) {
+        case TOKEN_EQUAL:
+        case TOKEN_LESS:
+        case TOKEN_LESSER_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+            return value_page_fraction(stats, column, column_stats, condition->type,
+                                       condition_selectivity(stats, table, condition));
+        case TOKEN_IN: {
+            double fraction = 0;
+            for (uint32_t i = 0; i < condition->in_list->count; i++) {
+                uint64_t key;
+                if (!value_sort_key(column, condition->in_list->values[i], &key)) continue;
+                fraction += value_page_fraction(stats, column, column_stats, TOKEN_EQUAL, equal_selectivity(column_stats, key));
+            }
+            return fmin(1.0, fraction);
+        }
+        default:
+            return 1;
+    }
+}
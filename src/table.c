@@ -1,18 +1,26 @@
+#define _GNU_SOURCE
 #include "table.h"
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "metrics.h"
+
+size_t column_width(const Column* column) {
+    switch (column->type) {
+        case COLUMN_INT:
+            return sizeof(int32_t);
+        case COLUMN_VARCHAR:
+            return column->size;
+    }
+    return 0;
+}
 
 size_t compute_row_size(const TableSchema* schema) {
-    size_t size = 1; // first byte is for deleted flag
+    size_t size = 0;
     for (int i = 0; i < schema->num_columns; i++) {
-        if (schema->columns[i].type == COLUMN_INT) {
-            size += sizeof(int32_t);
-        } else if (schema->columns[i].type == COLUMN_VARCHAR) {
-            size += schema->columns[i].size;
-        }
+        size += column_width(&schema->columns[i]);
     }
     return size;
 }
@@ -27,16 +35,9 @@ Row* create_row(const TableSchema* schema) {
 }
 
 size_t get_column_offset(const TableSchema* schema, const int col_index) {
-    size_t offset = 1;
+    size_t offset = 0;
     for (int i = 0; i < col_index; i++) {
-        switch (schema->columns[i].type) {
-            case COLUMN_INT:
-                offset += sizeof(int32_t);
-                break;
-            case COLUMN_VARCHAR:
-                offset += schema->columns[i].size;
-                break;
-        }
+        offset += column_width(&schema->columns[i]);
     }
     return offset;
 }
@@ -72,89 +73,931 @@ int extract_primary_key(const TableSchema* schema, const Row* row, int pk_index)
 
 
 Table* new_table() {
-    Table* table = malloc(sizeof(Table));
-    table->num_rows = 0;
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-        table->pages[i] = NULL;
-    }
+    Table* table = calloc(1, sizeof(Table));
+    if (!table) return NULL;
+    table->primary_key_index = -1;
+    // readers come and go all the time, preferring the cleaner's write lock keeps it from waiting behind them
+    pthread_rwlockattr_t lock_attributes;
+    pthread_rwlockattr_init(&lock_attributes);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&lock_attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&table->lock, &lock_attributes);
+    pthread_rwlockattr_destroy(&lock_attributes);
+    pthread_mutex_init(&table->write_lock, NULL);
     return table;
 }
 
+static void free_retired_pages(Table* table) {
+    // callers hold the table lock exclusively, no reader is left with a pointer into a retired page
+    for (uint32_t i = 0; i < table->retired_count; i++) free(table->retired_pages[i]);
+    table->retired_count = 0;
+}
+
+static void free_zone_map(ZoneMap* zone_map) {
+    if (zone_map == NULL) return;
+    free(zone_map->bloom_bits);
+    free(zone_map);
+}
+
 void free_table(Table* table) {
+    for (uint32_t row_num = table_next_row(table, 0); row_num < table->num_rows; row_num = table_next_row(table, row_num + 1)) {
+        if (!row_is_free(row_slot(table, row_num))) free_spilled_values(table, row_num);
+    }
+
     for (int i = 0; i < TABLE_MAX_PAGES; i++) {
         if (table->pages[i] != NULL) {
             free(table->pages[i]);
             table->pages[i] = NULL;
         }
+        for (int col_index = 0; col_index < MAX_COLUMNS; col_index++) {
+            free(table->column_pages[col_index][i]);
+            table->column_pages[col_index][i] = NULL;
+        }
+        free_zone_map(table->zone_maps[i]);
+        table->zone_maps[i] = NULL;
+        free(table->compressed_pages[i]);
+        table->compressed_pages[i] = NULL;
+    }
+    free_retired_pages(table);
+    for (int col_index = 0; col_index < MAX_COLUMNS; col_index++) {
+        if (table->dictionaries[col_index] != NULL) free_dictionary(table->dictionaries[col_index]);
     }
 
     if (table->tree != NULL) {
         free_tree(table->tree);
         table->tree = NULL;
     }
-    free(table->name);
+    free(table->stats);
+    pthread_rwlock_destroy(&table->lock);
+    pthread_mutex_destroy(&table->write_lock);
     free(table);
 }
 
+static size_t align_slot(const size_t size) {
+    return (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+static int is_slotted(const Table* table) {
+    return table->storage == STORAGE_ROW;
+}
+
+/*
+ * Slotted pages. A directory entry packs the tuple's offset in the page into its high half and the
+ * length of the space reserved for it into the low half, so readers load it in one atomic access.
+ */
+static uint32_t* page_directory(void* page) {
+    return (uint32_t*)((char*)page + sizeof(PageHeader));
+}
+
+static uint32_t page_slot_count(const void* page) {
+    return __atomic_load_n(&((const PageHeader*)page)->slot_count, __ATOMIC_ACQUIRE);
+}
+
+static size_t page_free_space(const void* page) {
+    const PageHeader* header = page;
+    return header->heap_start - (sizeof(PageHeader) + header->slot_count * sizeof(uint32_t));
+}
+
+static uint32_t slot_entry(const uint32_t offset, const uint32_t length) {
+    return offset << 16 | length;
+}
+
+static void* load_page(Table* table, const uint32_t page_num) {
+    // a thawing writer publishes the page before clearing compressed_pages, so one of the two is seen
+    const CompressedPage* compressed = __atomic_load_n(&table->compressed_pages[page_num], __ATOMIC_ACQUIRE);
+    if (compressed != NULL) return (void*)cached_page(compressed, PAGE_SIZE);
+    return __atomic_load_n(&table->pages[page_num], __ATOMIC_ACQUIRE);
+}
+
+static void* thaw_page(Table* table, const uint32_t page_num) {
+    // callers hold the write lock or the table lock exclusively, readers may still be decompressing the old copy
+    CompressedPage* compressed = table->compressed_pages[page_num];
+    if (compressed == NULL) return table->pages[page_num];
+
+    void* page = malloc(PAGE_SIZE);
+    if (!page) {
+        perror("malloc failed");
+        exit(1);
+    }
+    metrics_add(METRIC_PAGES_ALLOCATED, 1);
+    decompress_page(compressed, page, PAGE_SIZE);
+    __atomic_store_n(&table->pages[page_num], page, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->compressed_pages[page_num], NULL, __ATOMIC_RELEASE);
+
+    table->retired_pages[table->retired_count++] = compressed;
+    __atomic_sub_fetch(&table->compressed_count, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&table->compressed_bytes, compressed->length, __ATOMIC_RELAXED);
+    return page;
+}
+
+static void* init_slotted_page(Table* table, const uint32_t page_num) {
+    // zeroed so the unused middle of the page and the padding of tuples compress well
+    PageHeader* header = calloc(1, PAGE_SIZE);
+    if (!header) {
+        perror("calloc failed");
+        exit(1);
+    }
+    metrics_add(METRIC_PAGES_ALLOCATED, 1);
+    header->slot_count = 0;
+    header->heap_start = PAGE_SIZE;
+    __atomic_store_n(&table->pages[page_num], (void*)header, __ATOMIC_RELEASE);
+    return header;
+}
+
+// VARCHAR columns whose bytes are kept in the row, DICTIONARY encoded ones only keep a code
+static int holds_text(const Column* column) {
+    return column->type == COLUMN_VARCHAR && !column->dictionary_encoded;
+}
+
+static uint32_t row_text_length(const TableSchema* schema, const Row* row, const int col_index) {
+    return (uint32_t)strnlen((const char*)row->data + get_column_offset(schema, col_index), schema->columns[col_index].size);
+}
+
+// picks the strings to spill, longest first, until the tuple is below the threshold and returns its size
+static size_t plan_tuple(const TableSchema* schema, const Row* row, uint8_t* spill) {
+    uint32_t lengths[MAX_COLUMNS];
+    size_t size = ROW_HEADER_SIZE + schema->num_columns * TUPLE_FIELD_SIZE;
+    for (int col_index = 0; col_index < schema->num_columns; col_index++) {
+        spill[col_index] = 0;
+        lengths[col_index] = 0;
+        if (!holds_text(&schema->columns[col_index])) continue;
+        lengths[col_index] = row_text_length(schema, row, col_index);
+        size += lengths[col_index];
+    }
+
+    while (size > TUPLE_SPILL_THRESHOLD) {
+        int longest = -1;
+        for (int col_index = 0; col_index < schema->num_columns; col_index++) {
+            if (spill[col_index] || lengths[col_index] <= sizeof(SpilledText)) continue;
+            if (longest < 0 || lengths[col_index] > lengths[longest]) longest = col_index;
+        }
+        if (longest < 0) break;
+        spill[longest] = 1;
+        size -= lengths[longest] - sizeof(SpilledText);
+    }
+    return align_slot(size);
+}
+
+static size_t stored_tuple_size(Table* table, const uint32_t row_num) {
+    const char* tuple = row_slot(table, row_num);
+    size_t size = ROW_HEADER_SIZE + table->schema.num_columns * TUPLE_FIELD_SIZE;
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (!holds_text(&table->schema.columns[col_index])) continue;
+        uint16_t length;
+        memcpy(&length, tuple + ROW_HEADER_SIZE + col_index * TUPLE_FIELD_SIZE + sizeof(uint16_t), sizeof(uint16_t));
+        size += length & TEXT_SPILLED ? sizeof(SpilledText) : length;
+    }
+    return align_slot(size);
+}
+
+// the width of a column's entries in its column chain
+static size_t column_entry_width(const Column* column) {
+    if (column->dictionary_encoded) return DICTIONARY_CODE_SIZE;
+    if (column->type == COLUMN_VARCHAR && column->size > VARCHAR_INLINE_MAX) return sizeof(SpilledText);
+    return column_width(column);
+}
+
+// carves size bytes off the page's heap for the slot, the space starts out as a free slot
+static void place_tuple(void* page, const uint32_t slot, const size_t size) {
+    PageHeader* header = page;
+    header->heap_start -= size;
+    delete_row((char*)page + header->heap_start);
+    __atomic_store_n(&page_directory(page)[slot], slot_entry(header->heap_start, size), __ATOMIC_RELEASE);
+}
+
+static size_t table_slot_size(const Table* table) {
+    if (table->storage == STORAGE_COLUMN) return align_slot(ROW_HEADER_SIZE);
+    return align_slot(ROW_HEADER_SIZE + table->schema.num_columns * TUPLE_FIELD_SIZE);
+}
+
+uint32_t table_rows_per_page(const Table* table) {
+    if (!is_slotted(table)) return (uint32_t)(PAGE_SIZE / table_slot_size(table));
+
+    // as many slots as tuples with only empty strings would fit, bounded by the free slot bitmap
+    const size_t slots = (PAGE_SIZE - sizeof(PageHeader)) / (sizeof(uint32_t) + table_slot_size(table));
+    return (uint32_t)(slots < FREE_MAP_WORDS * 64 ? slots : FREE_MAP_WORDS * 64);
+}
+
+uint32_t column_rows_per_page(const Table* table, const int col_index) {
+    return (uint32_t)(PAGE_SIZE / column_entry_width(&table->schema.columns[col_index]));
+}
+
+static void* page_entry(void** pages, const uint32_t num, const size_t entry_size) {
+    const size_t entries_per_page = PAGE_SIZE / entry_size;
+
+    const size_t page_num = num / entries_per_page;
+    if (pages[page_num] == NULL) {
+        pages[page_num] = malloc(PAGE_SIZE);
+        if (!pages[page_num]) {
+            perror("malloc failed");
+            exit(1);
+        }
+        metrics_add(METRIC_PAGES_ALLOCATED, 1);
+    }
+    return (char*)pages[page_num] + num % entries_per_page * entry_size;
+}
+
 // Table row allocator function
 void* row_slot(Table* table, uint32_t row_num) {
-    const size_t row_size = compute_row_size(&table->schema) + 1;
-    const size_t rows_per_page = PAGE_SIZE / row_size;
+    if (!is_slotted(table)) return page_entry(table->pages, row_num, table_slot_size(table));
 
-    const size_t page_num = row_num / rows_per_page;
-    if (table->pages[page_num] == NULL) {
-        table->pages[page_num] = malloc(PAGE_SIZE);
-        if (!table->pages[page_num]) {
-            perror("malloc failed");
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    void* page = load_page(table, row_num / rows_per_page);
+    const uint32_t entry = __atomic_load_n(&page_directory(page)[row_num % rows_per_page], __ATOMIC_ACQUIRE);
+    return (char*)page + (entry >> 16);
+}
+
+void* row_slot_for_write(Table* table, const uint32_t row_num) {
+    // a page being written to is no longer known to be visible to everyone, index-only scans check its rows again
+    const uint32_t page_num = row_num / table_rows_per_page(table);
+    __atomic_store_n(&table->all_visible[page_num], 0, __ATOMIC_RELEASE);
+    if (is_slotted(table) && __atomic_load_n(&table->compressed_pages[page_num], __ATOMIC_ACQUIRE) != NULL) {
+        thaw_page(table, page_num);
+    }
+    return row_slot(table, row_num);
+}
+
+uint32_t table_next_row(Table* table, const uint32_t row_num) {
+    if (!is_slotted(table)) return row_num;
+
+    // row numbers past the end of a page's directory have no slot, the page filled up before them
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    uint32_t page_num = row_num / rows_per_page;
+    uint32_t slot = row_num % rows_per_page;
+    for (; page_num < TABLE_MAX_PAGES; page_num++, slot = 0) {
+        const void* page = load_page(table, page_num);
+        if (page != NULL && slot < page_slot_count(page)) return page_num * rows_per_page + slot;
+    }
+    return table_max_rows(table);
+}
+
+void* column_value(Table* table, const uint32_t row_num, const int col_index) {
+    if (table->storage == STORAGE_COLUMN) {
+        return page_entry(table->column_pages[col_index], row_num, column_entry_width(&table->schema.columns[col_index]));
+    }
+
+    char* tuple = row_slot(table, row_num);
+    char* field = tuple + ROW_HEADER_SIZE + col_index * TUPLE_FIELD_SIZE;
+    if (!holds_text(&table->schema.columns[col_index])) return field;
+
+    uint16_t offset;
+    memcpy(&offset, field, sizeof(uint16_t));
+    return tuple + offset;
+}
+
+static const SpilledText* spilled_text(Table* table, const uint32_t row_num, const int col_index) {
+    // spilled values are only read while the version is alive, moving the row copies the SpilledText along
+    const Column* column = &table->schema.columns[col_index];
+    if (table->storage == STORAGE_COLUMN) {
+        if (column_entry_width(column) != sizeof(SpilledText)) return NULL;
+        return column_value(table, row_num, col_index);
+    }
+
+    uint16_t length;
+    memcpy(&length, (char*)row_slot(table, row_num) + ROW_HEADER_SIZE + col_index * TUPLE_FIELD_SIZE + sizeof(uint16_t), sizeof(uint16_t));
+    if (!(length & TEXT_SPILLED)) return NULL;
+    return column_value(table, row_num, col_index);
+}
+
+uint16_t column_code(Table* table, const uint32_t row_num, const int col_index) {
+    uint16_t code;
+    memcpy(&code, column_value(table, row_num, col_index), sizeof(uint16_t));
+    return code;
+}
+
+TextValue column_text(Table* table, const uint32_t row_num, const int col_index) {
+    if (table->schema.columns[col_index].dictionary_encoded) {
+        const DictionaryEntry* entry = dictionary_entry(table->dictionaries[col_index], column_code(table, row_num, col_index));
+        return inline_text(entry->text, entry->length);
+    }
+
+    const SpilledText* spilled = spilled_text(table, row_num, col_index);
+    if (spilled != NULL) {
+        // tuples only keep byte alignment, take a copy of the header before reading it
+        SpilledText header;
+        memcpy(&header, spilled, sizeof(SpilledText));
+        TextValue value = spilled_text_value(&header);
+        value.bytes = (const char*)spilled + offsetof(SpilledText, prefix);
+        return value;
+    }
+
+    const char* text = column_value(table, row_num, col_index);
+    if (table->storage == STORAGE_COLUMN) {
+        return inline_text(text, (uint32_t)strnlen(text, table->schema.columns[col_index].size));
+    }
+
+    uint16_t length;
+    memcpy(&length, (char*)row_slot(table, row_num) + ROW_HEADER_SIZE + col_index * TUPLE_FIELD_SIZE + sizeof(uint16_t), sizeof(uint16_t));
+    return inline_text(text, length);
+}
+
+void free_spilled_values(Table* table, const uint32_t row_num) {
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (!holds_text(&table->schema.columns[col_index])) continue;
+        const SpilledText* spilled = spilled_text(table, row_num, col_index);
+        if (spilled == NULL) continue;
+
+        SpilledText header;
+        memcpy(&header, spilled, sizeof(SpilledText));
+        free_spilled_text(&header);
+    }
+}
+
+int32_t column_int(Table* table, const uint32_t row_num, const int col_index) {
+    int32_t value;
+    memcpy(&value, column_value(table, row_num, col_index), sizeof(int32_t));
+    return value;
+}
+
+uint32_t table_max_rows(const Table* table) {
+    // the chain with the widest entries runs out of pages first
+    uint32_t rows_per_page = table_rows_per_page(table);
+    if (table->storage == STORAGE_COLUMN) {
+        for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+            const uint32_t column_rows = column_rows_per_page(table, col_index);
+            if (column_rows < rows_per_page) rows_per_page = column_rows;
+        }
+    }
+    return rows_per_page * TABLE_MAX_PAGES;
+}
+
+void mark_slot_free(Table* table, const uint32_t row_num) {
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    const uint32_t page_num = row_num / rows_per_page;
+    const uint32_t slot = row_num % rows_per_page;
+
+    uint64_t* word = &table->free_maps[page_num][slot / 64];
+    const uint64_t bit = 1ULL << (slot % 64);
+    if (*word & bit) return;
+    *word |= bit;
+    table->free_counts[page_num]++;
+    table->free_slots++;
+}
+
+static int slot_fits(Table* table, const uint32_t page_num, const uint32_t slot, const size_t size) {
+    if (!is_slotted(table)) return 1;
+
+    void* page = table->pages[page_num];
+    return (page_directory(page)[slot] & 0xFFFF) >= size || page_free_space(page) >= size;
+}
+
+static void claim_slot(Table* table, const uint32_t page_num, const uint32_t slot, const size_t size) {
+    if (!is_slotted(table)) return;
+
+    // a tuple that outgrew the space of the slot gets fresh space from the heap, the old one is left until VACUUM
+    void* page = table->pages[page_num];
+    if ((page_directory(page)[slot] & 0xFFFF) < size) place_tuple(page, slot, size);
+}
+
+static int take_free_slot(Table* table, uint32_t* row_num, const size_t size) {
+    if (table->free_slots == 0) return 0;
+
+    // lowest free slot first, so the live rows drift towards the front of the table
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) {
+        if (table->free_counts[page_num] == 0) continue;
+
+        for (uint32_t word = 0; word < FREE_MAP_WORDS; word++) {
+            for (uint64_t bits = table->free_maps[page_num][word]; bits != 0; bits &= bits - 1) {
+                const uint32_t slot = word * 64 + (uint32_t)__builtin_ctzll(bits);
+                if (!slot_fits(table, page_num, slot, size)) continue;
+
+                claim_slot(table, page_num, slot, size);
+                table->free_maps[page_num][word] &= ~(1ULL << (slot % 64));
+                table->free_counts[page_num]--;
+                table->free_slots--;
+                *row_num = page_num * rows_per_page + slot;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int allocate_row(Table* table, const Row* source, uint32_t* row_num) {
+    // reuse a slot freed by the cleaner before growing the table
+    uint8_t spill[MAX_COLUMNS];
+    const size_t size = is_slotted(table) ? plan_tuple(&table->schema, source, spill) : 0;
+    if (size + sizeof(PageHeader) + sizeof(uint32_t) > PAGE_SIZE) return -1;
+    if (take_free_slot(table, row_num, size)) return 0;
+
+    if (!is_slotted(table)) {
+        if (table->num_rows >= table_max_rows(table)) return -1;
+        *row_num = table->num_rows;
+        return 0;
+    }
+
+    // append to the page holding the last row, or start the next one when it is full
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    for (uint32_t page_num = table->num_rows == 0 ? 0 : (table->num_rows - 1) / rows_per_page; page_num < TABLE_MAX_PAGES; page_num++) {
+        void* page = table->pages[page_num];
+        if (page == NULL) page = init_slotted_page(table, page_num);
+
+        PageHeader* header = page;
+        if (header->slot_count >= rows_per_page || page_free_space(page) < size + sizeof(uint32_t)) continue;
+
+        const uint32_t slot = header->slot_count;
+        place_tuple(page, slot, size);
+        __atomic_store_n(&header->slot_count, slot + 1, __ATOMIC_RELEASE);
+        *row_num = page_num * rows_per_page + slot;
+        return 0;
+    }
+    return -1;
+}
+
+void release_slot(Table* table, const uint32_t row_num) {
+    // callers hold the table lock exclusively and have already freed the version in the slot
+    if (is_slotted(table)) {
+        const uint32_t rows_per_page = table_rows_per_page(table);
+        PageHeader* header = table->pages[row_num / rows_per_page];
+        const uint32_t slot = row_num % rows_per_page;
+        if (slot + 1 == header->slot_count) {
+            const uint32_t entry = page_directory(header)[slot];
+            if (entry >> 16 == header->heap_start) header->heap_start += entry & 0xFFFF;
+            __atomic_store_n(&header->slot_count, slot, __ATOMIC_RELEASE);
+            if (row_num + 1 == table->num_rows) table->num_rows--;
+            return;
+        }
+    } else if (row_num + 1 == table->num_rows) {
+        table->num_rows--;
+        return;
+    }
+    mark_slot_free(table, row_num);
+}
+
+uint64_t text_prefix(const char* text, const size_t size) {
+    // strings compare as unsigned bytes, so do the big-endian numbers made of their first bytes
+    const size_t length = size < ZONE_PREFIX_SIZE ? size : ZONE_PREFIX_SIZE;
+    uint64_t prefix = 0;
+    size_t i = 0;
+    for (; i < length && text[i] != '\0'; i++) prefix = prefix << 8 | (uint8_t)text[i];
+    // the empty string sorts first, and shifting by the whole width of the prefix would be undefined
+    if (i == 0) return 0;
+    return prefix << 8 * (ZONE_PREFIX_SIZE - i);
+}
+
+static uint32_t bloom_column_count(const Table* table) {
+    uint32_t count = 0;
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (table->schema.columns[col_index].bloom_filter) count++;
+    }
+    return count;
+}
+
+// the column's filter in a page's bloom_bits, filters come in column order
+static uint64_t* column_bloom(const Table* table, uint64_t* bloom_bits, const int col_index) {
+    uint32_t position = 0;
+    for (int i = 0; i < col_index; i++) {
+        if (table->schema.columns[i].bloom_filter) position++;
+    }
+    return bloom_bits + position * bloom_words(table_rows_per_page(table));
+}
+
+static uint64_t column_hash(Table* table, const uint32_t row_num, const int col_index) {
+    if (table->schema.columns[col_index].type == COLUMN_INT) {
+        const int32_t value = column_int(table, row_num, col_index);
+        return bloom_hash((const char*)&value, sizeof(value));
+    }
+    const TextValue text = column_text(table, row_num, col_index);
+    return bloom_hash_text(&text);
+}
+
+void zone_map_add(Table* table, const uint32_t row_num) {
+    const uint32_t page_num = row_num / table_rows_per_page(table);
+    ZoneMap* zone_map = table->zone_maps[page_num];
+    if (zone_map == NULL) {
+        zone_map = calloc(1, sizeof(ZoneMap));
+        const uint32_t bloom_columns = bloom_column_count(table);
+        if (zone_map && bloom_columns > 0) {
+            zone_map->bloom_bits = calloc(bloom_columns * bloom_words(table_rows_per_page(table)), sizeof(uint64_t));
+        }
+        if (!zone_map || (bloom_columns > 0 && !zone_map->bloom_bits)) {
+            perror("calloc failed");
             exit(1);
         }
+        table->zone_maps[page_num] = zone_map;
+    }
+
+    // scans read the map without the writer lock, the fields are stored atomically and only ever widen
+    const int first = zone_map->row_count == 0;
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        const Column* column = &table->schema.columns[col_index];
+        ColumnZone* zone = &zone_map->columns[col_index];
+        if (column->type == COLUMN_INT) {
+            const int32_t value = column_int(table, row_num, col_index);
+            if (first || value < zone->min_int) __atomic_store_n(&zone->min_int, value, __ATOMIC_RELAXED);
+            if (first || value > zone->max_int) __atomic_store_n(&zone->max_int, value, __ATOMIC_RELAXED);
+        } else if (column->type == COLUMN_VARCHAR) {
+            const TextValue text = column_text(table, row_num, col_index);
+            const uint64_t prefix = text_prefix(text.bytes, text.inline_length);
+            if (first || prefix < zone->min_prefix) __atomic_store_n(&zone->min_prefix, prefix, __ATOMIC_RELAXED);
+            if (first || prefix > zone->max_prefix) __atomic_store_n(&zone->max_prefix, prefix, __ATOMIC_RELAXED);
+        }
+        if (column->bloom_filter) {
+            bloom_add(column_bloom(table, zone_map->bloom_bits, col_index), bloom_words(table_rows_per_page(table)),
+                      column_hash(table, row_num, col_index));
+        }
     }
+    __atomic_store_n(&zone_map->row_count, zone_map->row_count + 1, __ATOMIC_RELEASE);
+}
+
+int page_may_contain(const Table* table, const uint32_t page_num, const int col_index, const uint64_t hash) {
+    // pages without a filter on the column can't rule the value out
+    const ZoneMap* zone_map = table->zone_maps[page_num];
+    if (zone_map == NULL || !table->schema.columns[col_index].bloom_filter) return 1;
+    return bloom_may_contain(column_bloom(table, zone_map->bloom_bits, col_index),
+                             bloom_words(table_rows_per_page(table)), hash);
+}
+
+static int row_is_movable(const void* row) {
+    // versions still stamped with a transaction id are referenced by that transaction's undo log
+    return !(row_begin_ts(row) & TS_TXN_BIT) && !(row_end_ts(row) & TS_TXN_BIT);
+}
+
+static int row_is_present(Table* table, const uint32_t row_num) {
+    return table_next_row(table, row_num) == row_num && !row_is_free(row_slot(table, row_num));
+}
+
+// returns 0 when the tuple doesn't fit into the destination slot's page
+static int move_row(Table* table, const uint32_t from, const uint32_t to) {
+    if (is_slotted(table)) {
+        const uint32_t rows_per_page = table_rows_per_page(table);
+        const size_t size = stored_tuple_size(table, from);
+        if (!slot_fits(table, to / rows_per_page, to % rows_per_page, size)) return 0;
+        claim_slot(table, to / rows_per_page, to % rows_per_page, size);
+        memcpy(row_slot(table, to), row_slot(table, from), size);
+    } else {
+        memcpy(row_slot(table, to), row_slot(table, from), table_slot_size(table));
+    }
+
+    if (table->storage == STORAGE_COLUMN) {
+        for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+            memcpy(column_value(table, to, col_index), column_value(table, from, col_index),
+                   column_entry_width(&table->schema.columns[col_index]));
+        }
+    }
+    delete_row(row_slot(table, from));
+    return 1;
+}
+
+/*
+ * Packs the tuples of a slotted page against its end, keeping every slot number. Free slots all share
+ * one empty tuple that reserves no space, so the next insert into them takes space from the heap.
+ * Pages holding versions of open transactions are left alone, their undo logs point into the page.
+ */
+static void defragment_page(Table* table, const uint32_t page_num, char* scratch) {
     void* page = table->pages[page_num];
+    PageHeader* header = page;
+    const uint32_t* directory = page_directory(page);
 
+    for (uint32_t slot = 0; slot < header->slot_count; slot++) {
+        const void* tuple = (char*)page + (directory[slot] >> 16);
+        if (!row_is_free(tuple) && !row_is_movable(tuple)) return;
+    }
 
-    const size_t row_offset = row_num % rows_per_page;
-    const size_t byte_offset = row_offset * row_size;
-    return (char*)page + byte_offset;
+    memcpy(scratch, page, PAGE_SIZE);
+    const uint32_t* old_directory = page_directory(scratch);
+    header->heap_start = PAGE_SIZE;
+    uint32_t free_tuple = 0;
+    for (uint32_t slot = 0; slot < header->slot_count; slot++) {
+        const char* tuple = scratch + (old_directory[slot] >> 16);
+        if (row_is_free(tuple)) {
+            if (free_tuple == 0) {
+                header->heap_start -= align_slot(ROW_HEADER_SIZE);
+                free_tuple = header->heap_start;
+                delete_row((char*)page + free_tuple);
+            }
+            page_directory(page)[slot] = slot_entry(free_tuple, 0);
+            continue;
+        }
+        const uint32_t size = old_directory[slot] & 0xFFFF;
+        header->heap_start -= size;
+        memcpy((char*)page + header->heap_start, tuple, size);
+        page_directory(page)[slot] = slot_entry(header->heap_start, size);
+    }
+}
+
+static uint32_t release_pages(void** pages, const uint32_t num_rows, const uint32_t rows_per_page) {
+    uint32_t pages_released = 0;
+    const uint32_t pages_in_use = (num_rows + rows_per_page - 1) / rows_per_page;
+    for (uint32_t page_num = pages_in_use; page_num < TABLE_MAX_PAGES; page_num++) {
+        if (pages[page_num] == NULL) continue;
+        free(pages[page_num]);
+        pages[page_num] = NULL;
+        pages_released++;
+    }
+    return pages_released;
 }
 
-void serialize_row(const TableSchema* schema, const Row* source, void* destination) {
-    // First byte = deleted flag
-    *((uint8_t*)destination) = 0; // 0 = active, 1 = deleted
+uint32_t compact_table(Table* table) {
+    // callers hold the table lock exclusively, nobody else has a pointer into the pages
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    free_retired_pages(table);
+    if (is_slotted(table)) {
+        // moves and defragmentation write anywhere, compress_table seals the pages again afterwards
+        for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) thaw_page(table, page_num);
+        free_retired_pages(table);
+    }
+    uint32_t low = table_next_row(table, 0);
+    uint32_t high = table->num_rows;
 
-    size_t page_offset = 1;  // skip flag in destination
-    size_t row_offset = 0;   // start from beginning of Row->data
+    while (1) {
+        while (low < high && !row_is_free(row_slot(table, low))) low = table_next_row(table, low + 1);
+        while (high > low && !row_is_present(table, high - 1)) high--;
+        if (low >= high) break;
 
-    for (int i = 0; i < schema->num_columns; i++) {
-        size_t col_size = (schema->columns[i].type == COLUMN_INT)
-                              ? sizeof(int32_t)
-                              : schema->columns[i].size;
+        high--;
+        if (!row_is_movable(row_slot(table, high))) continue;
+
+        if (!move_row(table, high, low)) {
+            high++;
+            low = table_next_row(table, low + 1);
+            continue;
+        }
+        if (table->primary_key_index >= 0) {
+            const int32_t key = column_int(table, low, table->primary_key_index);
+            bpt_update(table->tree, (uint32_t)key, high, low);
+        }
+        low = table_next_row(table, low + 1);
+    }
+
+    uint32_t num_rows = table->num_rows;
+    while (num_rows > 0 && !row_is_present(table, num_rows - 1)) num_rows--;
+    table->num_rows = num_rows;
 
-        memcpy((char*)destination + page_offset, source->data + row_offset, col_size);
+    if (is_slotted(table)) {
+        char* scratch = malloc(PAGE_SIZE);
+        if (!scratch) {
+            perror("malloc failed");
+            exit(1);
+        }
+        for (uint32_t page_num = 0; page_num * rows_per_page < num_rows; page_num++) {
+            PageHeader* header = table->pages[page_num];
+            if (header == NULL) continue;
+            if (header->slot_count > num_rows - page_num * rows_per_page) header->slot_count = num_rows - page_num * rows_per_page;
+            defragment_page(table, page_num, scratch);
+        }
+        free(scratch);
+    }
 
-        row_offset  += col_size;
-        page_offset += col_size;
+    memset(table->free_maps, 0, sizeof(table->free_maps));
+    memset(table->free_counts, 0, sizeof(table->free_counts));
+    table->free_slots = 0;
+    for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) {
+        free_zone_map(table->zone_maps[page_num]);
+        table->zone_maps[page_num] = NULL;
+    }
+    for (uint32_t row_num = table_next_row(table, 0); row_num < num_rows; row_num = table_next_row(table, row_num + 1)) {
+        if (row_is_free(row_slot(table, row_num))) mark_slot_free(table, row_num);
+        else zone_map_add(table, row_num);
     }
+
+    uint32_t pages_released = release_pages(table->pages, num_rows, rows_per_page);
+    if (table->storage == STORAGE_COLUMN) {
+        for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+            pages_released += release_pages(table->column_pages[col_index], num_rows,
+                                            column_rows_per_page(table, col_index));
+        }
+    }
+    return pages_released;
 }
 
+static int page_is_sealed(Table* table, const uint32_t page_num) {
+    // the page taking appends and pages with free slots still get new tuples
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    const PageHeader* header = table->pages[page_num];
+    if (header == NULL || table->num_rows == 0 || page_num >= (table->num_rows - 1) / rows_per_page) return 0;
+    if (table->free_counts[page_num] != 0) return 0;
+
+    // and a version that is uncommitted or deleted will still be stamped or freed
+    for (uint32_t slot = 0; slot < header->slot_count; slot++) {
+        const void* tuple = (const char*)header + (page_directory((void*)header)[slot] >> 16);
+        if (row_is_free(tuple) || row_begin_ts(tuple) & TS_TXN_BIT || row_end_ts(tuple) != TS_INFINITY) return 0;
+    }
+    return 1;
+}
 
-void deserialize_row(const TableSchema* schema, void* source, const Row* destination) {
-    size_t page_offset = 1;  // skip deletion flag in page
-    size_t row_offset = 0;   // start of Row->data
+void mark_all_visible(Table* table, const uint64_t horizon) {
+    // callers hold the table lock exclusively. versions committed at or before the oldest snapshot and
+    // never deleted are visible to every snapshot that is open or will be taken
+    const uint32_t rows_per_page = table_rows_per_page(table);
+    memset(table->all_visible, 0, sizeof(table->all_visible));
+    for (uint32_t page_num = 0; page_num * rows_per_page < table->num_rows; page_num++) table->all_visible[page_num] = 1;
+
+    for (uint32_t row_num = table_next_row(table, 0); row_num < table->num_rows; row_num = table_next_row(table, row_num + 1)) {
+        const void* row = row_slot(table, row_num);
+        if (row_is_free(row)) continue;
+        const uint64_t begin_ts = row_begin_ts(row);
+        if (begin_ts & TS_TXN_BIT || begin_ts > horizon || row_end_ts(row) != TS_INFINITY) {
+            table->all_visible[row_num / rows_per_page] = 0;
+        }
+    }
+}
 
-    for (int i = 0; i < schema->num_columns; i++) {
-        size_t col_size = schema->columns[i].type == COLUMN_INT
-                              ? sizeof(int32_t)
-                              : schema->columns[i].size;
+uint32_t compress_table(Table* table) {
+    // callers hold the table lock exclusively
+    uint32_t compressed_count = 0;
+    if (table->compression == COMPRESSION_NONE || !is_slotted(table)) return 0;
+
+    for (uint32_t page_num = 0; page_num < TABLE_MAX_PAGES; page_num++) {
+        if (table->compressed_pages[page_num] != NULL || !page_is_sealed(table, page_num)) continue;
+
+        CompressedPage* compressed = compress_page(table->pages[page_num], PAGE_SIZE);
+        if (compressed == NULL) continue;
+        free(table->pages[page_num]);
+        table->pages[page_num] = NULL;
+        table->compressed_pages[page_num] = compressed;
+        table->compressed_count++;
+        table->compressed_bytes += compressed->length;
+        compressed_count++;
+    }
+    return compressed_count;
+}
+
+size_t index_payload_size(const Table* table) {
+    size_t size = 0;
+    for (uint32_t i = 0; i < table->include_count; i++) size += column_width(&table->schema.columns[table->include_columns[i]]);
+    return size;
+}
+
+// where the column's value sits in the payload of an index entry, -1 when the index doesn't include it
+int index_payload_offset(const Table* table, const int col_index) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < table->include_count; i++) {
+        if ((int)table->include_columns[i] == col_index) return (int)offset;
+        offset += column_width(&table->schema.columns[table->include_columns[i]]);
+    }
+    return -1;
+}
+
+void build_index_payload(const Table* table, const Row* source, uint8_t* payload) {
+    for (uint32_t i = 0; i < table->include_count; i++) {
+        const int col_index = (int)table->include_columns[i];
+        const size_t width = column_width(&table->schema.columns[col_index]);
+        memcpy(payload, source->data + get_column_offset(&table->schema, col_index), width);
+        payload += width;
+    }
+}
+
+// returns the index of a DICTIONARY column whose dictionary has no room for the row's value, -1 when all are encoded
+int encode_row_values(Table* table, const Row* source) {
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        if (!table->schema.columns[col_index].dictionary_encoded) continue;
+        const char* value = (const char*)source->data + get_column_offset(&table->schema, col_index);
+        uint16_t code;
+        if (dictionary_encode(table->dictionaries[col_index], value, row_text_length(&table->schema, source, col_index), &code) != 0)
+            return col_index;
+    }
+    return -1;
+}
+
+static uint16_t value_code(Table* table, const Row* source, const int col_index) {
+    // encode_row_values already gave the value its code, this only looks it up
+    uint16_t code = 0;
+    const char* value = (const char*)source->data + get_column_offset(&table->schema, col_index);
+    dictionary_encode(table->dictionaries[col_index], value, row_text_length(&table->schema, source, col_index), &code);
+    return code;
+}
 
-        memcpy(destination->data + row_offset, (char*)source + page_offset, col_size);
+uint32_t field_value(Table* table, const Row* source, const int col_index) {
+    // INT values and dictionary codes are what a row keeps in its fixed-width fields
+    if (table->schema.columns[col_index].type == COLUMN_INT) {
+        int32_t value;
+        memcpy(&value, source->data + get_column_offset(&table->schema, col_index), sizeof(int32_t));
+        return (uint32_t)value;
+    }
+    return value_code(table, source, col_index);
+}
 
-        row_offset  += col_size;
-        page_offset += col_size;
+// overwrites the field where it is and returns the value it held
+uint32_t write_field(Table* table, const uint32_t row_num, const int col_index, const uint32_t value) {
+    row_slot_for_write(table, row_num);
+    char* field = column_value(table, row_num, col_index);
+    if (table->schema.columns[col_index].type == COLUMN_INT) {
+        int32_t old_value;
+        const int32_t new_value = (int32_t)value;
+        memcpy(&old_value, field, sizeof(int32_t));
+        memcpy(field, &new_value, sizeof(int32_t));
+        return (uint32_t)old_value;
+    }
+    uint16_t old_code;
+    const uint16_t new_code = (uint16_t)value;
+    memcpy(&old_code, field, sizeof(uint16_t));
+    memcpy(field, &new_code, sizeof(uint16_t));
+    return old_code;
+}
+
+void update_index_payload(Table* table, const uint32_t row_num) {
+    // the entry keeps its key and row number, only the copies of the INCLUDE columns change
+    if (table->primary_key_index < 0 || table->include_count == 0) return;
+    Row* row = create_row(&table->schema);
+    deserialize_row(table, row_num, row);
+    uint8_t payload[BPT_MAX_PAYLOAD];
+    build_index_payload(table, row, payload);
+    bpt_update_payload(table->tree, (uint32_t)extract_primary_key(&table->schema, row, table->primary_key_index), row_num, payload);
+    free(row->data);
+    free(row);
+}
+
+void serialize_row(Table* table, const Row* source, const uint32_t row_num) {
+    // a new version is live from the moment its writer commits until someone deletes it. the slot may
+    // be a reused one that readers are still skipping, so it is only marked as taken once it is invisible
+    char* destination = row_slot_for_write(table, row_num);
+    set_row_begin_ts(destination, TS_INFINITY);
+    set_row_end_ts(destination, TS_INFINITY);
+
+    const TableSchema* schema = &table->schema;
+    if (table->storage == STORAGE_COLUMN) {
+        for (int col_index = 0; col_index < schema->num_columns; col_index++) {
+            const Column* column = &schema->columns[col_index];
+            const char* value = (const char*)source->data + get_column_offset(schema, col_index);
+            if (column->dictionary_encoded) {
+                const uint16_t code = value_code(table, source, col_index);
+                memcpy(column_value(table, row_num, col_index), &code, sizeof(uint16_t));
+                continue;
+            }
+            if (column_entry_width(column) == sizeof(SpilledText)) {
+                SpilledText spilled;
+                spill_text(&spilled, value, row_text_length(schema, source, col_index));
+                memcpy(column_value(table, row_num, col_index), &spilled, sizeof(SpilledText));
+                continue;
+            }
+            memcpy(column_value(table, row_num, col_index), value, column_width(column));
+        }
+    } else {
+        // INT values and dictionary codes sit in their field, VARCHAR fields hold the offset and length of the bytes after the fields
+        uint8_t spill[MAX_COLUMNS];
+        plan_tuple(schema, source, spill);
+        uint16_t offset = (uint16_t)(ROW_HEADER_SIZE + schema->num_columns * TUPLE_FIELD_SIZE);
+        for (int col_index = 0; col_index < schema->num_columns; col_index++) {
+            const char* value = (const char*)source->data + get_column_offset(schema, col_index);
+            char* field = destination + ROW_HEADER_SIZE + col_index * TUPLE_FIELD_SIZE;
+            if (schema->columns[col_index].type == COLUMN_INT) {
+                memcpy(field, value, sizeof(int32_t));
+                continue;
+            }
+            if (schema->columns[col_index].dictionary_encoded) {
+                const uint16_t code = value_code(table, source, col_index);
+                memset(field, 0, TUPLE_FIELD_SIZE);
+                memcpy(field, &code, sizeof(uint16_t));
+                continue;
+            }
+            const uint32_t length = row_text_length(schema, source, col_index);
+            uint16_t stored_length = (uint16_t)length;
+            if (spill[col_index]) {
+                SpilledText spilled;
+                spill_text(&spilled, value, length);
+                memcpy(destination + offset, &spilled, sizeof(SpilledText));
+                stored_length = TEXT_SPILLED;
+            } else {
+                memcpy(destination + offset, value, length);
+            }
+            memcpy(field, &offset, sizeof(uint16_t));
+            memcpy(field + sizeof(uint16_t), &stored_length, sizeof(uint16_t));
+            offset += spill[col_index] ? sizeof(SpilledText) : length;
+        }
+    }
+
+    __atomic_store_n((uint8_t*)destination + ROW_FLAG_OFFSET, 0, __ATOMIC_RELEASE); // 0 = holds a version, 1 = free
+}
+
+
+void deserialize_row(Table* table, const uint32_t row_num, const Row* destination) {
+    for (int col_index = 0; col_index < table->schema.num_columns; col_index++) {
+        char* value = (char*)destination->data + get_column_offset(&table->schema, col_index);
+        if (table->schema.columns[col_index].type == COLUMN_INT) {
+            memcpy(value, column_value(table, row_num, col_index), sizeof(int32_t));
+            continue;
+        }
+        const TextValue text = column_text(table, row_num, col_index);
+        memset(value, 0, table->schema.columns[col_index].size);
+        read_text(&text, value);
     }
 }
 
 void delete_row(void* row) {
-    *(uint8_t*)row = 1; // mark as deleted
+    __atomic_store_n((uint8_t*)row + ROW_FLAG_OFFSET, 1, __ATOMIC_RELEASE); // mark the slot as free
+}
+
+int row_is_free(const void* row) {
+    return __atomic_load_n((const uint8_t*)row + ROW_FLAG_OFFSET, __ATOMIC_ACQUIRE) != 0;
+}
+
+uint64_t row_begin_ts(const void* row) {
+    return __atomic_load_n((const uint64_t*)row, __ATOMIC_ACQUIRE);
+}
+
+uint64_t row_end_ts(const void* row) {
+    return __atomic_load_n((const uint64_t*)row + 1, __ATOMIC_ACQUIRE);
+}
+
+void set_row_begin_ts(void* row, const uint64_t ts) {
+    __atomic_store_n((uint64_t*)row, ts, __ATOMIC_RELEASE);
+}
+
+void set_row_end_ts(void* row, const uint64_t ts) {
+    __atomic_store_n((uint64_t*)row + 1, ts, __ATOMIC_RELEASE);
 }
 
 int32_t get_column_index(const TableSchema* schema, const char* column_name) {
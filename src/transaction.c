@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include "transaction.h"
+#include "binary_plus_tree.h"
+#include "database.h"
+#include "metrics.h"
+
+// guards the commit clock and the list of active transactions, commits are serialized on it
+static pthread_mutex_t transaction_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t last_commit_ts = 0;
+static uint64_t next_txn_id = 1;
+static Transaction* active_transactions = NULL;
+static uint32_t dead_since_clean = 0;
+
+// a wakeup sent while the cleaner is busy stays pending until it looks again
+static pthread_mutex_t cleaner_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cleaner_wakeup = PTHREAD_COND_INITIALIZER;
+static int cleaner_pending = 0;
+
+int begin_transaction(Transaction* txn) {
+    if (txn->active) return -1;
+    txn->active = 1;
+    txn->undo_count = 0;
+
+    pthread_mutex_lock(&transaction_lock);
+    txn->snapshot.read_ts = last_commit_ts;
+    txn->snapshot.txn_id = next_txn_id++;
+    txn->next_active = active_transactions;
+    active_transactions = txn;
+    pthread_mutex_unlock(&transaction_lock);
+    return 0;
+}
+
+static void unlink_transaction(Transaction* txn) {
+    for (Transaction** link = &active_transactions; *link != NULL; link = &(*link)->next_active) {
+        if (*link == txn) {
+            *link = txn->next_active;
+            break;
+        }
+    }
+    txn->next_active = NULL;
+    txn->undo_count = 0;
+    txn->active = 0;
+}
+
+static void end_transaction(Transaction* txn) {
+    pthread_mutex_lock(&transaction_lock);
+    unlink_transaction(txn);
+    pthread_mutex_unlock(&transaction_lock);
+}
+
+void commit_transaction(Transaction* txn) {
+    metrics_add(METRIC_COMMITS, 1);
+    if (txn->undo_count == 0) {
+        end_transaction(txn);
+        return;
+    }
+
+    // the versions written so far carry the transaction id, swap them for the commit timestamp
+    // before publishing it so a snapshot taken afterwards sees the whole transaction at once.
+    // the undo buffer is kept for the next transaction so batched writes don't pay for it again
+    pthread_mutex_lock(&transaction_lock);
+    const uint64_t commit_ts = last_commit_ts + 1;
+    for (uint32_t i = 0; i < txn->undo_count; i++) {
+        const UndoRecord* record = &txn->undo_log[i];
+        switch (record->type) {
+            case UNDO_INSERT:
+                set_row_begin_ts(record->row_ptr, commit_ts);
+                __atomic_add_fetch(&record->table->live_rows, 1, __ATOMIC_RELAXED);
+                break;
+            case UNDO_DELETE:
+                set_row_end_ts(record->row_ptr, commit_ts);
+                __atomic_sub_fetch(&record->table->live_rows, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&record->table->dead_versions, 1, __ATOMIC_RELAXED);
+                dead_since_clean++;
+                break;
+            case UNDO_UPDATE:
+                // the version was overwritten in place, its begin stamp comes with the insert record
+                break;
+        }
+    }
+    __atomic_store_n(&last_commit_ts, commit_ts, __ATOMIC_RELEASE);
+    unlink_transaction(txn);
+    const int wake_cleaner = dead_since_clean >= CLEANER_DEAD_VERSION_THRESHOLD;
+    if (wake_cleaner) dead_since_clean = 0;
+    pthread_mutex_unlock(&transaction_lock);
+
+    if (wake_cleaner) {
+        pthread_mutex_lock(&cleaner_lock);
+        cleaner_pending = 1;
+        pthread_cond_signal(&cleaner_wakeup);
+        pthread_mutex_unlock(&cleaner_lock);
+    }
+}
+
+static void undo_record(const UndoRecord* record) {
+    Table* table = record->table;
+    switch (record->type) {
+        case UNDO_INSERT:
+            pthread_rwlock_wrlock(&table->lock);
+            if (record->has_key) bpt_delete(table->tree, record->key, record->row_num);
+            free_spilled_values(table, record->row_num);
+            delete_row(record->row_ptr);
+            // records are undone newest first, so appended rows come off the end of the table
+            // unless another session has appended behind them in the meantime
+            release_slot(table, record->row_num);
+            pthread_rwlock_unlock(&table->lock);
+            break;
+        case UNDO_DELETE:
+            set_row_end_ts(record->row_ptr, TS_INFINITY);
+            break;
+        case UNDO_UPDATE:
+            // nobody else sees the version, the lock only keeps VACUUM from compressing its page meanwhile
+            pthread_rwlock_rdlock(&table->lock);
+            write_field(table, record->row_num, record->col_index, record->old_value);
+            if (index_payload_offset(table, record->col_index) >= 0) update_index_payload(table, record->row_num);
+            pthread_rwlock_unlock(&table->lock);
+            break;
+    }
+}
+
+void rollback_to_savepoint(Transaction* txn, const uint32_t savepoint) {
+    while (txn->undo_count > savepoint) {
+        txn->undo_count--;
+        undo_record(&txn->undo_log[txn->undo_count]);
+    }
+}
+
+void rollback_transaction(Transaction* txn) {
+    metrics_add(METRIC_ROLLBACKS, 1);
+    rollback_to_savepoint(txn, 0);
+    end_transaction(txn);
+}
+
+static UndoRecord* append_undo_record(Transaction* txn) {
+    if (txn->undo_count == txn->undo_capacity) {
+        const uint32_t capacity = txn->undo_capacity ? txn->undo_capacity * 2 : 64;
+        UndoRecord* undo_log = realloc(txn->undo_log, capacity * sizeof(UndoRecord));
+        if (!undo_log) {
+            perror("realloc failed");
+            exit(1);
+        }
+        txn->undo_log = undo_log;
+        txn->undo_capacity = capacity;
+    }
+    return &txn->undo_log[txn->undo_count++];
+}
+
+void log_insert(Transaction* txn, Table* table, const uint32_t row_num, void* row_ptr, const int has_key, const uint32_t key) {
+    UndoRecord* record = append_undo_record(txn);
+    record->type = UNDO_INSERT;
+    record->table = table;
+    record->row_num = row_num;
+    record->row_ptr = row_ptr;
+    record->has_key = has_key;
+    record->key = key;
+}
+
+void log_delete(Transaction* txn, Table* table, void* row_ptr) {
+    UndoRecord* record = append_undo_record(txn);
+    record->type = UNDO_DELETE;
+    record->table = table;
+    record->row_ptr = row_ptr;
+    record->has_key = 0;
+}
+
+void log_update(Transaction* txn, Table* table, const uint32_t row_num, const int col_index, const uint32_t old_value) {
+    UndoRecord* record = append_undo_record(txn);
+    record->type = UNDO_UPDATE;
+    record->table = table;
+    record->row_num = row_num;
+    record->row_ptr = NULL;
+    record->has_key = 0;
+    record->col_index = col_index;
+    record->old_value = old_value;
+}
+
+int version_visible(const Snapshot* snapshot, const void* row_ptr) {
+    if (row_is_free(row_ptr)) return 0;
+
+    const uint64_t begin_ts = row_begin_ts(row_ptr);
+    if (begin_ts & TS_TXN_BIT) {
+        if ((begin_ts & ~TS_TXN_BIT) != snapshot->txn_id) return 0;
+    } else if (begin_ts > snapshot->read_ts) {
+        return 0;
+    }
+
+    const uint64_t end_ts = row_end_ts(row_ptr);
+    if (end_ts & TS_TXN_BIT) return (end_ts & ~TS_TXN_BIT) != snapshot->txn_id;
+    return end_ts > snapshot->read_ts;
+}
+
+void stamp_insert(const Transaction* txn, void* row_ptr) {
+    set_row_begin_ts(row_ptr, TS_TXN_BIT | txn->snapshot.txn_id);
+    set_row_end_ts(row_ptr, TS_INFINITY);
+}
+
+WriteResult delete_version(Transaction* txn, Table* table, void* row_ptr) {
+    // first writer wins: a version deleted by anyone after our snapshot can't be deleted again
+    if (row_end_ts(row_ptr) != TS_INFINITY) return WRITE_CONFLICT;
+
+    set_row_end_ts(row_ptr, TS_TXN_BIT | txn->snapshot.txn_id);
+    log_delete(txn, table, row_ptr);
+    return WRITE_SUCCESS;
+}
+
+uint64_t oldest_active_snapshot() {
+    pthread_mutex_lock(&transaction_lock);
+    uint64_t horizon = last_commit_ts;
+    for (const Transaction* txn = active_transactions; txn != NULL; txn = txn->next_active) {
+        if (txn->snapshot.read_ts < horizon) horizon = txn->snapshot.read_ts;
+    }
+    pthread_mutex_unlock(&transaction_lock);
+    return horizon;
+}
+
+uint32_t collect_dead_versions(Table* table, const uint64_t horizon) {
+    uint32_t reclaimed = 0;
+    for (uint32_t row_index = table_next_row(table, 0); row_index < table->num_rows; row_index = table_next_row(table, row_index + 1)) {
+        void* row_ptr = row_slot(table, row_index);
+        if (row_is_free(row_ptr)) continue;
+
+        // a version that ended at or before the oldest snapshot is invisible to every reader
+        const uint64_t end_ts = row_end_ts(row_ptr);
+        if (end_ts & TS_TXN_BIT || end_ts > horizon) continue;
+
+        if (table->primary_key_index >= 0) {
+            const int32_t key = column_int(table, row_index, table->primary_key_index);
+            bpt_delete(table->tree, (uint32_t)key, row_index);
+        }
+        free_spilled_values(table, row_index);
+        delete_row(row_slot_for_write(table, row_index));
+        mark_slot_free(table, row_index);
+        reclaimed++;
+    }
+
+    __atomic_sub_fetch(&table->dead_versions, reclaimed, __ATOMIC_RELAXED);
+    return reclaimed;
+}
+
+uint32_t reclaim_dead_versions(Table* table) {
+    // the write lock waits out every statement still holding a pointer into the table. the horizon is
+    // taken after it, the snapshots that ended while we waited no longer hold versions back
+    pthread_rwlock_wrlock(&table->lock);
+    const uint32_t reclaimed = collect_dead_versions(table, oldest_active_snapshot());
+    pthread_rwlock_unlock(&table->lock);
+    return reclaimed;
+}
+
+void run_cleaner() {
+    pthread_rwlock_rdlock(&global_db.lock);
+    for (uint32_t i = 0; i < global_db.num_tables; i++) {
+        Table* table = global_db.tables[i];
+        if (__atomic_load_n(&table->dead_versions, __ATOMIC_RELAXED) == 0) continue;
+        reclaim_dead_versions(table);
+    }
+    pthread_rwlock_unlock(&global_db.lock);
+}
+
+static void* cleaner_main(void* arg) {
+    (void)arg;
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CLEANER_INTERVAL_SECONDS;
+
+        pthread_mutex_lock(&cleaner_lock);
+        int timed_out = 0;
+        while (!cleaner_pending && !timed_out) {
+            timed_out = pthread_cond_timedwait(&cleaner_wakeup, &cleaner_lock, &deadline) == ETIMEDOUT;
+        }
+        cleaner_pending = 0;
+        pthread_mutex_unlock(&cleaner_lock);
+
+        run_cleaner();
+    }
+    return NULL;
+}
+
+void start_cleaner() {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, cleaner_main, NULL) != 0) {
+        perror("pthread_create failed");
+        exit(1);
+    }
+    pthread_detach(thread);
+}
+
+int table_in_use(const Table* table) {
+    // callers hold the catalog write lock, so no other session is running a statement that grows its undo log
+    pthread_mutex_lock(&transaction_lock);
+    int in_use = 0;
+    for (const Transaction* txn = active_transactions; txn != NULL && !in_use; txn = txn->next_active) {
+        for (uint32_t i = 0; i < txn->undo_count; i++) {
+            if (txn->undo_log[i].table == table) { in_use = 1; break; }
+        }
+    }
+    pthread_mutex_unlock(&transaction_lock);
+    return in_use;
+}